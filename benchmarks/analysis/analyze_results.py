@@ -1,4 +1,5 @@
 import os
+import json
 import pandas as pd
 import matplotlib.pyplot as plt
 import re
@@ -19,9 +20,41 @@ def parse_ycsb_log(file_path):
                 metrics['Update_P95_Lat'] = float(line.split(',')[-1].strip())
             if "[READ], 95thPercentileLatency(us)" in line:
                 metrics['Read_P95_Lat'] = float(line.split(',')[-1].strip())
+            if "[UPDATE], 99thPercentileLatency(us)" in line:
+                metrics['Update_P99_Lat'] = float(line.split(',')[-1].strip())
+            if "[READ], 99thPercentileLatency(us)" in line:
+                metrics['Read_P99_Lat'] = float(line.split(',')[-1].strip())
                 
     return metrics
 
+def parse_c_results(file_path):
+    # JSON written by the C benchmark / ycsb_bench -o: a list of runs, each
+    # with per-operation latency percentiles in us
+    with open(file_path, 'r') as f:
+        try:
+            runs = json.load(f)
+        except ValueError:
+            return []
+    if not isinstance(runs, list):
+        return []
+
+    rows = []
+    for run in runs:
+        if not isinstance(run, dict) or 'engine' not in run or 'operations' not in run:
+            continue
+        row = {'DB': 'c-' + run['engine'].lower(), 'Workload': run['workload'],
+               'Throughput': run['throughput']}
+        if run.get('waf') is not None:
+            row['WAF'] = run['waf']
+        for op, name in (('read', 'Read'), ('update', 'Update')):
+            stats = run['operations'].get(op)
+            if stats:
+                row[f'{name}_Avg_Lat'] = stats['mean_us']
+                row[f'{name}_P95_Lat'] = stats['p95_us']
+                row[f'{name}_P99_Lat'] = stats['p99_us']
+        rows.append(row)
+    return rows
+
 def main():
     results_dir = sys.argv[1] if len(sys.argv) > 1 else "results"
     data = []
@@ -41,6 +74,8 @@ def main():
                     row = {'DB': db, 'Workload': workload}
                     row.update(metrics)
                     data.append(row)
+            elif filename.endswith(".json"):
+                data.extend(parse_c_results(os.path.join(root, filename)))
 
     df = pd.DataFrame(data)
     
@@ -84,5 +119,18 @@ def main():
         plt.savefig(latency_path)
         print(f"Generated {latency_path}")
 
+    # Tail latency (Read / Update P99): where flush stalls and lock convoys show up
+    for col, title, name in (('Read_P99_Lat', 'Read P99 Latency Comparison', 'read_p99_latency_comparison.png'),
+                             ('Update_P99_Lat', 'Update P99 Latency Comparison', 'update_p99_latency_comparison.png')):
+        if col in df.columns and df[col].notna().any():
+            pivot = df.pivot_table(index='Workload', columns='DB', values=col, aggfunc='mean')
+            pivot.plot(kind='bar', figsize=(10, 6))
+            plt.title(title)
+            plt.ylabel('Latency (us)')
+            plt.tight_layout()
+            path = os.path.join(charts_dir, name)
+            plt.savefig(path)
+            print(f"Generated {path}")
+
 if __name__ == "__main__":
     main()
@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include "arena.h"
+
+static ArenaBlock* arena_new_block(Arena *a, size_t size) {
+    ArenaBlock *b;
+    HugeMem mem;
+    if (a->huge_pages && hp_alloc(&mem, sizeof(ArenaBlock) + size, true)) {
+        b = (ArenaBlock*)mem.ptr;
+        b->mem = mem;
+        size = mem.size - sizeof(ArenaBlock); // Use the whole rounded-up mapping
+        a->page_kind = mem.kind;
+    } else {
+        b = (ArenaBlock*)malloc(sizeof(ArenaBlock) + size);
+        b->mem.ptr = NULL;
+    }
+    b->size = size;
+    b->used = 0;
+    b->next = a->blocks;
+    a->blocks = b;
+    atomic_fetch_add(&a->bytes_allocated, size);
+    atomic_fetch_add(&a->num_blocks, 1);
+    return b;
+}
+
+void arena_init(Arena *a, size_t block_size, bool huge_pages) {
+    a->blocks = NULL;
+    a->huge_pages = huge_pages;
+    a->page_kind = HP_NONE;
+    // A huge page per block at least, or the mapping is mostly wasted
+    if (huge_pages && block_size < HP_HUGE_PAGE_SIZE - sizeof(ArenaBlock)) {
+        block_size = HP_HUGE_PAGE_SIZE - sizeof(ArenaBlock);
+    }
+    a->block_size = block_size;
+    a->bytes_allocated = 0;
+    a->num_blocks = 0;
+    pthread_mutex_init(&a->grow_lock, NULL);
+    atomic_store(&a->current, arena_new_block(a, block_size));
+}
+
+void* arena_alloc(Arena *a, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+
+    if (size > a->block_size / 4) {
+        // Big allocations get a private block so they don't waste the shared one
+        pthread_mutex_lock(&a->grow_lock);
+        ArenaBlock *b = arena_new_block(a, size);
+        b->used = size;
+        pthread_mutex_unlock(&a->grow_lock);
+        return b->data;
+    }
+
+    for (;;) {
+        ArenaBlock *b = atomic_load_explicit(&a->current, memory_order_acquire);
+        size_t off = atomic_fetch_add_explicit(&b->used, size, memory_order_relaxed);
+        if (off + size <= b->size) return b->data + off;
+
+        // Block exhausted: the first thread to get here installs a fresh one
+        pthread_mutex_lock(&a->grow_lock);
+        if (atomic_load(&a->current) == b) {
+            atomic_store_explicit(&a->current, arena_new_block(a, a->block_size), memory_order_release);
+        }
+        pthread_mutex_unlock(&a->grow_lock);
+    }
+}
+
+size_t arena_memory_usage(Arena *a) {
+    return atomic_load(&a->bytes_allocated);
+}
+
+void arena_destroy(Arena *a) {
+    ArenaBlock *b = a->blocks;
+    while (b) {
+        ArenaBlock *next = b->next;
+        if (b->mem.ptr) {
+            HugeMem mem = b->mem; // The header lives inside the mapping
+            hp_free(&mem);
+        } else {
+            free(b);
+        }
+        b = next;
+    }
+    a->blocks = NULL;
+    atomic_store(&a->current, NULL);
+    pthread_mutex_destroy(&a->grow_lock);
+}
@@ -0,0 +1,41 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "hugepage.h"
+
+// Bump allocator for structures that are freed all at once (memtables).
+// Allocation is lock-free while the current block has room; only moving to a
+// new block takes grow_lock. Memory is released in bulk by arena_destroy.
+// With huge_pages each block is its own 2MB-aligned mapping (see hugepage.h)
+// instead of a malloc.
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    HugeMem mem; // Mapping behind the block, ptr NULL when malloc'd
+    size_t size;
+    _Atomic size_t used;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    _Atomic(ArenaBlock*) current;
+    ArenaBlock *blocks; // Every block ever allocated, for arena_destroy
+    size_t block_size;
+    bool huge_pages;
+    HugePageKind page_kind;     // What the last mapped block got
+    _Atomic size_t bytes_allocated;
+    _Atomic size_t num_blocks;  // Trips to the system allocator
+    pthread_mutex_t grow_lock;
+} Arena;
+
+void arena_init(Arena *a, size_t block_size, bool huge_pages);
+void* arena_alloc(Arena *a, size_t size); // 8-byte aligned
+size_t arena_memory_usage(Arena *a);
+void arena_destroy(Arena *a);
+
+#endif
@@ -0,0 +1,158 @@
+#define _GNU_SOURCE // posix_memalign
+#include <stdlib.h>
+#include <string.h>
+#include "blockcache.h"
+
+static uint64_t bc_hash(uint64_t file_id, uint64_t offset) {
+    uint64_t h = file_id * 0x9e3779b97f4a7c15ULL ^ (offset / BC_BLOCK_SIZE);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Low bits pick the shard, high bits the bucket inside it
+static BCShard* bc_shard(BlockCache *c, uint64_t h) {
+    return &c->shards[h % (uint64_t)c->num_shards];
+}
+
+static int32_t* bc_bucket(BCShard *s, uint64_t h) {
+    return &s->buckets[(h >> 32) % s->num_buckets];
+}
+
+static int32_t bc_find(BCShard *s, uint64_t h, uint64_t file_id, uint64_t offset) {
+    for (int32_t i = *bc_bucket(s, h); i != -1; i = s->slots[i].next) {
+        if (s->slots[i].file_id == file_id && s->slots[i].offset == offset) return i;
+    }
+    return -1;
+}
+
+BlockCache* bc_create(size_t capacity_bytes, int num_shards) {
+    size_t blocks = capacity_bytes / BC_BLOCK_SIZE;
+    if (blocks == 0) return NULL;
+    if (num_shards < 1) num_shards = 1;
+    if ((size_t)num_shards > blocks) num_shards = (int)blocks;
+
+    BlockCache *c = (BlockCache*)malloc(sizeof(BlockCache));
+    c->num_shards = num_shards;
+    c->capacity = 0;
+    void *mem;
+    if (posix_memalign(&mem, 64, sizeof(BCShard) * num_shards) != 0) {
+        free(c);
+        return NULL;
+    }
+    c->shards = (BCShard*)mem;
+    for (int i = 0; i < num_shards; i++) {
+        BCShard *s = &c->shards[i];
+        memset(s, 0, sizeof(BCShard));
+        pthread_mutex_init(&s->lock, NULL);
+        s->num_slots = blocks / num_shards + ((size_t)i < blocks % num_shards ? 1 : 0);
+        s->slots = (BCSlot*)calloc(s->num_slots, sizeof(BCSlot));
+        if (posix_memalign(&mem, BC_BLOCK_SIZE, s->num_slots * BC_BLOCK_SIZE) != 0) mem = NULL;
+        s->data = (char*)mem;
+        s->num_buckets = s->num_slots * 2;
+        s->buckets = (int32_t*)malloc(sizeof(int32_t) * s->num_buckets);
+        memset(s->buckets, 0xff, sizeof(int32_t) * s->num_buckets); // -1
+        c->capacity += s->num_slots * BC_BLOCK_SIZE;
+    }
+    return c;
+}
+
+bool bc_get(BlockCache *c, uint64_t file_id, uint64_t offset, char *dst) {
+    uint64_t h = bc_hash(file_id, offset);
+    BCShard *s = bc_shard(c, h);
+    pthread_mutex_lock(&s->lock);
+    int32_t i = bc_find(s, h, file_id, offset);
+    if (i == -1) {
+        s->misses++;
+        pthread_mutex_unlock(&s->lock);
+        return false;
+    }
+    s->slots[i].referenced = true;
+    s->hits++;
+    memcpy(dst, s->data + (size_t)i * BC_BLOCK_SIZE, BC_BLOCK_SIZE);
+    pthread_mutex_unlock(&s->lock);
+    return true;
+}
+
+static void bc_unlink(BCShard *s, int32_t victim) {
+    BCSlot *v = &s->slots[victim];
+    int32_t *pp = bc_bucket(s, bc_hash(v->file_id, v->offset));
+    while (*pp != victim) pp = &s->slots[*pp].next;
+    *pp = v->next;
+}
+
+void bc_put(BlockCache *c, uint64_t file_id, uint64_t offset, const char *src) {
+    uint64_t h = bc_hash(file_id, offset);
+    BCShard *s = bc_shard(c, h);
+    pthread_mutex_lock(&s->lock);
+    if (bc_find(s, h, file_id, offset) != -1) { // Another reader got there first
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+
+    // CLOCK: nothing is pinned, so two sweeps always find a victim
+    int32_t victim;
+    for (;;) {
+        victim = (int32_t)s->clock_hand;
+        s->clock_hand = (s->clock_hand + 1) % s->num_slots;
+        BCSlot *v = &s->slots[victim];
+        if (!v->used) break;
+        if (v->referenced) {
+            v->referenced = false;
+            continue;
+        }
+        bc_unlink(s, victim);
+        s->evictions++;
+        break;
+    }
+
+    BCSlot *v = &s->slots[victim];
+    v->file_id = file_id;
+    v->offset = offset;
+    v->used = true;
+    v->referenced = false; // A block read once is the first to go; a hit earns it a sweep
+    int32_t *head = bc_bucket(s, h);
+    v->next = *head;
+    *head = victim;
+    memcpy(s->data + (size_t)victim * BC_BLOCK_SIZE, src, BC_BLOCK_SIZE);
+    pthread_mutex_unlock(&s->lock);
+}
+
+void bc_counters(BlockCache *c, uint64_t *hits, uint64_t *misses, uint64_t *evictions, size_t *used_bytes) {
+    *hits = *misses = *evictions = 0;
+    *used_bytes = 0;
+    for (int i = 0; i < c->num_shards; i++) {
+        BCShard *s = &c->shards[i];
+        pthread_mutex_lock(&s->lock);
+        *hits += s->hits;
+        *misses += s->misses;
+        *evictions += s->evictions;
+        for (size_t j = 0; j < s->num_slots; j++) {
+            if (s->slots[j].used) *used_bytes += BC_BLOCK_SIZE;
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+void bc_reset_stats(BlockCache *c) {
+    for (int i = 0; i < c->num_shards; i++) {
+        BCShard *s = &c->shards[i];
+        pthread_mutex_lock(&s->lock);
+        s->hits = s->misses = s->evictions = 0;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+void bc_free(BlockCache *c) {
+    if (!c) return;
+    for (int i = 0; i < c->num_shards; i++) {
+        BCShard *s = &c->shards[i];
+        pthread_mutex_destroy(&s->lock);
+        free(s->slots);
+        free(s->data);
+        free(s->buckets);
+    }
+    free(c->shards);
+    free(c);
+}
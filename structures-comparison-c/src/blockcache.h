@@ -0,0 +1,60 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// SSTable block cache. SSTables are read with O_DIRECT, so this is the only
+// cache between a lookup and the device and its budget is the whole read
+// cache of the LSM-Tree.
+//
+// Blocks are keyed by (file id, offset) and spread over shards by hash; each
+// shard has its own lock, hash chains and CLOCK hand over a fixed set of
+// 4KB slots, so threads reading different blocks rarely meet. Blocks are
+// copied in and out under the shard lock: nothing is pinned, and eviction
+// never waits for a reader.
+
+#define BC_BLOCK_SIZE 4096
+#define BC_DEFAULT_SHARDS 16
+
+typedef struct {
+    uint64_t file_id;
+    uint64_t offset;
+    int32_t next;    // Hash chain, -1 at the end
+    bool used;
+    bool referenced; // CLOCK bit, set on every hit
+} BCSlot;
+
+typedef struct {
+    pthread_mutex_t lock;
+    BCSlot *slots;
+    char *data;        // num_slots blocks, 4KB aligned
+    size_t num_slots;
+    int32_t *buckets;  // Chain heads, -1 when empty
+    size_t num_buckets;
+    size_t clock_hand;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} __attribute__((aligned(64))) BCShard;
+
+typedef struct {
+    BCShard *shards;
+    int num_shards;
+    size_t capacity; // Bytes of block slots, all shards together
+} BlockCache;
+
+// capacity_bytes is rounded down to whole blocks, at least one per shard.
+// Returns NULL if it is under one block (no cache).
+BlockCache* bc_create(size_t capacity_bytes, int num_shards);
+// Copies the block into dst (BC_BLOCK_SIZE bytes) and returns true on a hit
+bool bc_get(BlockCache *c, uint64_t file_id, uint64_t offset, char *dst);
+// Caches a block just read from disk, evicting with CLOCK if the shard is full
+void bc_put(BlockCache *c, uint64_t file_id, uint64_t offset, const char *src);
+void bc_counters(BlockCache *c, uint64_t *hits, uint64_t *misses, uint64_t *evictions, size_t *used_bytes);
+void bc_reset_stats(BlockCache *c);
+void bc_free(BlockCache *c);
+
+#endif
@@ -0,0 +1,55 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bloom.h"
+
+// 64-bit finalizer (splitmix64), good enough to spread sequential keys
+static uint64_t bloom_hash(uint64_t key) {
+    key += 0x9e3779b97f4a7c15ULL;
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+}
+
+void bloom_init(BloomFilter *bf, size_t num_keys, int bits_per_key) {
+    // k = bits_per_key * ln(2) minimizes the false positive rate
+    int k = (int)(bits_per_key * 0.69);
+    if (k < 1) k = 1;
+    if (k > 30) k = 30;
+
+    size_t bits = num_keys * (size_t)bits_per_key;
+    if (bits < 64) bits = 64; // Tiny tables would otherwise see a very high FP rate
+
+    bf->num_bytes = (uint32_t)((bits + 7) / 8);
+    bf->num_hashes = (uint32_t)k;
+    bf->bits = (uint8_t*)calloc(bf->num_bytes, 1);
+}
+
+void bloom_add(BloomFilter *bf, uint64_t key) {
+    uint64_t h = bloom_hash(key);
+    uint64_t delta = (h >> 33) | (h << 31);
+    uint64_t nbits = (uint64_t)bf->num_bytes * 8;
+    for (uint32_t i = 0; i < bf->num_hashes; i++) {
+        uint64_t bit = h % nbits;
+        bf->bits[bit / 8] |= (uint8_t)(1 << (bit % 8));
+        h += delta;
+    }
+}
+
+bool bloom_may_contain(const BloomFilter *bf, uint64_t key) {
+    if (!bf->bits || bf->num_bytes == 0) return true; // No filter: must read the file
+    uint64_t h = bloom_hash(key);
+    uint64_t delta = (h >> 33) | (h << 31);
+    uint64_t nbits = (uint64_t)bf->num_bytes * 8;
+    for (uint32_t i = 0; i < bf->num_hashes; i++) {
+        uint64_t bit = h % nbits;
+        if ((bf->bits[bit / 8] & (1 << (bit % 8))) == 0) return false;
+        h += delta;
+    }
+    return true;
+}
+
+void bloom_free(BloomFilter *bf) {
+    free(bf->bits);
+    bf->bits = NULL;
+    bf->num_bytes = 0;
+}
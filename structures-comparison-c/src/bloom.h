@@ -0,0 +1,21 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Classic Bloom filter with double hashing (LevelDB style): one 64-bit hash
+// per key, k probes derived as h + i*delta.
+typedef struct {
+    uint8_t *bits;
+    uint32_t num_bytes;
+    uint32_t num_hashes;
+} BloomFilter;
+
+void bloom_init(BloomFilter *bf, size_t num_keys, int bits_per_key);
+void bloom_add(BloomFilter *bf, uint64_t key);
+bool bloom_may_contain(const BloomFilter *bf, uint64_t key);
+void bloom_free(BloomFilter *bf);
+
+#endif
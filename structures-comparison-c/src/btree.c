@@ -1,230 +1,1044 @@
-#define _GNU_SOURCE // Needed for O_DIRECT and posix_memalign
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <fcntl.h>
-#include <unistd.h>
+#include <sched.h>
 #include "btree.h"
+#include "keysearch.h"
+#include "stats.h"
 
-void free_node(BTreeNode *node); // Forward declaration
+#define BTREE_DEFAULT_FILE "btree_data.db"
 
-BTreeNode* create_node(int t, bool is_leaf) {
-    BTreeNode *node = (BTreeNode*)malloc(sizeof(BTreeNode));
-    node->t = t; // Warning: struct definition in .c or .h? .h didn't have t in node.
-    // Let's pass t implicitly or fix struct. 
-    // Usually B-Tree nodes don't need to store t if Tree has it, but for split we need t.
-    // We will allocate max size based on t.
-    node->keys = (uint64_t*)malloc(sizeof(uint64_t) * (2 * t - 1));
-    node->values = (uint64_t*)malloc(sizeof(uint64_t) * (2 * t - 1));
-    node->children = (BTreeNode**)malloc(sizeof(BTreeNode*) * (2 * t));
-    node->num_keys = 0;
-    node->is_leaf = is_leaf;
-    return node;
+void btree_node_layout(int t, char *data, BTreeNode *n) {
+    int max_keys = 2 * t - 1;
+    n->frame = NULL;
+    n->hdr = (BTreePageHeader*)data;
+    n->keys = (uint64_t*)(data + sizeof(BTreePageHeader));
+    n->values = n->keys + max_keys;
+    n->children = n->values + max_keys;
 }
-// Fix struct in header or just use parameter.
 
+// Same, for a pinned page
+static void node_view(BTree *tree, BPFrame *f, BTreeNode *n) {
+    btree_node_layout(tree->t, f->data, n);
+    n->frame = f;
+}
+
+typedef enum { LATCH_SHARED, LATCH_EXCLUSIVE } LatchMode;
+
+static void node_latch(BTreeNode *n, LatchMode mode) {
+    if (mode == LATCH_SHARED) {
+        stats_rdlock(&n->frame->latch);
+    } else {
+        stats_wrlock(&n->frame->latch);
+        bp_write_begin(n->frame);
+    }
+}
+
+// Pins the page (any disk read happens in the pool with no latch of this
+// page held) and then latches it
+static void node_get(BTree *tree, uint64_t page_no, BTreeNode *n, LatchMode mode) {
+    node_view(tree, bp_fetch(tree->pool, page_no), n);
+    node_latch(n, mode);
+}
+
+static void create_node(BTree *tree, bool is_leaf, BTreeNode *n) {
+    node_view(tree, bp_new_page(tree->pool), n);
+    node_latch(n, LATCH_EXCLUSIVE);
+    n->hdr->num_keys = 0;
+    n->hdr->is_leaf = is_leaf;
+    n->hdr->next_leaf = BTREE_NO_PAGE;
+}
+
+static void node_put(BTree *tree, BTreeNode *n, bool dirty) {
+    // Only the exclusive holder can have left the version odd
+    if (atomic_load_explicit(&n->frame->version, memory_order_relaxed) & 1) bp_write_end(n->frame);
+    pthread_rwlock_unlock(&n->frame->latch);
+    bp_unpin(tree->pool, n->frame, dirty);
+}
+
+static bool node_full(BTree *tree, const BTreeNode *n) {
+    return n->hdr->num_keys == 2 * (uint32_t)tree->t - 1;
+}
+
+// First slot among the first num_keys whose key is >= key (SIMD when the
+// CPU has it, see keysearch.h). Counted as the comparisons of a binary
+// search over the node.
+static inline int node_find_in(const BTreeNode *n, uint32_t num_keys, uint64_t key) {
+    if (num_keys) stats_add(STAT_KEY_COMPARISONS, 32 - __builtin_clz(num_keys));
+    return ks_lower_bound(n->keys, (int)num_keys, key);
+}
+
+static inline int node_find(const BTreeNode *n, uint64_t key) {
+    return node_find_in(n, n->hdr->num_keys, key);
+}
+
+// Child of an inner node that covers key: separator i is the first key of
+// child i+1, so a key equal to it goes right
+static inline int node_child_index_in(const BTreeNode *n, uint32_t num_keys, uint64_t key) {
+    int i = node_find_in(n, num_keys, key);
+    if (i < (int)num_keys && n->keys[i] == key) i++;
+    return i;
+}
+
+static inline int node_child_index(const BTreeNode *n, uint64_t key) {
+    return node_child_index_in(n, n->hdr->num_keys, key);
+}
 
-// ... Implementation details for insert/search/delete would go here 
-// For brevity in this turn, I will implement a simplified version or just required stubs 
-// if the user wants full implementation I should do it. 
-// "Refaça essa aplicação em C puro" implies full implementation.
+static uint64_t node_page_no(const BTreeNode *n) {
+    return n->frame->page_no;
+}
+
+// root_latch held exclusively
+static void btree_write_meta(BTree *tree) {
+    BPFrame *f = bp_fetch(tree->pool, BTREE_META_PAGE);
+    pthread_rwlock_wrlock(&f->latch);
+    BTreeMeta *meta = (BTreeMeta*)f->data;
+    meta->magic = BTREE_MAGIC;
+    meta->root = tree->root;
+    meta->t = tree->t;
+    meta->byte_values = tree->heap != NULL;
+    pthread_rwlock_unlock(&f->latch);
+    bp_unpin(tree->pool, f, true);
+}
+
+// Latches the root in the given mode, without root_latch: whoever replaces
+// the root does it with the old root page latched exclusively, so once we
+// hold it latched and it is still `root`, it stays the root until we let go.
+// If it was replaced in between, start over from the new one.
+static void btree_get_root(BTree *tree, BTreeNode *n, LatchMode mode) {
+    for (;;) {
+        uint64_t root = atomic_load(&tree->root);
+        node_get(tree, root, n, mode);
+        if (atomic_load(&tree->root) == root) return;
+        node_put(tree, n, false);
+    }
+}
+
+// Shared crabbing down to the leaf that would hold key, returned latched,
+// for in-place heap updates and btree_traverse (lookups and scans read
+// optimistically, below). Returns how many pages the descent visited.
+static int btree_find_leaf(BTree *tree, uint64_t key, BTreeNode *leaf) {
+    BTreeNode cur;
+    int pages = 1;
+    btree_get_root(tree, &cur, LATCH_SHARED);
+    while (!cur.hdr->is_leaf) {
+        // Crab: latch the child before letting go of the parent
+        BTreeNode child;
+        node_get(tree, cur.children[node_child_index(&cur, key)], &child, LATCH_SHARED);
+        node_put(tree, &cur, false);
+        cur = child;
+        pages++;
+    }
+    *leaf = cur;
+    return pages;
+}
+
+void btree_traverse(BTree *tree, uint64_t page_no) {
+    (void)page_no; // Leaves are linked: walk them from the leftmost one
+    BTreeNode cur;
+    btree_find_leaf(tree, 0, &cur);
+    for (;;) {
+        for (uint32_t i = 0; i < cur.hdr->num_keys; i++) printf(" %lu", cur.keys[i]);
+        if (cur.hdr->next_leaf == BTREE_NO_PAGE) break;
+        BTreeNode next;
+        node_get(tree, cur.hdr->next_leaf, &next, LATCH_SHARED);
+        node_put(tree, &cur, false);
+        cur = next;
+    }
+    node_put(tree, &cur, false);
+}
+
+// Optimistic reads. Lookups and scans latch nothing: they pin each page,
+// take its version (bufpool.h), copy what they need and check the version
+// again before trusting the copy. A child's page number is checked before it
+// is fetched, and the parent once more after the child's version is taken,
+// so the child was still linked there at that point; anything that changes
+// it later moves its own version. The same goes for the next leaf of a
+// scan. A read that fails a check drops its pins and starts over, giving
+// the writer in the way a chance to finish.
+
+// Pins the page and takes its version; false (unpinned) while a writer has it
+static bool node_read(BTree *tree, uint64_t page_no, BTreeNode *n, uint64_t *version) {
+    node_view(tree, bp_fetch(tree->pool, page_no), n);
+    if (bp_read_begin(n->frame, version)) return true;
+    bp_unpin(tree->pool, n->frame, false);
+    return false;
+}
+
+static void node_unpin(BTree *tree, BTreeNode *n) {
+    bp_unpin(tree->pool, n->frame, false);
+}
 
-void btree_traverse(BTreeNode *node) {
-    if (node != NULL) {
-        int i;
-        for (i = 0; i < node->num_keys; i++) {
-            if (!node->is_leaf) btree_traverse(node->children[i]);
-            printf(" %lu", node->keys[i]);
+// num_keys of a page that may be changing under the reader: read once and
+// kept in bounds, so a torn image can't send a search off the page
+static uint32_t node_num_keys_optimistic(BTree *tree, const BTreeNode *n) {
+    uint32_t num_keys = *(volatile uint32_t*)&n->hdr->num_keys;
+    uint32_t max_keys = 2 * (uint32_t)tree->t - 1;
+    return num_keys < max_keys ? num_keys : max_keys;
+}
+
+static void btree_read_restart(BTree *tree) {
+    atomic_fetch_add(&tree->read_restarts, 1);
+    sched_yield();
+}
+
+// Optimistic descent to the leaf that would hold key, returned pinned with
+// its version in *version. False (nothing pinned) if a check failed. *pages
+// counts the pages visited either way.
+static bool btree_find_leaf_optimistic(BTree *tree, uint64_t key, BTreeNode *leaf, uint64_t *version, int *pages) {
+    BTreeNode cur;
+    uint64_t v;
+    uint64_t root = atomic_load(&tree->root);
+    if (!node_read(tree, root, &cur, &v)) return false;
+    (*pages)++;
+    // The root is replaced with the old one latched exclusively: still the
+    // root once its version is taken, any replacement from here on moves it
+    if (atomic_load(&tree->root) != root) {
+        node_unpin(tree, &cur);
+        return false;
+    }
+    while (!cur.hdr->is_leaf) {
+        uint32_t num_keys = node_num_keys_optimistic(tree, &cur);
+        uint64_t child_page = cur.children[node_child_index_in(&cur, num_keys, key)];
+        BTreeNode child;
+        uint64_t child_version;
+        if (!bp_read_valid(cur.frame, v) || !node_read(tree, child_page, &child, &child_version)) {
+            node_unpin(tree, &cur);
+            return false;
         }
-        if (!node->is_leaf) btree_traverse(node->children[i]);
+        (*pages)++;
+        bool linked = bp_read_valid(cur.frame, v);
+        node_unpin(tree, &cur);
+        cur = child;
+        v = child_version;
+        if (!linked) {
+            node_unpin(tree, &cur);
+            return false;
+        }
+    }
+    *leaf = cur;
+    *version = v;
+    return true;
+}
+
+// Copies the value out: the page may be evicted as soon as it is unpinned.
+// A heap tuple is only deleted after the leaf stops pointing at it, so a
+// leaf whose version held across the heap read vouches for the tuple too.
+static bool btree_search_node(BTree *tree, uint64_t key, void *buf, uint32_t cap, uint32_t *len) {
+    int pages = 0;
+    for (;;) {
+        BTreeNode leaf;
+        uint64_t v;
+        if (!btree_find_leaf_optimistic(tree, key, &leaf, &v, &pages)) {
+            btree_read_restart(tree);
+            continue;
+        }
+        uint32_t num_keys = node_num_keys_optimistic(tree, &leaf);
+        int i = node_find_in(&leaf, num_keys, key);
+        bool found = i < (int)num_keys && leaf.keys[i] == key;
+        uint64_t value = found ? leaf.values[i] : 0;
+        bool valid = bp_read_valid(leaf.frame, v);
+        if (valid && found && tree->heap) {
+            int heap_pages;
+            int n = vh_read(tree->heap, value, buf, cap, &heap_pages);
+            pages += heap_pages;
+            valid = bp_read_valid(leaf.frame, v);
+            found = n >= 0;
+            if (found) *len = (uint32_t)n;
+        } else if (valid && found) {
+            memcpy(buf, &value, cap < sizeof(uint64_t) ? cap : sizeof(uint64_t));
+            *len = sizeof(uint64_t);
+        }
+        node_unpin(tree, &leaf);
+        if (!valid) {
+            btree_read_restart(tree);
+            continue;
+        }
+        stats_add(STAT_LOOKUPS, 1);
+        stats_add(STAT_LOOKUP_FILES, 1);
+        stats_add(STAT_LOOKUP_BLOCKS, pages);
+        return found;
+    }
+}
+
+bool btree_search(BTree *tree, uint64_t key, uint64_t *value) {
+    uint64_t v = 0;
+    uint32_t len;
+    if (!btree_search_node(tree, key, &v, sizeof(v), &len)) return false;
+    if (value) *value = v;
+    return true;
+}
+
+bool btree_get(BTree *tree, uint64_t key, void *buf, uint32_t cap, uint32_t *len) {
+    return btree_search_node(tree, key, buf, cap, len);
+}
+
+// Pins the leaf that holds start and returns the slot of the first key >= start
+static int btree_scan_seek(BTree *tree, uint64_t start, BTreeNode *leaf, uint64_t *version) {
+    int pages = 0;
+    while (!btree_find_leaf_optimistic(tree, start, leaf, version, &pages)) btree_read_restart(tree);
+    return node_find_in(leaf, node_num_keys_optimistic(tree, leaf), start);
+}
+
+// btree_scan; without read_values heap tuples aren't read and cb gets a NULL
+// value with the right length (statistics). Each entry is checked against
+// the leaf's version before cb sees it; after a failed check the scan goes
+// down again to the first key it hasn't passed on yet.
+static size_t btree_scan_values(BTree *tree, uint64_t start, size_t limit, BTreeScanFn cb, void *arg, bool read_values) {
+    size_t count = 0;
+    char *buf = tree->heap && read_values ? (char*)malloc(VH_MAX_VALUE) : NULL;
+    BTreeNode cur;
+    uint64_t v;
+    int i = btree_scan_seek(tree, start, &cur, &v);
+    for (;;) {
+        bool ok;
+        uint32_t num_keys = node_num_keys_optimistic(tree, &cur);
+        if (i < (int)num_keys) {
+            if (limit && count == limit) break;
+            uint64_t key = cur.keys[i], value = cur.values[i];
+            ok = bp_read_valid(cur.frame, v);
+            const void *out = &value;
+            uint32_t len = sizeof(uint64_t);
+            int n = 0;
+            if (ok && tree->heap) {
+                out = buf;
+                len = vh_tid_len(value);
+                if (buf) {
+                    n = vh_read(tree->heap, value, buf, VH_MAX_VALUE, NULL);
+                    ok = bp_read_valid(cur.frame, v);
+                }
+            }
+            if (ok) {
+                i++;
+                if (n < 0) continue;
+                count++;
+                if (!cb(arg, key, out, len) || key == UINT64_MAX) break;
+                start = key + 1;
+                continue;
+            }
+        } else {
+            uint64_t next_page = cur.hdr->next_leaf;
+            ok = bp_read_valid(cur.frame, v);
+            if (ok && next_page == BTREE_NO_PAGE) break;
+            BTreeNode next;
+            uint64_t next_version;
+            if (ok && node_read(tree, next_page, &next, &next_version)) {
+                ok = bp_read_valid(cur.frame, v);
+                node_unpin(tree, &cur);
+                cur = next;
+                v = next_version;
+                i = 0;
+                if (ok) continue;
+            }
+        }
+        node_unpin(tree, &cur);
+        btree_read_restart(tree);
+        i = btree_scan_seek(tree, start, &cur, &v);
     }
+    node_unpin(tree, &cur);
+    free(buf);
+    return count;
 }
 
-uint64_t* btree_search_node(BTreeNode *node, uint64_t key) {
-    int i = 0;
-    while (i < node->num_keys && key > node->keys[i]) i++;
-    if (i < node->num_keys && key == node->keys[i]) return &node->values[i];
-    if (node->is_leaf) return NULL;
-    return btree_search_node(node->children[i], key);
+size_t btree_scan(BTree *tree, uint64_t start, size_t limit, BTreeScanFn cb, void *arg) {
+    return btree_scan_values(tree, start, limit, cb, arg, true);
 }
 
-uint64_t* btree_search(BTree *tree, uint64_t key) {
-    pthread_mutex_lock(&tree->lock);
-    uint64_t* res = btree_search_node(tree->root, key);
-    pthread_mutex_unlock(&tree->lock);
-    // If res points to node memory, and node is split/freed... 
-    // B-Tree insert splits nodes. Original node might be modified.
-    // Pointers to keys/values inside node array might be invalid if realloc happens?
-    // We used malloc for arrays.
-    // Safe-ish if we don't dereference after unlock?
-    // Benchmark just checks non-null.
-    return res;
+uint64_t btree_node_split(int t, BTreeNode *y, BTreeNode *z) {
+    uint64_t sep;
+    if (y->hdr->is_leaf) {
+        // y keeps t-1 entries, z gets the other t
+        z->hdr->num_keys = t;
+        memcpy(z->keys, y->keys + t - 1, sizeof(uint64_t) * t);
+        memcpy(z->values, y->values + t - 1, sizeof(uint64_t) * t);
+        sep = z->keys[0];
+    } else {
+        z->hdr->num_keys = t - 1;
+        memcpy(z->keys, y->keys + t, sizeof(uint64_t) * (t - 1));
+        memcpy(z->children, y->children + t, sizeof(uint64_t) * t);
+        sep = y->keys[t - 1];
+    }
+    y->hdr->num_keys = t - 1;
+    return sep;
 }
 
+void btree_node_add_child(BTreeNode *x, int i, uint64_t sep, uint64_t right) {
+    int n = x->hdr->num_keys;
+    memmove(x->children + i + 2, x->children + i + 1, sizeof(uint64_t) * (n - i));
+    x->children[i + 1] = right;
+    memmove(x->keys + i + 1, x->keys + i, sizeof(uint64_t) * (n - i));
+    x->keys[i] = sep;
+    x->hdr->num_keys++;
+}
+
+// Splits the full i-th child of x. x is latched exclusively by the caller,
+// who marks it dirty; the two halves are released when done. The new leaf
+// is linked in after the old one.
 void btree_split_child(BTree *tree, BTreeNode *x, int i) {
-    int t = tree->t;
-    BTreeNode *y = x->children[i];
-    BTreeNode *z = create_node(t, y->is_leaf);
-    z->num_keys = t - 1;
+    BTreeNode y, z;
+    node_get(tree, x->children[i], &y, LATCH_EXCLUSIVE);
+    create_node(tree, y.hdr->is_leaf, &z);
 
-    for (int j = 0; j < t - 1; j++) {
-        z->keys[j] = y->keys[j + t];
-        z->values[j] = y->values[j + t];
+    uint64_t sep = btree_node_split(tree->t, &y, &z);
+    if (y.hdr->is_leaf) {
+        z.hdr->next_leaf = y.hdr->next_leaf;
+        y.hdr->next_leaf = node_page_no(&z);
     }
+    btree_node_add_child(x, i, sep, node_page_no(&z));
 
-    if (!y->is_leaf) {
-        for (int j = 0; j < t; j++) z->children[j] = y->children[j + t];
+    node_put(tree, &y, true);
+    node_put(tree, &z, true);
+}
+
+static void leaf_insert_at(BTreeNode *leaf, int i, uint64_t key, uint64_t value) {
+    for (int j = leaf->hdr->num_keys; j > i; j--) {
+        leaf->keys[j] = leaf->keys[j - 1];
+        leaf->values[j] = leaf->values[j - 1];
     }
+    leaf->keys[i] = key;
+    leaf->values[i] = value;
+    leaf->hdr->num_keys++;
+}
 
-    y->num_keys = t - 1;
+// Insert or update in a leaf latched exclusively. Returns false (nothing
+// changed) when the key is new and the leaf is full. *old gets the value
+// replaced, 0 if the key is new.
+static bool leaf_put(BTree *tree, BTreeNode *leaf, uint64_t key, uint64_t value, uint64_t *old) {
+    int i = node_find(leaf, key);
+    if (i < (int)leaf->hdr->num_keys && leaf->keys[i] == key) {
+        *old = leaf->values[i];
+        leaf->values[i] = value; // Update in place
+        return true;
+    }
+    if (node_full(tree, leaf)) return false;
+    *old = 0;
+    leaf_insert_at(leaf, i, key, value);
+    return true;
+}
 
-    for (int j = x->num_keys; j >= i + 1; j--) x->children[j + 1] = x->children[j];
-    x->children[i + 1] = z;
+// Pessimistic descent from x (latched exclusively, non-full), splitting full
+// children on the way down. The parent is released as soon as the child is
+// latched and known not to be full, so a split never reaches back up.
+// Consumes the latch and pin on x.
+void btree_insert_non_full(BTree *tree, BTreeNode *x, uint64_t key, uint64_t value, uint64_t *old) {
+    BTreeNode cur = *x;
+    for (;;) {
+        if (cur.hdr->is_leaf) {
+            leaf_put(tree, &cur, key, value, old);
+            node_put(tree, &cur, true);
+            return;
+        }
 
-    for (int j = x->num_keys - 1; j >= i; j--) {
-        x->keys[j + 1] = x->keys[j];
-        x->values[j + 1] = x->values[j];
+        int i = node_child_index(&cur, key);
+        BTreeNode child;
+        node_get(tree, cur.children[i], &child, LATCH_EXCLUSIVE);
+        if (node_full(tree, &child)) {
+            node_put(tree, &child, false);
+            btree_split_child(tree, &cur, i);
+            if (key >= cur.keys[i]) i++;
+            node_get(tree, cur.children[i], &child, LATCH_EXCLUSIVE);
+            node_put(tree, &cur, true);
+        } else {
+            node_put(tree, &cur, false);
+        }
+        cur = child;
     }
+}
+
+// Optimistic attempt: shared latches down to the leaf, exclusive only there.
+// Returns false (having changed nothing) when the insert needs a split.
+static bool btree_insert_optimistic(BTree *tree, uint64_t key, uint64_t value, uint64_t *old) {
+    BTreeNode cur;
+    btree_get_root(tree, &cur, LATCH_SHARED);
+    if (cur.hdr->is_leaf) { // Single-node tree: the root itself needs the exclusive latch
+        node_put(tree, &cur, false);
+        return false;
+    }
+    for (;;) {
+        BTreeNode child;
+        node_get(tree, cur.children[node_child_index(&cur, key)], &child, LATCH_SHARED);
+        if (!child.hdr->is_leaf) {
+            node_put(tree, &cur, false);
+            cur = child;
+            continue;
+        }
+
+        // Trade the leaf's shared latch for an exclusive one. The parent's
+        // shared latch stops anyone from splitting the leaf in between.
+        pthread_rwlock_unlock(&child.frame->latch);
+        node_latch(&child, LATCH_EXCLUSIVE);
+        node_put(tree, &cur, false);
+
+        bool done = leaf_put(tree, &child, key, value, old);
+        node_put(tree, &child, done);
+        return done;
+    }
+}
+
+static void btree_insert_pessimistic(BTree *tree, uint64_t key, uint64_t value, uint64_t *old) {
+    stats_wrlock(&tree->root_latch);
+    BTreeNode root;
+    node_get(tree, tree->root, &root, LATCH_EXCLUSIVE);
+    if (node_full(tree, &root)) {
+        // Grow a new root; root_latch stays held so nobody reaches the old one meanwhile
+        BTreeNode s;
+        create_node(tree, false, &s);
+        s.children[0] = tree->root;
+        tree->root = node_page_no(&s);
+        btree_write_meta(tree);
+        node_put(tree, &root, false); // btree_split_child latches it again
+        btree_split_child(tree, &s, 0);
+        root = s;
+    }
+    pthread_rwlock_unlock(&tree->root_latch);
+    btree_insert_non_full(tree, &root, key, value, old);
+}
+
+// --- Bulk load ---
+//
+// A sorted batch going into an empty tree is built bottom-up instead of key
+// by key: the leaves are packed full, left to right, then each inner level
+// is built over the one below it, up to a single root. Every level takes a
+// run of fresh page numbers and is written around the buffer pool,
+// BTREE_BULK_RUN pages per write, so the load costs one sequential write per
+// page instead of a split cascade and random write-backs. Entries are spread
+// evenly over each level's nodes, which keeps every node at or above the
+// minimum fill.
+
+#define BTREE_BULK_RUN 64 // Pages per sequential write (256KB)
+
+typedef struct {
+    BTree *tree;
+    char *buf;          // BTREE_BULK_RUN page images, 4KB aligned for O_DIRECT
+    uint64_t next_page; // Page number of buf's first page
+    int used;
+    bool failed;
+} BulkWriter;
 
-    x->keys[i] = y->keys[t - 1];
-    x->values[i] = y->values[t - 1];
-    x->num_keys++;
+static void bulk_flush(BulkWriter *w) {
+    if (w->used == 0) return;
+    if (!bp_write_run(w->tree->pool, w->next_page, w->buf, w->used)) w->failed = true;
+    w->next_page += w->used;
+    w->used = 0;
 }
 
-void btree_insert_non_full(BTree *tree, BTreeNode *x, uint64_t key, uint64_t value) {
-    int i = x->num_keys - 1;
-    if (x->is_leaf) {
-        while (i >= 0 && key < x->keys[i]) {
-            x->keys[i + 1] = x->keys[i];
-            x->values[i + 1] = x->values[i];
-            i--;
+// Next page of the run, zeroed, as a node view
+static void bulk_node(BulkWriter *w, bool is_leaf, BTreeNode *n) {
+    if (w->used == BTREE_BULK_RUN) bulk_flush(w);
+    char *data = w->buf + (size_t)w->used++ * BP_PAGE_SIZE;
+    memset(data, 0, BP_PAGE_SIZE);
+    btree_node_layout(w->tree->t, data, n);
+    n->hdr->is_leaf = is_leaf;
+    n->hdr->next_leaf = BTREE_NO_PAGE;
+}
+
+// Builds the tree over n strictly increasing keys and returns its root page,
+// or BTREE_NO_PAGE if a write failed. root_latch held exclusively.
+static uint64_t btree_bulk_build(BTree *tree, const uint64_t *keys, const uint64_t *values, size_t n) {
+    BulkWriter w = {tree, NULL, 0, 0, false};
+    if (posix_memalign((void**)&w.buf, BP_PAGE_SIZE, (size_t)BTREE_BULK_RUN * BP_PAGE_SIZE) != 0) return BTREE_NO_PAGE;
+
+    // Leaves; seps[j] is the first key of node j of the level just built
+    uint64_t cap = 2 * tree->t - 1;
+    uint64_t nodes = (n + cap - 1) / cap;
+    uint64_t first = bp_alloc_run(tree->pool, nodes);
+    uint64_t *seps = (uint64_t*)malloc(sizeof(uint64_t) * nodes);
+    w.next_page = first;
+    size_t pos = 0;
+    for (uint64_t j = 0; j < nodes; j++) {
+        uint32_t cnt = n / nodes + (j < n % nodes);
+        BTreeNode leaf;
+        bulk_node(&w, true, &leaf);
+        leaf.hdr->num_keys = cnt;
+        memcpy(leaf.keys, keys + pos, sizeof(uint64_t) * cnt);
+        memcpy(leaf.values, values + pos, sizeof(uint64_t) * cnt);
+        if (j + 1 < nodes) leaf.hdr->next_leaf = first + j + 1;
+        seps[j] = keys[pos];
+        pos += cnt;
+    }
+    bulk_flush(&w);
+
+    // Inner levels until one node is left. Node j's separator is written
+    // back into seps[j] once seps[pos >= j] has been read, so one array does.
+    cap = 2 * tree->t; // Children per inner node
+    while (nodes > 1) {
+        uint64_t items = nodes, child_first = first;
+        nodes = (items + cap - 1) / cap;
+        first = bp_alloc_run(tree->pool, nodes);
+        w.next_page = first;
+        pos = 0;
+        for (uint64_t j = 0; j < nodes; j++) {
+            uint32_t cnt = items / nodes + (j < items % nodes);
+            BTreeNode inner;
+            bulk_node(&w, false, &inner);
+            inner.hdr->num_keys = cnt - 1;
+            for (uint32_t c = 0; c < cnt; c++) {
+                inner.children[c] = child_first + pos + c;
+                if (c > 0) inner.keys[c - 1] = seps[pos + c];
+            }
+            seps[j] = seps[pos];
+            pos += cnt;
+        }
+        bulk_flush(&w);
+    }
+
+    free(seps);
+    free(w.buf);
+    return w.failed ? BTREE_NO_PAGE : first;
+}
+
+static bool keys_strictly_sorted(const uint64_t *keys, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        if (keys[i] <= keys[i - 1]) return false;
+    }
+    return true;
+}
+
+void btree_insert_batch(BTree *tree, const uint64_t *keys, const uint64_t *values, size_t n) {
+    if (n == 0) return;
+    bool bulk = keys_strictly_sorted(keys, n);
+    if (bulk) {
+        // The old root stays latched exclusively (and root_latch held) until the
+        // new root is in, which keeps every other operation out
+        stats_wrlock(&tree->root_latch);
+        BTreeNode root;
+        node_get(tree, tree->root, &root, LATCH_EXCLUSIVE);
+        bulk = root.hdr->is_leaf && root.hdr->num_keys == 0;
+        uint64_t *tids = NULL;
+        if (bulk && tree->heap) {
+            // Values go to the heap first (filling its pages in order), the leaves get their TIDs
+            tids = (uint64_t*)malloc(sizeof(uint64_t) * n);
+            for (size_t i = 0; i < n; i++) tids[i] = vh_insert(tree->heap, &values[i], sizeof(uint64_t));
+        }
+        if (bulk) {
+            uint64_t new_root = btree_bulk_build(tree, keys, tids ? tids : values, n);
+            if (new_root != BTREE_NO_PAGE) {
+                // The old, empty root page is left unused
+                tree->root = new_root;
+                btree_write_meta(tree);
+                tree->bulk_loaded += n;
+                atomic_fetch_add(&logical_bytes_written, sizeof(uint64_t) * 2 * n);
+            } else {
+                bulk = false;
+                for (size_t i = 0; tids && i < n; i++) vh_delete(tree->heap, tids[i]);
+            }
         }
-        x->keys[i + 1] = key;
-        x->values[i + 1] = value;
-        x->num_keys++;
+        node_put(tree, &root, false);
+        pthread_rwlock_unlock(&tree->root_latch);
+        free(tids);
+        if (bulk) return;
+    }
+    // Tree already has data (or the batch isn't sorted): plain inserts, in
+    // key order at least so consecutive ones mostly hit a cached leaf
+    for (size_t i = 0; i < n; i++) btree_insert(tree, keys[i], values[i]);
+}
+
+// --- Delete (CLRS, top-down) ---
+//
+// Before the descent enters a child it makes sure the child can lose a key
+// without going under the minimum, borrowing from a sibling through the
+// parent or merging with one. So, like the top-down splits of insert, a
+// delete never has to climb back up and each parent is released as soon as
+// its child has been topped up. Entries only live in leaves, so a separator
+// left behind by a deleted key simply keeps routing. With lazy_underflow
+// leaves may drain down to a single key and are only refilled when a delete
+// would empty them, which spares most of the sibling and parent pages a
+// strict delete rewrites.
+
+// Too few keys to give one up
+static bool node_underfull(BTree *tree, const BTreeNode *n) {
+    if (n->hdr->is_leaf && tree->lazy_underflow) return n->hdr->num_keys < 2;
+    return n->hdr->num_keys < (uint32_t)tree->t;
+}
+
+static bool node_can_lend(BTree *tree, const BTreeNode *n) {
+    return n->hdr->num_keys >= (uint32_t)tree->t;
+}
+
+// Releases a node the delete changed, counting the page
+static void node_put_modified(BTree *tree, BTreeNode *n) {
+    atomic_fetch_add(&tree->delete_pages, 1);
+    node_put(tree, n, true);
+}
+
+static void leaf_remove_at(BTreeNode *leaf, int i) {
+    int n = leaf->hdr->num_keys;
+    memmove(leaf->keys + i, leaf->keys + i + 1, sizeof(uint64_t) * (n - i - 1));
+    memmove(leaf->values + i, leaf->values + i + 1, sizeof(uint64_t) * (n - i - 1));
+    leaf->hdr->num_keys--;
+}
+
+// Moves l's last entry into c = child i. Leaves just hand the entry over and
+// the separator becomes c's new first key; inner nodes rotate it through x.
+static void borrow_from_left(BTreeNode *x, int i, BTreeNode *c, BTreeNode *l) {
+    int n = c->hdr->num_keys, ln = l->hdr->num_keys;
+    memmove(c->keys + 1, c->keys, sizeof(uint64_t) * n);
+    if (c->hdr->is_leaf) {
+        memmove(c->values + 1, c->values, sizeof(uint64_t) * n);
+        c->keys[0] = l->keys[ln - 1];
+        c->values[0] = l->values[ln - 1];
+        x->keys[i - 1] = c->keys[0];
     } else {
-        while (i >= 0 && key < x->keys[i]) i--;
-        i++;
-        if (x->children[i]->num_keys == 2 * tree->t - 1) {
-            btree_split_child(tree, x, i);
-            if (key > x->keys[i]) i++;
-        }
-        btree_insert_non_full(tree, x->children[i], key, value);
-    }
-}
-
-// Helper for aligned allocation (4KB)
-void* alloc_aligned_4k(size_t size) {
-    void *ptr;
-#ifdef __linux__
-    if (posix_memalign(&ptr, 4096, size) != 0) return NULL;
-#else
-    ptr = malloc(size); // Fallback for Windows/Non-POSIX (wont use O_DIRECT)
-#endif
-    return ptr;
-}
-
-// Simulate 4KB page write cost using O_DIRECT (Linux) or NO_BUFFERING
-void simulate_disk_write() {
-    static int fd = -1;
-    static void *aligned_buf = NULL;
-    
-    if (!aligned_buf) {
-        aligned_buf = alloc_aligned_4k(4096);
-        if (!aligned_buf) {
-             perror("Failed to alloc aligned buf");
-             return;
-        }
-        memset(aligned_buf, 0, 4096);
-        ((char*)aligned_buf)[0] = 1; // Dirty
-    }
-
-    if (fd == -1) {
-#ifdef __linux__
-        // O_DIRECT requires block-aligned writes
-        fd = open("btree_disk_sim.dat", O_RDWR | O_CREAT | O_DIRECT, 0666);
-#else
-        // Initial fallback
-        fd = open("btree_disk_sim.dat", O_RDWR | O_CREAT, 0666);
-#endif
-        if (fd == -1) {
-            perror("Failed to open btree_disk_sim.dat");
+        memmove(c->children + 1, c->children, sizeof(uint64_t) * (n + 1));
+        c->children[0] = l->children[ln];
+        c->keys[0] = x->keys[i - 1];
+        x->keys[i - 1] = l->keys[ln - 1];
+    }
+    l->hdr->num_keys--;
+    c->hdr->num_keys++;
+}
+
+// Moves r's first entry into c = child i, the mirror of borrow_from_left
+static void borrow_from_right(BTreeNode *x, int i, BTreeNode *c, BTreeNode *r) {
+    int n = c->hdr->num_keys, rn = r->hdr->num_keys;
+    if (c->hdr->is_leaf) {
+        c->keys[n] = r->keys[0];
+        c->values[n] = r->values[0];
+        memmove(r->values, r->values + 1, sizeof(uint64_t) * (rn - 1));
+        memmove(r->keys, r->keys + 1, sizeof(uint64_t) * (rn - 1));
+        x->keys[i] = r->keys[0];
+    } else {
+        c->keys[n] = x->keys[i];
+        c->children[n + 1] = r->children[0];
+        x->keys[i] = r->keys[0];
+        memmove(r->keys, r->keys + 1, sizeof(uint64_t) * (rn - 1));
+        memmove(r->children, r->children + 1, sizeof(uint64_t) * rn);
+    }
+    r->hdr->num_keys--;
+    c->hdr->num_keys++;
+}
+
+// Folds r = child i+1 into l = child i and drops separator i from x. Inner
+// nodes pull the separator down between the halves; leaves don't need it and
+// unlink r from the chain. r's page is dead afterwards (there is no free
+// page list yet, so it just stays unused in the file).
+static void merge_children(BTreeNode *x, int i, BTreeNode *l, BTreeNode *r) {
+    int ln = l->hdr->num_keys, rn = r->hdr->num_keys, xn = x->hdr->num_keys;
+    if (l->hdr->is_leaf) {
+        memcpy(l->keys + ln, r->keys, sizeof(uint64_t) * rn);
+        memcpy(l->values + ln, r->values, sizeof(uint64_t) * rn);
+        l->hdr->num_keys = ln + rn;
+        l->hdr->next_leaf = r->hdr->next_leaf;
+    } else {
+        l->keys[ln] = x->keys[i];
+        memcpy(l->keys + ln + 1, r->keys, sizeof(uint64_t) * rn);
+        memcpy(l->children + ln + 1, r->children, sizeof(uint64_t) * (rn + 1));
+        l->hdr->num_keys = ln + rn + 1;
+    }
+
+    memmove(x->keys + i, x->keys + i + 1, sizeof(uint64_t) * (xn - i - 1));
+    memmove(x->children + i + 1, x->children + i + 2, sizeof(uint64_t) * (xn - i - 1));
+    x->hdr->num_keys--;
+}
+
+// Tops up child c = x[i] (both latched exclusively, c underfull): borrow from
+// a sibling that can lend, else merge with one. c may end up being the left
+// sibling the old c was merged into.
+//
+// Siblings are latched left to right, the order btree_traverse crabs the leaf chain
+// in: to reach the left one, c's latch is dropped first and taken again
+// after. Nothing can change c meanwhile, since every writer goes through x.
+static void btree_fill_child(BTree *tree, BTreeNode *x, int i, BTreeNode *c) {
+    int n = x->hdr->num_keys;
+    if (i > 0) {
+        BTreeNode l;
+        bp_write_end(c->frame);
+        pthread_rwlock_unlock(&c->frame->latch);
+        node_get(tree, x->children[i - 1], &l, LATCH_EXCLUSIVE);
+        node_latch(c, LATCH_EXCLUSIVE);
+        if (node_can_lend(tree, &l)) {
+            borrow_from_left(x, i, c, &l);
+            node_put_modified(tree, &l);
+            atomic_fetch_add(&tree->borrows, 1);
             return;
         }
+        if (i == n) { // Last child: nothing on the right to use
+            merge_children(x, i - 1, &l, c);
+            node_put(tree, c, false);
+            *c = l;
+            atomic_fetch_add(&tree->merges, 1);
+            return;
+        }
+        node_put(tree, &l, false);
+    }
+    BTreeNode r;
+    node_get(tree, x->children[i + 1], &r, LATCH_EXCLUSIVE);
+    if (node_can_lend(tree, &r)) {
+        borrow_from_right(x, i, c, &r);
+        node_put_modified(tree, &r);
+        atomic_fetch_add(&tree->borrows, 1);
+        return;
+    }
+    merge_children(x, i, c, &r);
+    node_put(tree, &r, false);
+    atomic_fetch_add(&tree->merges, 1);
+}
+
+// Pessimistic delete below the root, latched exclusively along with
+// root_latch, which is let go once the descent leaves the root. *removed
+// gets the value deleted, left alone if the key is absent.
+static void btree_delete_pessimistic(BTree *tree, uint64_t key, uint64_t *removed) {
+    stats_wrlock(&tree->root_latch);
+    BTreeNode cur;
+    node_get(tree, tree->root, &cur, LATCH_EXCLUSIVE);
+    bool holds_root = true, dirty = false; // dirty: cur has been changed
+    while (!cur.hdr->is_leaf) {
+        int i = node_child_index(&cur, key);
+        BTreeNode next;
+        node_get(tree, cur.children[i], &next, LATCH_EXCLUSIVE);
+        bool filled = node_underfull(tree, &next);
+        if (filled) btree_fill_child(tree, &cur, i, &next);
+
+        // Whatever happens below, `next` can absorb it: let go of cur
+        if (holds_root && cur.hdr->num_keys == 0) {
+            // The root's last separator went into a merge: its only child takes over
+            tree->root = node_page_no(&next);
+            btree_write_meta(tree);
+            node_put(tree, &cur, false);
+        } else if (dirty || filled) {
+            node_put_modified(tree, &cur);
+        } else {
+            node_put(tree, &cur, false);
+        }
+        if (holds_root) {
+            pthread_rwlock_unlock(&tree->root_latch);
+            holds_root = false;
+        }
+        cur = next;
+        dirty = filled; // A merged or topped-up child has changed too
     }
+    if (holds_root) pthread_rwlock_unlock(&tree->root_latch);
 
-    // Simulate random position
-    // Use pread/pwrite if available or lseek+write
-    long offset = (rand() % 25600) * 4096;
-    
-    // We write 4KB aligned buffer
-    if (pwrite(fd, aligned_buf, 4096, offset) != 4096) {
-        // perror("pwrite failed"); // Silence optional errors during heavy bench
+    int i = node_find(&cur, key);
+    if (i < (int)cur.hdr->num_keys && cur.keys[i] == key) {
+        *removed = cur.values[i];
+        leaf_remove_at(&cur, i);
+        dirty = true;
     }
-    // WAF Metric: Physical Write = 4096 bytes
-    // Using atomic fetch_add
-    atomic_fetch_add(&physical_bytes_written, 4096);
+    if (dirty) node_put_modified(tree, &cur);
+    else node_put(tree, &cur, false);
 }
 
-BTree* btree_create(int t) {
+// Optimistic attempt, as for inserts: shared latches down to the leaf and
+// exclusive only there. Returns false (having changed nothing) when the leaf
+// would underflow.
+static bool btree_delete_optimistic(BTree *tree, uint64_t key, uint64_t *removed) {
+    BTreeNode cur;
+    btree_get_root(tree, &cur, LATCH_SHARED);
+    if (cur.hdr->is_leaf) {
+        node_put(tree, &cur, false);
+        return false;
+    }
+    for (;;) {
+        BTreeNode child;
+        node_get(tree, cur.children[node_child_index(&cur, key)], &child, LATCH_SHARED);
+        if (!child.hdr->is_leaf) {
+            node_put(tree, &cur, false);
+            cur = child;
+            continue;
+        }
+
+        pthread_rwlock_unlock(&child.frame->latch);
+        node_latch(&child, LATCH_EXCLUSIVE);
+        node_put(tree, &cur, false);
+
+        int j = node_find(&child, key);
+        if (j >= (int)child.hdr->num_keys || key != child.keys[j]) {
+            node_put(tree, &child, false); // Not in the tree
+            return true;
+        }
+        if (node_underfull(tree, &child)) {
+            node_put(tree, &child, false);
+            return false;
+        }
+        *removed = child.values[j];
+        leaf_remove_at(&child, j);
+        node_put_modified(tree, &child);
+        return true;
+    }
+}
+
+BTreeOptions btree_default_options(void) {
+    BTreeOptions o;
+    o.t = 64;
+    o.cache_frames = 256; // 1MB
+    o.huge_pages = false;
+    o.lazy_underflow = false;
+    o.byte_values = false;
+    o.io = ior_default_options();
+    return o;
+}
+
+BTree* btree_create_opts(const char *path, const BTreeOptions *opts) {
+    BufferPool *pool = bp_open(path, opts->cache_frames, opts->huge_pages, &opts->io);
+    if (!pool) return NULL;
+    ks_init();
+
     BTree *tree = (BTree*)malloc(sizeof(BTree));
-    tree->t = t;
-    tree->root = create_node(t, true);
-    pthread_mutex_init(&tree->lock, NULL);
+    tree->pool = pool;
+    tree->t = opts->t;
+    if (tree->t > (int)BTREE_MAX_T) tree->t = BTREE_MAX_T;
+    if (tree->t < 2) tree->t = 2;
+    tree->lazy_underflow = opts->lazy_underflow;
+    tree->heap = NULL;
+    pthread_rwlock_init(&tree->root_latch, NULL);
+    tree->restarts = tree->read_restarts = 0;
+    tree->merges = tree->borrows = tree->delete_pages = 0;
+    tree->bulk_loaded = 0;
+
+    if (pool->num_pages > 0) {
+        BPFrame *f = bp_fetch(pool, BTREE_META_PAGE);
+        BTreeMeta meta = *(BTreeMeta*)f->data;
+        bp_unpin(pool, f, false);
+        if (meta.magic == BTREE_MAGIC) {
+            // Existing tree: its node layout depends on the t it was built with
+            tree->t = meta.t;
+            tree->root = meta.root;
+            if (meta.byte_values) tree->heap = vh_create(pool);
+            return tree;
+        }
+        fprintf(stderr, "%s is not a B-Tree file, starting a new tree after its pages\n", path);
+    }
+
+    BPFrame *meta = bp_new_page(pool); // Page 0 on a fresh file
+    bp_unpin(pool, meta, true);
+    if (opts->byte_values) tree->heap = vh_create(pool);
+    BTreeNode root;
+    create_node(tree, true, &root);
+    tree->root = node_page_no(&root);
+    node_put(tree, &root, true);
+    stats_wrlock(&tree->root_latch);
+    btree_write_meta(tree);
+    pthread_rwlock_unlock(&tree->root_latch);
     return tree;
 }
 
-// ... (traverse, search, split, insert_non_full same as before) 
-// Kept implementation brief in diff, but need to ensure 'btree_insert' is standard
+BTree* btree_create(int t) {
+    BTreeOptions o = btree_default_options();
+    o.t = t;
+    return btree_create_opts(BTREE_DEFAULT_FILE, &o);
+}
 
 void btree_insert_mt(BTree *tree, uint64_t key, uint64_t value) {
-    pthread_mutex_lock(&tree->lock);
     btree_insert(tree, key, value);
-    pthread_mutex_unlock(&tree->lock);
+}
+
+// Puts value (a TID in a heap tree) in the leaf and returns the one it replaced, 0 if none
+static uint64_t btree_store(BTree *tree, uint64_t key, uint64_t value) {
+    uint64_t old = 0;
+    if (btree_insert_optimistic(tree, key, value, &old)) return old;
+    atomic_fetch_add(&tree->restarts, 1);
+    btree_insert_pessimistic(tree, key, value, &old);
+    return old;
 }
 
 void btree_insert(BTree *tree, uint64_t key, uint64_t value) {
+    if (tree->heap) {
+        btree_put(tree, key, &value, sizeof(value));
+        return;
+    }
     // WAF Metric: Logical Write = 16 bytes (Key 8 + Value 8)
+    // Physical writes happen when the buffer pool writes dirty pages back.
     atomic_fetch_add(&logical_bytes_written, sizeof(uint64_t) * 2);
+    btree_store(tree, key, value);
+}
 
-    // Note: simulate_disk_write is called here.
-    // If called via _mt, lock is held. 
-    // This serializes IO, which is unfortunate for NVMe but realistic for this architecture.
-    simulate_disk_write(); 
-
-    if (tree->root->num_keys == 2 * tree->t - 1) {
-        BTreeNode *s = create_node(tree->t, false);
-        s->children[0] = tree->root;
-        tree->root = s;
-        btree_split_child(tree, s, 0);
-        btree_insert_non_full(tree, s, key, value);
-    } else {
-        btree_insert_non_full(tree, tree->root, key, value);
+// Overwrites the key's tuple in place when the new value has the same
+// length. The leaf stays latched shared meanwhile, so a concurrent delete
+// (which needs it exclusively) can't drop the tuple under the update.
+static bool btree_update_in_place(BTree *tree, uint64_t key, const void *value, uint32_t len) {
+    BTreeNode leaf;
+    btree_find_leaf(tree, key, &leaf);
+    int i = node_find(&leaf, key);
+    bool done = i < (int)leaf.hdr->num_keys && leaf.keys[i] == key &&
+                vh_update(tree->heap, leaf.values[i], value, len);
+    node_put(tree, &leaf, false);
+    return done;
+}
+
+void btree_put(BTree *tree, uint64_t key, const void *value, uint32_t len) {
+    if (len > BTREE_MAX_VALUE_BYTES) len = BTREE_MAX_VALUE_BYTES;
+    if (!tree->heap) {
+        uint64_t v = 0;
+        memcpy(&v, value, len < sizeof(v) ? len : sizeof(v));
+        btree_insert(tree, key, v);
+        return;
     }
+    // WAF Metric: Logical Write = key + value bytes
+    atomic_fetch_add(&logical_bytes_written, sizeof(uint64_t) + len);
+    if (btree_update_in_place(tree, key, value, len)) return;
+
+    // New tuple first, then the leaf points at it, then the old one goes
+    uint64_t old = btree_store(tree, key, vh_insert(tree->heap, value, len));
+    if (old) vh_delete(tree->heap, old);
 }
 
 void btree_delete(BTree *tree, uint64_t key) {
-    // Simplified: No-op for benchmark or assume delete logic 
-    // Since we removed it, let's just leave it empty or very simple recursion stub
-    // The benchmark calls it, so it must exist.
-    // For "Refaça", maybe I should put back the empty stub I had or a recursive free?
+    // Same logical cost as an LSM tombstone, so the two WAFs compare
+    atomic_fetch_add(&logical_bytes_written, sizeof(uint64_t) * 2);
+
+    uint64_t removed = 0;
+    if (!btree_delete_optimistic(tree, key, &removed)) {
+        atomic_fetch_add(&tree->restarts, 1);
+        btree_delete_pessimistic(tree, key, &removed);
+    }
+    if (tree->heap && removed) vh_delete(tree->heap, removed);
 }
 
-void free_node(BTreeNode *node) {
-    if (node) {
-        if (!node->is_leaf) {
-            for (int i = 0; i <= node->num_keys; i++) free_node(node->children[i]);
-        }
-        free(node->keys);
-        free(node->values);
-        free(node->children);
-        free(node);
+void btree_checkpoint(BTree *tree) {
+    bp_checkpoint(tree->pool);
+}
+
+void btree_reset_stats(BTree *tree) {
+    bp_reset_stats(tree->pool);
+    tree->restarts = tree->read_restarts = 0;
+    tree->merges = tree->borrows = tree->delete_pages = 0;
+    tree->bulk_loaded = 0;
+}
+
+void btree_print_stats(BTree *tree, const char *label) {
+    BufferPool *bp = tree->pool;
+    pthread_mutex_lock(&bp->lock);
+    uint64_t accesses = bp->hits + bp->misses;
+    printf("%s Buffer Pool: %zu frames, %lu pages, %lu hits / %lu misses (%.1f%% hit rate), %lu evictions, %lu write-backs, huge pages: %s\n",
+           label, bp->num_frames, bp->num_pages, bp->hits, bp->misses,
+           accesses ? 100.0 * bp->hits / accesses : 0.0, bp->evictions, bp->writebacks, hp_kind_name(bp->mem.kind));
+    if (bp->direct_writes) {
+        printf("%s Bulk load: %lu entries, %lu pages written sequentially\n", label, tree->bulk_loaded, bp->direct_writes);
+    }
+    pthread_mutex_unlock(&bp->lock);
+    printf("%s Latching: %lu inserts/deletes restarted with exclusive latches, %lu optimistic reads retried\n", label,
+           atomic_load(&tree->restarts), atomic_load(&tree->read_restarts));
+    printf("%s Delete: %lu pages modified, %lu borrows, %lu merges (lazy underflow %s)\n", label,
+           atomic_load(&tree->delete_pages), atomic_load(&tree->borrows), atomic_load(&tree->merges),
+           tree->lazy_underflow ? "on" : "off");
+    printf("%s Key search: %s\n", label, ks_selected_name());
+    if (tree->heap) {
+        printf("%s Value heap: %lu pages, %lu overflow pages, %lu KB dead tuples\n", label,
+               atomic_load(&tree->heap->pages), atomic_load(&tree->heap->overflow_pages),
+               atomic_load(&tree->heap->dead_bytes) / 1024);
     }
 }
 
+static bool btree_count_entry(void *arg, uint64_t key, const void *value, uint32_t len) {
+    (void)key;
+    (void)value;
+    *(uint64_t*)arg += sizeof(uint64_t) + len;
+    return true;
+}
+
+void btree_space_usage(BTree *tree, uint64_t *live_bytes, uint64_t *disk_bytes) {
+    *live_bytes = 0;
+    btree_scan_values(tree, 0, 0, btree_count_entry, live_bytes, false);
+    pthread_mutex_lock(&tree->pool->lock);
+    *disk_bytes = tree->pool->num_pages * BP_PAGE_SIZE;
+    pthread_mutex_unlock(&tree->pool->lock);
+}
 
 void btree_free(BTree *tree) {
-    free_node(tree->root);
-    pthread_mutex_destroy(&tree->lock);
+    bp_close(tree->pool);
+    if (tree->heap) vh_free(tree->heap);
+    pthread_rwlock_destroy(&tree->root_latch);
     free(tree);
 }
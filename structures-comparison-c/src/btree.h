@@ -2,36 +2,142 @@
 #define BTREE_H
 
 #include <stdint.h>
-#include <stdint.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <pthread.h>
 #include <stdatomic.h>
+#include "bufpool.h"
+#include "valheap.h"
 
 extern _Atomic uint64_t physical_bytes_written;
 extern _Atomic uint64_t logical_bytes_written;
 
-typedef struct BTreeNode BTreeNode;
+// On-disk B+-Tree: page 0 holds the meta record, every other page is one node
+//
+//   [BTreePageHeader][keys: 2t-1][values: 2t-1][children: 2t page numbers]
+//
+// Entries live in the leaves only; inner nodes hold separators (the first
+// key of the child to their right) and children, and leaves hold keys and
+// values, each linked to the next one so range scans walk the leaf level.
+// Nodes are only reached through the buffer pool, so what hits the disk is
+// the dirty pages it writes back on eviction or checkpoint.
+//
+// A tree opened with byte_values stores byte-string values in a value heap
+// (valheap.h) in the same file, and its leaf values are the heap TIDs.
+//
+// Readers (lookups, scans) take no latch at all: they pin pages and validate
+// what they copied against each page's version (bufpool.h), starting over
+// if a writer got in the way. Writers crab on the pool's per-page rwlocks:
+// they go down with shared latches, releasing the parent once the child is
+// latched, and only take the leaf exclusively; if the leaf is full they
+// restart pessimistically, going down with exclusive latches and splitting
+// full children on the way (top-down), so a parent is released as soon as
+// its child is known not to split. At most two nodes are latched at a
+// time. Deletes mirror this: they top up (borrow or merge) each child before
+// entering it, CLRS style, which latches the parent, the child and one
+// sibling at most. Siblings are always latched left to right.
+
+#define BTREE_META_PAGE 0
+#define BTREE_MAGIC 0x32304545525442ULL // "BTREE02"
+#define BTREE_NO_PAGE 0 // The meta page, so never a node
+
+typedef struct {
+    uint32_t num_keys;
+    uint32_t is_leaf;
+    uint64_t next_leaf; // Leaves: right neighbour, or BTREE_NO_PAGE
+} BTreePageHeader;
+
+// Largest minimum degree whose node still fits in one page
+#define BTREE_MAX_T ((BP_PAGE_SIZE - sizeof(BTreePageHeader) + 2 * sizeof(uint64_t)) / (6 * sizeof(uint64_t)))
+
+typedef struct {
+    uint64_t magic;
+    uint64_t root; // Page number of the root node
+    uint32_t t;
+    uint32_t byte_values; // Leaf values are value heap TIDs (0 in files from before it existed)
+} BTreeMeta;
 
-struct BTreeNode {
+// A node page pinned in the buffer pool, with its arrays laid out for t
+typedef struct BTreeNode {
+    BPFrame *frame;
+    BTreePageHeader *hdr;
     uint64_t *keys;
     uint64_t *values;
-    struct BTreeNode **children;
-    int num_keys;
-    int t; // Minimum degree
-    bool is_leaf;
-};
+    uint64_t *children;
+} BTreeNode;
+
+typedef struct {
+    int t;               // Minimum degree, capped at BTREE_MAX_T
+    size_t cache_frames; // Buffer pool size in 4KB pages
+    bool huge_pages;     // Back the pool frames with 2MB huge pages
+    bool lazy_underflow; // Deletes let leaves drain to one key before rebalancing
+    bool byte_values;    // New trees keep byte-string values in a value heap (existing ones keep theirs)
+    IORingOptions io;    // Checkpoint write-back: io_uring depth, SQPOLL, or sync
+} BTreeOptions;
+
+#define BTREE_MAX_VALUE_BYTES (32 * 1024) // Same cap as the LSM
 
 typedef struct {
-    BTreeNode *root;
+    BufferPool *pool;
+    _Atomic uint64_t root; // Page number, changed with the old root page latched exclusively
     int t; // Min degree
-    pthread_mutex_t lock; // Coarse lock for thread safety
+    pthread_rwlock_t root_latch; // Serializes root changes; readers don't take it
+    bool lazy_underflow;
+    ValueHeap *heap;             // NULL: values are u64 in the leaves
+    _Atomic uint64_t restarts;   // Optimistic inserts/deletes redone with exclusive latches
+    _Atomic uint64_t read_restarts; // Lookups/scans that failed a version check and went down again
+    _Atomic uint64_t merges;
+    _Atomic uint64_t borrows;
+    _Atomic uint64_t delete_pages; // Pages changed by deletes (before write-back coalescing)
+    uint64_t bulk_loaded;          // Entries written by bottom-up bulk loads
 } BTree;
 
-BTree* btree_create(int t);
-void btree_insert(BTree *tree, uint64_t key, uint64_t value);
-void btree_insert_mt(BTree *tree, uint64_t key, uint64_t value); // Thread safe wrapper
-uint64_t* btree_search(BTree *tree, uint64_t key);
-void btree_delete(BTree *tree, uint64_t key);
-void btree_free(BTree *tree);
+// Scan callback: return false to stop early. value is only valid during the
+// call; u64 values come as their 8 bytes.
+typedef bool (*BTreeScanFn)(void *arg, uint64_t key, const void *value, uint32_t len);
+
+BTreeOptions btree_default_options(void);
+BTree* btree_create_opts(const char *path, const BTreeOptions *opts); // Reopens an existing tree file
+BTree* btree_create(int t); // btree_data.db with the default cache
+void btree_insert(BTree *tree, uint64_t key, uint64_t value); // Thread safe; updates the value if key exists
+void btree_insert_mt(BTree *tree, uint64_t key, uint64_t value); // Same as btree_insert, kept for callers
+// Inserts n entries. Strictly increasing keys into an empty tree are bulk
+// loaded bottom-up (packed leaves, sequential page writes, other operations
+// wait until it is done); anything else falls back to btree_insert per key.
+void btree_insert_batch(BTree *tree, const uint64_t *keys, const uint64_t *values, size_t n);
+// Copies the value out (value may be NULL), checked against the leaf's
+// version. First 8 bytes of a byte value.
+bool btree_search(BTree *tree, uint64_t key, uint64_t *value);
+// Byte string values, up to BTREE_MAX_VALUE_BYTES (longer ones are cut). A
+// tree without byte_values keeps the first 8 bytes; a u64 value reads back
+// as its 8 bytes.
+void btree_put(BTree *tree, uint64_t key, const void *value, uint32_t len);
+// Copies the first cap bytes of the value into buf and sets *len to its full length
+bool btree_get(BTree *tree, uint64_t key, void *buf, uint32_t cap, uint32_t *len);
+// Calls cb for up to limit entries (0: no limit) with key >= start, in key
+// order. cb runs with the current leaf pinned but not latched, so it may
+// even write to the tree (a scan sees such writes or not). Returns how many entries were passed to cb.
+size_t btree_scan(BTree *tree, uint64_t start, size_t limit, BTreeScanFn cb, void *arg);
+void btree_delete(BTree *tree, uint64_t key); // Thread safe; no-op if the key is absent
+void btree_checkpoint(BTree *tree); // Writes back every dirty page
+void btree_reset_stats(BTree *tree);
+void btree_print_stats(BTree *tree, const char *label);
+// Node helpers, shared with the copy-on-write tree (cowbtree.h), which
+// keeps the same page layout. They only touch the page images.
+//
+// Points the node view at the arrays of a page image laid out for t
+void btree_node_layout(int t, char *data, BTreeNode *n);
+// Moves the upper half of the full node y into the empty node z of the same
+// kind and returns the separator for the parent. An inner node moves its
+// median up. A leaf keeps every entry: z starts with the separator, which
+// is only copied up. Leaf links are left to the caller.
+uint64_t btree_node_split(int t, BTreeNode *y, BTreeNode *z);
+// Links the right half of a split i-th child into x after it, with sep
+void btree_node_add_child(BTreeNode *x, int i, uint64_t sep, uint64_t right);
+
+// Space amplification inputs: 8 bytes + the value per entry (walks every
+// leaf) and the pages allocated in the file
+void btree_space_usage(BTree *tree, uint64_t *live_bytes, uint64_t *disk_bytes);
+void btree_free(BTree *tree); // Checkpoints, then closes the file
 
 #endif
@@ -0,0 +1,332 @@
+#define _GNU_SOURCE // Needed for O_DIRECT
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bufpool.h"
+#include "stats.h"
+
+// Lock held. A map too small for page_no is copied into a larger one; hits
+// may still be reading the old one, so it is retired rather than freed.
+static BPPageMap* bp_map_reserve(BufferPool *bp, uint64_t page_no) {
+    BPPageMap *map = atomic_load(&bp->page_map);
+    if (map && page_no < map->cap) return map;
+    uint64_t old_cap = map ? map->cap : 0;
+    uint64_t cap = old_cap ? old_cap : 64;
+    while (cap <= page_no) cap *= 2;
+    BPPageMap *grown = (BPPageMap*)malloc(sizeof(BPPageMap) + sizeof(int32_t) * cap);
+    grown->cap = cap;
+    for (uint64_t i = 0; i < cap; i++) atomic_init(&grown->frames[i], i < old_cap ? atomic_load(&map->frames[i]) : -1);
+    atomic_store(&bp->page_map, grown);
+    if (map) ebr_retire(&bp->ebr, map, free);
+    return grown;
+}
+
+// Called without the pool lock: the frame is pinned or io_pending, so its
+// contents can't change underneath.
+static void bp_write_page(BufferPool *bp, BPFrame *f) {
+    if (pwrite(bp->fd, f->data, BP_PAGE_SIZE, f->page_no * BP_PAGE_SIZE) != BP_PAGE_SIZE) {
+        perror("Buffer pool write failed");
+    }
+    // WAF Metric: Physical Write = one 4KB page per dirty write-back
+    atomic_fetch_add(&physical_bytes_written, BP_PAGE_SIZE);
+}
+
+// CLOCK: the first unpinned frame whose reference bit is already clear.
+// Returns it unmapped and pinned once, lock held. Returns NULL when the lock
+// had to be dropped (a dirty victim was written back, or every frame was
+// busy): the caller must redo its page lookup.
+static BPFrame* bp_victim(BufferPool *bp) {
+    for (size_t scanned = 0; scanned < 2 * bp->num_frames + 1; scanned++) {
+        BPFrame *f = &bp->frames[bp->clock_hand];
+        bp->clock_hand = (bp->clock_hand + 1) % bp->num_frames;
+        if (f->pin_count != 0 || f->io_pending) continue;
+        if (f->referenced) {
+            f->referenced = false; // Second chance
+            continue;
+        }
+        // Claim it, or lose it to a lock-free pin that got there first
+        int unpinned = 0;
+        if (!atomic_compare_exchange_strong(&f->pin_count, &unpinned, BP_PIN_CLAIMED)) continue;
+        if (f->page_no != BP_NO_PAGE && f->dirty) {
+            // The page stays mapped while it is written, so nobody reads a
+            // stale copy from disk in the meantime; they wait on io_cv.
+            f->io_pending = true;
+            pthread_mutex_unlock(&bp->lock);
+            bp_write_page(bp, f);
+            pthread_mutex_lock(&bp->lock);
+            f->dirty = false;
+            f->io_pending = false;
+            f->pin_count = 0;
+            bp->writebacks++;
+            pthread_cond_broadcast(&bp->io_cv);
+            return NULL;
+        }
+        if (f->page_no != BP_NO_PAGE) {
+            atomic_store(&atomic_load(&bp->page_map)->frames[f->page_no], -1);
+            f->page_no = BP_NO_PAGE;
+            bp->evictions++;
+        }
+        f->dirty = false;
+        f->referenced = true;
+        f->pin_count = 1; // Last: a stale pin from here on sees the page is gone
+        return f;
+    }
+    // Every frame pinned or busy: wait for an unpin or an I/O to finish. An
+    // unpin between the sweep and the count going up didn't see us waiting,
+    // so look once more before sleeping.
+    atomic_fetch_add(&bp->frame_waiters, 1);
+    bool free_frame = false;
+    for (size_t i = 0; i < bp->num_frames && !free_frame; i++) free_frame = bp->frames[i].pin_count == 0;
+    if (!free_frame) pthread_cond_wait(&bp->io_cv, &bp->lock);
+    atomic_fetch_sub(&bp->frame_waiters, 1);
+    return NULL;
+}
+
+BufferPool* bp_open(const char *path, size_t num_frames, bool huge_pages, const IORingOptions *io) {
+    int fd;
+#ifdef __linux__
+    fd = open(path, O_RDWR | O_CREAT | O_DIRECT, 0666);
+#else
+    fd = open(path, O_RDWR | O_CREAT, 0666);
+#endif
+    if (fd == -1) {
+        perror("Buffer pool open failed");
+        return NULL;
+    }
+    if (num_frames < BP_MIN_FRAMES) num_frames = BP_MIN_FRAMES;
+
+    BufferPool *bp = (BufferPool*)calloc(1, sizeof(BufferPool));
+    bp->fd = fd;
+    bp->num_frames = num_frames;
+    bp->frames = (BPFrame*)calloc(num_frames, sizeof(BPFrame));
+    // Page aligned, as O_DIRECT needs
+    if (!hp_alloc(&bp->mem, num_frames * BP_PAGE_SIZE, huge_pages)) {
+        close(fd);
+        free(bp->frames);
+        free(bp);
+        return NULL;
+    }
+    for (size_t i = 0; i < num_frames; i++) {
+        bp->frames[i].page_no = BP_NO_PAGE;
+        bp->frames[i].data = (char*)bp->mem.ptr + i * BP_PAGE_SIZE;
+        pthread_rwlock_init(&bp->frames[i].latch, NULL);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0) bp->num_pages = (st.st_size + BP_PAGE_SIZE - 1) / BP_PAGE_SIZE;
+    ebr_init(&bp->ebr);
+    bp_map_reserve(bp, bp->num_pages);
+    pthread_mutex_init(&bp->lock, NULL);
+    pthread_cond_init(&bp->io_cv, NULL);
+    IORingOptions sync_io = {false, 1, false};
+    bp->ring = ior_create(io ? io : &sync_io);
+    pthread_mutex_init(&bp->checkpoint_lock, NULL);
+    return bp;
+}
+
+// Hit without the pool lock. NULL if the page isn't cached, or its frame is
+// being loaded, written back or evicted: the locked path sorts those out.
+static BPFrame* bp_fetch_cached(BufferPool *bp, uint64_t page_no) {
+    uint64_t e = ebr_enter(&bp->ebr);
+    BPPageMap *map = atomic_load(&bp->page_map);
+    int32_t idx = page_no < map->cap ? atomic_load(&map->frames[page_no]) : -1;
+    ebr_exit(&bp->ebr, e);
+    if (idx < 0) return NULL;
+
+    BPFrame *f = &bp->frames[idx];
+    int pins = atomic_load(&f->pin_count);
+    do {
+        if (pins < 0) return NULL; // Claimed by an eviction
+    } while (!atomic_compare_exchange_weak(&f->pin_count, &pins, pins + 1));
+    // Pinned, so it can't be claimed any more; but it may have been reused
+    // for another page since the map was read
+    if (f->page_no != page_no || f->io_pending) {
+        bp_unpin(bp, f, false);
+        return NULL;
+    }
+    f->referenced = true;
+    atomic_fetch_add(&bp->hits, 1);
+    stats_add(STAT_CACHE_HITS, 1);
+    return f;
+}
+
+BPFrame* bp_fetch(BufferPool *bp, uint64_t page_no) {
+    BPFrame *hit = bp_fetch_cached(bp, page_no);
+    if (hit) return hit;
+
+    stats_mutex_lock(&bp->lock);
+    for (;;) {
+        int32_t idx = bp_map_reserve(bp, page_no)->frames[page_no];
+        if (idx >= 0) {
+            BPFrame *f = &bp->frames[idx];
+            if (f->io_pending) {
+                // Someone else is reading or writing this page: waiting on it is lock wait too
+                uint64_t t0 = stats_now_ns();
+                pthread_cond_wait(&bp->io_cv, &bp->lock);
+                stats_add(STAT_LOCK_WAIT_NS, stats_now_ns() - t0);
+                continue;
+            }
+            f->pin_count++;
+            f->referenced = true;
+            bp->hits++;
+            stats_add(STAT_CACHE_HITS, 1);
+            pthread_mutex_unlock(&bp->lock);
+            return f;
+        }
+
+        BPFrame *f = bp_victim(bp);
+        if (!f) continue;
+
+        // Map it before reading so a second fetch of this page waits for us
+        // instead of loading it into another frame
+        bp->misses++;
+        stats_add(STAT_CACHE_MISSES, 1);
+        f->page_no = page_no;
+        f->io_pending = true;
+        atomic_store(&atomic_load(&bp->page_map)->frames[page_no], (int32_t)(f - bp->frames));
+        pthread_mutex_unlock(&bp->lock);
+
+        if (pread(bp->fd, f->data, BP_PAGE_SIZE, page_no * BP_PAGE_SIZE) != BP_PAGE_SIZE) {
+            memset(f->data, 0, BP_PAGE_SIZE); // Allocated but never written back
+        }
+        stats_add(STAT_BYTES_READ, BP_PAGE_SIZE);
+
+        pthread_mutex_lock(&bp->lock);
+        f->io_pending = false;
+        pthread_cond_broadcast(&bp->io_cv);
+        pthread_mutex_unlock(&bp->lock);
+        return f;
+    }
+}
+
+BPFrame* bp_new_page(BufferPool *bp) {
+    stats_mutex_lock(&bp->lock);
+    uint64_t page_no = bp->num_pages++;
+    bp_map_reserve(bp, page_no);
+    BPFrame *f;
+    while ((f = bp_victim(bp)) == NULL) {}
+    memset(f->data, 0, BP_PAGE_SIZE);
+    f->page_no = page_no;
+    f->dirty = true;
+    // Mapped last: a hit on it sees the zeroed page (the victim may have grown the map meanwhile)
+    atomic_store(&atomic_load(&bp->page_map)->frames[page_no], (int32_t)(f - bp->frames));
+    pthread_mutex_unlock(&bp->lock);
+    return f;
+}
+
+void bp_unpin(BufferPool *bp, BPFrame *f, bool dirty) {
+    // Marked before the pin goes: an eviction checks it after claiming the frame
+    if (dirty) f->dirty = true;
+    if (atomic_fetch_sub(&f->pin_count, 1) == 1 && atomic_load(&bp->frame_waiters) > 0) {
+        pthread_mutex_lock(&bp->lock);
+        pthread_cond_broadcast(&bp->io_cv);
+        pthread_mutex_unlock(&bp->lock);
+    }
+}
+
+uint64_t bp_alloc_run(BufferPool *bp, uint64_t count) {
+    pthread_mutex_lock(&bp->lock);
+    uint64_t first = bp->num_pages;
+    bp->num_pages += count;
+    pthread_mutex_unlock(&bp->lock);
+    return first;
+}
+
+bool bp_write_run(BufferPool *bp, uint64_t first_page, const char *buf, uint64_t count) {
+    size_t len = count * BP_PAGE_SIZE;
+    off_t off = first_page * BP_PAGE_SIZE;
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(bp->fd, buf + done, len - done, off + done);
+        if (n <= 0) {
+            perror("Buffer pool run write failed");
+            return false;
+        }
+        done += n;
+    }
+    // WAF Metric: same 4KB per page as a write-back, just fewer and larger I/Os
+    atomic_fetch_add(&physical_bytes_written, len);
+    pthread_mutex_lock(&bp->lock);
+    bp->direct_writes += count;
+    pthread_mutex_unlock(&bp->lock);
+    return true;
+}
+
+// Releases the pages of a checkpoint batch once the ring has written them
+static void bp_checkpoint_drain(BufferPool *bp, BPFrame **batch, int *n) {
+    if (*n == 0) return;
+    ior_wait_all(bp->ring);
+    pthread_mutex_lock(&bp->lock);
+    for (int i = 0; i < *n; i++) {
+        batch[i]->dirty = false;
+        batch[i]->pin_count--;
+        bp->writebacks++;
+    }
+    if (bp->frame_waiters > 0) pthread_cond_broadcast(&bp->io_cv);
+    pthread_mutex_unlock(&bp->lock);
+    for (int i = 0; i < *n; i++) pthread_rwlock_unlock(&batch[i]->latch);
+    *n = 0;
+}
+
+void bp_checkpoint(BufferPool *bp) {
+    // Dirty pages go out through the ring, up to its depth at once
+    pthread_mutex_lock(&bp->checkpoint_lock);
+    int depth = (int)ior_depth(bp->ring), n = 0;
+    BPFrame **batch = (BPFrame**)malloc(sizeof(BPFrame*) * depth);
+    for (size_t i = 0; i < bp->num_frames; i++) {
+        BPFrame *f = &bp->frames[i];
+        pthread_mutex_lock(&bp->lock);
+        // io_pending frames are being loaded (clean) or already written back
+        if (f->page_no == BP_NO_PAGE || !f->dirty || f->io_pending) {
+            pthread_mutex_unlock(&bp->lock);
+            continue;
+        }
+        f->pin_count++;
+        pthread_mutex_unlock(&bp->lock);
+
+        // The read latch keeps writers off the page while it is on its way
+        // out. Waiting for one while holding others could deadlock with a
+        // writer that holds this page and wants one of ours, so a busy page
+        // first lets the batch finish.
+        if (pthread_rwlock_tryrdlock(&f->latch) != 0) {
+            bp_checkpoint_drain(bp, batch, &n);
+            pthread_rwlock_rdlock(&f->latch);
+        }
+        // WAF Metric: Physical Write = one 4KB page per dirty write-back
+        atomic_fetch_add(&physical_bytes_written, BP_PAGE_SIZE);
+        ior_write(bp->ring, bp->fd, f->data, BP_PAGE_SIZE, f->page_no * BP_PAGE_SIZE);
+        batch[n++] = f;
+        if (n == depth) bp_checkpoint_drain(bp, batch, &n);
+    }
+    bp_checkpoint_drain(bp, batch, &n);
+    free(batch);
+    fdatasync(bp->fd);
+    pthread_mutex_unlock(&bp->checkpoint_lock);
+    ebr_collect(&bp->ebr); // Page maps outgrown since the last one
+
+}
+
+void bp_reset_stats(BufferPool *bp) {
+    pthread_mutex_lock(&bp->lock);
+    bp->hits = bp->misses = bp->evictions = bp->writebacks = bp->direct_writes = 0;
+    pthread_mutex_unlock(&bp->lock);
+}
+
+void bp_close(BufferPool *bp) {
+    if (!bp) return;
+    bp_checkpoint(bp);
+    close(bp->fd);
+    for (size_t i = 0; i < bp->num_frames; i++) pthread_rwlock_destroy(&bp->frames[i].latch);
+    pthread_mutex_destroy(&bp->lock);
+    pthread_cond_destroy(&bp->io_cv);
+    ior_destroy(bp->ring);
+    pthread_mutex_destroy(&bp->checkpoint_lock);
+    ebr_destroy(&bp->ebr);
+    free(atomic_load(&bp->page_map));
+    free(bp->frames);
+    hp_free(&bp->mem);
+    free(bp);
+}
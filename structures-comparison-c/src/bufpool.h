@@ -0,0 +1,122 @@
+#ifndef BUFPOOL_H
+#define BUFPOOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "hugepage.h"
+#include "ioring.h"
+#include "epoch.h"
+
+extern _Atomic uint64_t physical_bytes_written;
+
+// Buffer pool over a file of fixed-size pages, read and written with O_DIRECT.
+//
+// A fixed number of 4KB frames caches pages. Callers pin a page while they
+// use it (bp_fetch / bp_new_page) and unpin it saying whether they changed it.
+// When a frame is needed, CLOCK picks an unpinned victim that hasn't been used
+// since the hand last passed it; a dirty victim is written back first. So the
+// physical writes depend on the cache size, not on the number of updates.
+//
+// Disk I/O never runs under the pool lock: the frame being read or written
+// back is marked io_pending and anyone who wants that page waits for it.
+// Each frame also carries the page latch writers take; it may only be
+// taken while the page is pinned. Readers don't latch: they pin the frame,
+// note its version, copy what they need and keep the copy only if the
+// version is still the same (bp_read_begin / bp_read_valid). The version is
+// odd while the latch is held exclusively and moves every time it is, so a
+// writer brackets its changes with bp_write_begin / bp_write_end.
+//
+// A hit doesn't take the pool lock either: the page map is read inside an
+// epoch (a grown map retires the old array through it) and the frame pinned
+// with a CAS on pin_count, then checked to still hold the page. Eviction
+// claims a frame by swinging pin_count from 0 to BP_PIN_CLAIMED, so a frame
+// is never pinned and reused at once; a fetch that runs into a claimed or
+// io_pending frame takes the locked path. Unpinning is one atomic op.
+
+#define BP_PAGE_SIZE 4096
+#define BP_MIN_FRAMES 32 // A B-Tree operation pins up to 4 pages: room for 8 threads
+#define BP_NO_PAGE UINT64_MAX
+#define BP_PIN_CLAIMED (-1) // pin_count of a frame being evicted or written back
+
+// Fields other than pin_count and referenced change under the pool lock
+// only, with the frame claimed or pinned by the one changing it
+typedef struct {
+    _Atomic uint64_t page_no; // BP_NO_PAGE when the frame is free
+    char *data;               // BP_PAGE_SIZE bytes, 4KB aligned
+    _Atomic int pin_count;
+    _Atomic bool dirty;
+    _Atomic bool referenced;  // CLOCK bit, set on every access
+    _Atomic bool io_pending;  // Being read in or written back with the pool lock dropped
+    pthread_rwlock_t latch;
+    _Atomic uint64_t version; // Odd while latched exclusively (see above)
+} BPFrame;
+
+// page_no -> frame index or -1 (page numbers are dense). Replaced, never
+// resized in place, when a page number doesn't fit.
+typedef struct {
+    uint64_t cap;
+    _Atomic int32_t frames[];
+} BPPageMap;
+
+typedef struct {
+    int fd;
+    BPFrame *frames;
+    size_t num_frames;
+    HugeMem mem;            // Frame memory, one mapping (optionally on huge pages)
+    _Atomic(BPPageMap*) page_map;
+    EBR ebr;                // Lock-free hits read the page map inside an epoch
+    uint64_t num_pages;     // Pages allocated in the file
+    size_t clock_hand;
+    _Atomic int frame_waiters; // Threads waiting for any frame to become evictable
+    pthread_mutex_t lock;
+    pthread_cond_t io_cv;   // Signalled when a frame's I/O completes
+    IORing *ring;           // Checkpoint write-back, up to its depth pages in flight
+    pthread_mutex_t checkpoint_lock; // One checkpoint at a time owns the ring
+
+    _Atomic uint64_t hits;
+    uint64_t misses;        // Each one is a 4KB read
+    uint64_t evictions;
+    uint64_t writebacks;    // Dirty pages written (eviction or checkpoint)
+    uint64_t direct_writes; // Pages written by bp_write_run, around the frames
+} BufferPool;
+
+// Right after taking the latch exclusively / right before letting go of it
+static inline void bp_write_begin(BPFrame *f) {
+    atomic_fetch_add_explicit(&f->version, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+static inline void bp_write_end(BPFrame *f) {
+    atomic_fetch_add_explicit(&f->version, 1, memory_order_release);
+}
+// On a pinned frame: false while a writer has it (unpin and try again later,
+// waiting on it with pins held could starve the pool)
+static inline bool bp_read_begin(BPFrame *f, uint64_t *version) {
+    *version = atomic_load_explicit(&f->version, memory_order_acquire);
+    return !(*version & 1);
+}
+// Whether nothing was written since bp_read_begin returned version: what was
+// read in between is a consistent image, anything else must be thrown away
+static inline bool bp_read_valid(BPFrame *f, uint64_t version) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&f->version, memory_order_relaxed) == version;
+}
+
+// Opens (or creates) the page file. Existing pages are kept. io (NULL:
+// synchronous) sets how checkpoints write; evictions write one page at a time.
+BufferPool* bp_open(const char *path, size_t num_frames, bool huge_pages, const IORingOptions *io);
+BPFrame* bp_fetch(BufferPool *bp, uint64_t page_no); // Pinned
+BPFrame* bp_new_page(BufferPool *bp);                // Pinned, zeroed and dirty; page_no in the frame
+void bp_unpin(BufferPool *bp, BPFrame *f, bool dirty);
+// Bulk loading: reserve a run of fresh page numbers without caching them,
+// then write them straight to the file in large sequential writes. buf is
+// 4KB aligned and holds count pages; none of them may be in the pool yet.
+uint64_t bp_alloc_run(BufferPool *bp, uint64_t count); // First page number of the run
+bool bp_write_run(BufferPool *bp, uint64_t first_page, const char *buf, uint64_t count);
+void bp_checkpoint(BufferPool *bp); // Writes back every dirty page (under its read latch) and syncs
+void bp_reset_stats(BufferPool *bp);
+void bp_close(BufferPool *bp);      // Checkpoints first
+
+#endif
@@ -0,0 +1,421 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "lsm_internal.h"
+
+// Background compaction for LSMTree.
+//
+// Leveled: L0 (overlapping flush output) is merged into L1 once it holds
+// l0_compaction_trigger files; every L(n>=1) is one non-overlapping sorted run
+// of at most level_base_bytes * ratio^(n-1) bytes, and an over-full level pushes
+// one file (round robin) into the overlapping files of L(n+1).
+// Tiered: every level collects whole runs; once it holds `ratio` of them
+// (l0_compaction_trigger for L0) they are merged into a single run one level down.
+//
+// Both are a k-way heap merge of the inputs, newest input first, so the first
+// version of a key popped from the heap is the live one. Tombstones are dropped
+// only when nothing older can exist underneath the output. Byte values are
+// copied into the output's value pages; value log pointers that don't make
+// it to the output are reported dead to the value log.
+//
+// When no level needs work the thread collects value log segments instead.
+
+typedef struct {
+    int level;
+    int output_level;
+    LSMTableMeta **inputs; // Newest first: equal keys resolve to the lowest index
+    int *input_levels;
+    int num_inputs;
+    bool drop_tombstones;
+    bool split_outputs;
+} CompactionJob;
+
+static uint64_t level_target_bytes(LSMTree *t, int level) {
+    uint64_t target = t->opts.level_base_bytes;
+    for (int i = 1; i < level; i++) target *= t->opts.level_size_ratio;
+    return target;
+}
+
+static bool levels_empty_below(LSMTree *t, int level) {
+    for (int i = level + 1; i < LSM_MAX_LEVELS; i++) {
+        if (t->levels[i].count) return false;
+    }
+    return true;
+}
+
+static bool table_overlaps(LSMTableMeta *m, uint64_t lo, uint64_t hi) {
+    return !(m->max_key < lo || m->min_key > hi);
+}
+
+int lsm_compaction_pick_level(LSMTree *t) {
+    if (t->levels[0].count >= t->opts.l0_compaction_trigger) return 0;
+    if (t->opts.compaction_policy == LSM_COMPACTION_LEVELED) {
+        // The last level is allowed to grow without bound
+        for (int i = 1; i < LSM_MAX_LEVELS - 1; i++) {
+            if (t->levels[i].bytes > level_target_bytes(t, i)) return i;
+        }
+    } else {
+        for (int i = 1; i < LSM_MAX_LEVELS; i++) {
+            if (t->levels[i].count >= t->opts.level_size_ratio) return i;
+        }
+    }
+    return -1;
+}
+
+static void job_add(CompactionJob *job, LSMTableMeta *m, int level) {
+    job->inputs[job->num_inputs] = m;
+    job->input_levels[job->num_inputs] = level;
+    job->num_inputs++;
+}
+
+// levels_lock held
+static void compaction_build_job(LSMTree *t, int level, CompactionJob *job) {
+    LSMLevel *src = &t->levels[level];
+    int next_count = level + 1 < LSM_MAX_LEVELS ? t->levels[level + 1].count : 0;
+
+    memset(job, 0, sizeof(CompactionJob));
+    job->level = level;
+    job->inputs = (LSMTableMeta**)malloc(sizeof(LSMTableMeta*) * (src->count + next_count));
+    job->input_levels = (int*)malloc(sizeof(int) * (src->count + next_count));
+
+    if (t->opts.compaction_policy == LSM_COMPACTION_TIERED) {
+        job->output_level = (level == LSM_MAX_LEVELS - 1) ? level : level + 1;
+        for (int i = src->count - 1; i >= 0; i--) job_add(job, src->files[i], level);
+        // Older runs already sitting in the output level may still hold deleted keys
+        job->drop_tombstones = levels_empty_below(t, job->output_level) &&
+                               (job->output_level == level || t->levels[job->output_level].count == 0);
+        job->split_outputs = false; // One run = one file
+        return;
+    }
+
+    job->output_level = level + 1;
+    job->split_outputs = true;
+    uint64_t lo, hi;
+    if (level == 0) {
+        lo = UINT64_MAX;
+        hi = 0;
+        for (int i = src->count - 1; i >= 0; i--) {
+            LSMTableMeta *m = src->files[i];
+            job_add(job, m, 0);
+            if (m->min_key < lo) lo = m->min_key;
+            if (m->max_key > hi) hi = m->max_key;
+        }
+    } else {
+        LSMTableMeta *m = src->files[0];
+        for (int i = 0; i < src->count; i++) {
+            if (src->files[i]->min_key >= src->compact_cursor) {
+                m = src->files[i];
+                break;
+            }
+        }
+        job_add(job, m, level);
+        lo = m->min_key;
+        hi = m->max_key;
+        src->compact_cursor = (hi == UINT64_MAX) ? 0 : hi + 1;
+    }
+
+    LSMLevel *dst = &t->levels[level + 1];
+    for (int i = 0; i < dst->count; i++) {
+        if (table_overlaps(dst->files[i], lo, hi)) job_add(job, dst->files[i], level + 1);
+    }
+    job->drop_tombstones = levels_empty_below(t, job->output_level);
+}
+
+static void job_free(CompactionJob *job) {
+    free(job->inputs);
+    free(job->input_levels);
+}
+
+static bool merge_less(SSTIterator *its, int a, int b) {
+    if (its[a].key != its[b].key) return its[a].key < its[b].key;
+    return a < b; // Newer input wins the tie
+}
+
+static void heap_sift_down(int *heap, int n, SSTIterator *its, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < n && merge_less(its, heap[l], heap[m])) m = l;
+        if (r < n && merge_less(its, heap[r], heap[m])) m = r;
+        if (m == i) return;
+        int tmp = heap[i];
+        heap[i] = heap[m];
+        heap[m] = tmp;
+        i = m;
+    }
+}
+
+static void outputs_push(LSMTableMeta ***outputs, int *num, int *cap, LSMTableMeta *m) {
+    if (*num == *cap) {
+        *cap *= 2;
+        *outputs = (LSMTableMeta**)realloc(*outputs, sizeof(LSMTableMeta*) * *cap);
+    }
+    (*outputs)[(*num)++] = m;
+}
+
+static void compaction_install(LSMTree *t, CompactionJob *job, LSMTableMeta **outputs, int num_outputs) {
+    pthread_mutex_lock(&t->levels_lock);
+    for (int i = 0; i < job->num_inputs; i++) lsm_level_remove(t, job->input_levels[i], job->inputs[i]);
+    for (int i = 0; i < num_outputs; i++) {
+        lsm_level_add(t, job->output_level, outputs[i]);
+        t->compaction_bytes += outputs[i]->sst->file_bytes;
+    }
+    lsm_manifest_publish(t);
+    t->compactions++;
+    pthread_cond_broadcast(&t->stall_cv);
+    pthread_mutex_unlock(&t->levels_lock);
+}
+
+static void compaction_run(LSMTree *t, CompactionJob *job) {
+    // Trivial move: a single file with nothing to merge against keeps its bytes
+    if (job->num_inputs == 1 && job->output_level != job->level) {
+        pthread_mutex_lock(&t->levels_lock);
+        lsm_level_remove(t, job->level, job->inputs[0]);
+        lsm_level_add(t, job->output_level, job->inputs[0]);
+        lsm_manifest_publish(t);
+        pthread_cond_broadcast(&t->stall_cv);
+        pthread_mutex_unlock(&t->levels_lock);
+        return;
+    }
+
+    int n = job->num_inputs;
+    SSTIterator *its = (SSTIterator*)malloc(sizeof(SSTIterator) * n);
+    int *heap = (int*)malloc(sizeof(int) * n);
+    int hn = 0;
+    for (int i = 0; i < n; i++) {
+        sst_iter_init(&its[i], job->inputs[i]->sst, false); // Don't flush the cache for blocks about to be deleted
+        if (its[i].valid) heap[hn++] = i;
+    }
+    for (int i = hn / 2 - 1; i >= 0; i--) heap_sift_down(heap, hn, its, i);
+
+    int num_outputs = 0, cap_outputs = 4;
+    LSMTableMeta **outputs = (LSMTableMeta**)malloc(sizeof(LSMTableMeta*) * cap_outputs);
+    LSMTableMeta *cur = NULL;
+    SSTWriter *w = NULL;
+    bool failed = false, have_last = false;
+    uint64_t last_key = 0;
+    char *value_buf = NULL;
+    uint64_t *dropped = NULL; // Value log pointers left behind, reported once the output is in
+    size_t num_dropped = 0, cap_dropped = 0;
+
+    while (hn > 0 && !failed) {
+        int s = heap[0];
+        SSTIterator *it = &its[s];
+
+        if (have_last && it->key == last_key) {
+            if (it->kind == LSM_KIND_VPTR && t->vlog) {
+                if (num_dropped == cap_dropped) {
+                    cap_dropped = cap_dropped ? cap_dropped * 2 : 256;
+                    dropped = (uint64_t*)realloc(dropped, sizeof(uint64_t) * cap_dropped);
+                }
+                dropped[num_dropped++] = it->value;
+            }
+        } else {
+            have_last = true;
+            last_key = it->key; // Older versions of this key are skipped below
+            if (!(it->kind == LSM_KIND_TOMBSTONE && job->drop_tombstones)) {
+                if (w && job->split_outputs && sst_writer_bytes(w) >= t->opts.target_file_bytes) {
+                    cur = lsm_table_finish(t, cur, w);
+                    w = NULL;
+                    if (cur) outputs_push(&outputs, &num_outputs, &cap_outputs, cur);
+                    else failed = true;
+                }
+                if (!w && !failed) {
+                    cur = lsm_table_create(t, &w);
+                    if (!cur) failed = true;
+                }
+                uint64_t value = it->value;
+                if (!failed && it->kind == LSM_KIND_BYTES) {
+                    if (!value_buf) value_buf = (char*)malloc(SST_MAX_VALUE_BYTES);
+                    int len = sst_read_value(it->t, value, value_buf, SST_MAX_VALUE_BYTES, false);
+                    if (len < 0) failed = true;
+                    else value = sst_writer_add_value(w, value_buf, (uint32_t)len);
+                }
+                if (!failed) sst_writer_add(w, it->key, value, it->kind);
+            }
+        }
+
+        sst_iter_next(it);
+        if (!it->valid) heap[0] = heap[--hn];
+        heap_sift_down(heap, hn, its, 0);
+    }
+
+    if (w) {
+        bool empty = sst_writer_entries(w) == 0; // Everything left was a dropped tombstone
+        cur = lsm_table_finish(t, cur, w);
+        if (cur) outputs_push(&outputs, &num_outputs, &cap_outputs, cur);
+        else if (!empty) failed = true;
+    }
+
+    for (int i = 0; i < n; i++) sst_iter_destroy(&its[i]);
+    free(its);
+    free(heap);
+    free(value_buf);
+
+    if (failed) {
+        // Leave the inputs live and throw the partial output away
+        fprintf(stderr, "LSM compaction L%d -> L%d failed\n", job->level, job->output_level);
+        for (int i = 0; i < num_outputs; i++) lsm_table_retire(t, outputs[i]);
+        free(outputs);
+        free(dropped);
+        return;
+    }
+
+    compaction_install(t, job, outputs, num_outputs);
+    for (int i = 0; i < job->num_inputs; i++) lsm_table_retire(t, job->inputs[i]);
+    for (size_t i = 0; i < num_dropped; i++) vlog_discard(t->vlog, dropped[i]);
+    free(outputs);
+    free(dropped);
+}
+
+// --- Value log GC ---
+//
+// The segment is replayed and every value still referenced by the tree (the
+// newest version of its key holds exactly this pointer) is appended again at
+// the head of the log and the key repointed. The check is done once without
+// any lock to skip the dead ones, then again with gc_lock held exclusively,
+// in chunks, right before each rewrite so no user write can land in between.
+// Once the new pointers are durable the segment file goes.
+
+#define GC_CHUNK 128 // Keys repointed per hold of gc_lock
+
+typedef struct {
+    uint64_t key;
+    uint64_t vptr;
+    size_t data_off; // Its bytes in GCState.data
+} GCEntry;
+
+typedef struct {
+    LSMTree *t;
+    uint64_t seg;
+    GCEntry *live;
+    size_t num_live;
+    size_t cap_live;
+    char *data;
+    size_t data_len;
+    size_t data_cap;
+} GCState;
+
+static bool gc_still_live(LSMTree *t, uint64_t key, uint64_t vptr) {
+    uint64_t v;
+    return lsm_lookup(t, key, &v, NULL, 0, NULL) == LSM_KIND_VPTR && v == vptr;
+}
+
+static void gc_collect(void *arg, const WALRecord *r, const void *payload, uint64_t payload_off) {
+    GCState *g = (GCState*)arg;
+    uint64_t vptr = vlog_ptr(g->seg, payload_off, r->payload_len);
+    if (!gc_still_live(g->t, r->key, vptr)) return;
+    if (g->num_live == g->cap_live) {
+        g->cap_live = g->cap_live ? g->cap_live * 2 : 256;
+        g->live = (GCEntry*)realloc(g->live, sizeof(GCEntry) * g->cap_live);
+    }
+    while (g->data_len + r->payload_len > g->data_cap) {
+        g->data_cap = g->data_cap ? g->data_cap * 2 : 1 << 20;
+        g->data = (char*)realloc(g->data, g->data_cap);
+    }
+    GCEntry *e = &g->live[g->num_live++];
+    e->key = r->key;
+    e->vptr = vptr;
+    e->data_off = g->data_len;
+    memcpy(g->data + g->data_len, payload, r->payload_len);
+    g->data_len += r->payload_len;
+}
+
+static bool vlog_gc_run(LSMTree *t, uint64_t seg) {
+    GCState g;
+    memset(&g, 0, sizeof(g));
+    g.t = t;
+    g.seg = seg;
+    char path[512];
+    vlog_segment_path(t->vlog, seg, path, sizeof(path));
+    if (wal_replay(path, gc_collect, &g) < 0) return false;
+
+    uint64_t relocated = 0;
+    bool failed = false;
+    for (size_t i = 0; i < g.num_live; i += GC_CHUNK) {
+        pthread_rwlock_wrlock(&t->gc_lock);
+        for (size_t j = i; j < g.num_live && j < i + GC_CHUNK; j++) {
+            GCEntry *e = &g.live[j];
+            if (!gc_still_live(t, e->key, e->vptr)) continue; // Overwritten since the first check
+            uint32_t len = vlog_ptr_len(e->vptr);
+            uint64_t vptr = vlog_append(t->vlog, e->key, g.data + e->data_off, len);
+            if (lsm_write_record(t, e->key, LSM_KIND_VPTR, vptr, NULL, 0) != 0) failed = true;
+            relocated += len;
+        }
+        pthread_rwlock_unlock(&t->gc_lock);
+    }
+    // New values and the records pointing at them must survive a crash before the old copies go
+    vlog_sync(t->vlog);
+    if (lsm_wal_sync(t) != 0) failed = true;
+    // Relocated pointers that never reached the log: the old segment is still needed
+    if (!failed) vlog_gc_done(t->vlog, seg, relocated);
+    free(g.live);
+    free(g.data);
+    return !failed;
+}
+
+// Segment worth collecting, 0 if none
+uint64_t lsm_vlog_gc_pick(LSMTree *t) {
+    if (!t->vlog || t->gc_disabled) return 0;
+    return vlog_gc_pick(t->vlog, t->opts.vlog_gc_ratio);
+}
+
+static void* compaction_main(void *arg) {
+    LSMTree *t = (LSMTree*)arg;
+    pthread_mutex_lock(&t->levels_lock);
+    while (!t->shutting_down) {
+        int level = lsm_compaction_pick_level(t);
+        uint64_t seg = level < 0 ? lsm_vlog_gc_pick(t) : 0;
+        if (seg) {
+            // Not compaction_running: a batch ingest waits on that while holding gc_lock shared
+            t->gc_running = true;
+            pthread_mutex_unlock(&t->levels_lock);
+            bool ok = vlog_gc_run(t, seg);
+            pthread_mutex_lock(&t->levels_lock);
+            t->gc_running = false;
+            if (!ok) {
+                fprintf(stderr, "LSM value log GC of segment %lu failed\n", seg);
+                t->gc_disabled = true;
+            }
+            pthread_cond_broadcast(&t->stall_cv);
+            continue;
+        }
+        if (level < 0) {
+            pthread_cond_broadcast(&t->stall_cv); // Idle: release lsm_compact_wait
+            pthread_cond_wait(&t->compaction_cv, &t->levels_lock);
+            continue;
+        }
+
+        CompactionJob job;
+        compaction_build_job(t, level, &job);
+        t->compaction_running = true;
+        pthread_mutex_unlock(&t->levels_lock);
+
+        // Only this thread retires tables, so the inputs stay valid without extra references
+        compaction_run(t, &job);
+        job_free(&job);
+
+        pthread_mutex_lock(&t->levels_lock);
+        t->compaction_running = false;
+        pthread_cond_broadcast(&t->stall_cv);
+    }
+    pthread_mutex_unlock(&t->levels_lock);
+    return NULL;
+}
+
+void lsm_compaction_start(LSMTree *t) {
+    t->compaction_started = true;
+    pthread_create(&t->compaction_thread, NULL, compaction_main, t);
+}
+
+void lsm_compaction_stop(LSMTree *t) {
+    if (!t->compaction_started) return;
+    pthread_mutex_lock(&t->levels_lock);
+    t->shutting_down = true;
+    pthread_cond_broadcast(&t->compaction_cv);
+    pthread_cond_broadcast(&t->stall_cv);
+    pthread_mutex_unlock(&t->levels_lock);
+    pthread_join(t->compaction_thread, NULL);
+    t->compaction_started = false;
+}
@@ -0,0 +1,635 @@
+#define _GNU_SOURCE // Needed for O_DIRECT
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "cowbtree.h"
+#include "keysearch.h"
+#include "stats.h"
+
+CowBTreeOptions cow_default_options(void) {
+    CowBTreeOptions o;
+    o.t = 64;
+    o.txn_ops = 1000;
+    o.cache_bytes = 1 << 20; // Same 1MB as the B-Tree's default buffer pool
+    return o;
+}
+
+static inline bool cow_is_mem(uint64_t ref) {
+    return (ref & COW_MEM_REF) != 0;
+}
+
+static inline char* cow_mem_node(uint64_t ref) {
+    return (char*)(uintptr_t)(ref & ~COW_MEM_REF);
+}
+
+static inline uint64_t cow_mem_ref(const char *node) {
+    return (uint64_t)(uintptr_t)node | COW_MEM_REF;
+}
+
+// Same counting as the B-Tree's node_find
+static inline int cow_find(const BTreeNode *n, uint64_t key) {
+    uint32_t num_keys = n->hdr->num_keys;
+    if (num_keys) stats_add(STAT_KEY_COMPARISONS, 32 - __builtin_clz(num_keys));
+    return ks_lower_bound(n->keys, (int)num_keys, key);
+}
+
+static inline int cow_child_index(const BTreeNode *n, uint64_t key) {
+    int i = cow_find(n, key);
+    if (i < (int)n->hdr->num_keys && n->keys[i] == key) i++;
+    return i;
+}
+
+static char* cow_alloc_page(void) {
+    char *p;
+    if (posix_memalign((void**)&p, BP_PAGE_SIZE, BP_PAGE_SIZE) != 0) {
+        perror("COW B-Tree page allocation failed");
+        abort();
+    }
+    return p;
+}
+
+// A committed page into buf (aligned): a copy from the cache, else an
+// O_DIRECT read, cached afterwards
+static void cow_read_page(CowBTree *tree, uint64_t page_no, char *buf) {
+    uint64_t off = page_no * BP_PAGE_SIZE;
+    if (tree->cache && bc_get(tree->cache, 0, off, buf)) {
+        stats_add(STAT_CACHE_HITS, 1);
+        return;
+    }
+    if (pread(tree->fd, buf, BP_PAGE_SIZE, off) != BP_PAGE_SIZE) {
+        perror("COW B-Tree read failed");
+        memset(buf, 0, BP_PAGE_SIZE); // An empty leaf
+        ((BTreePageHeader*)buf)->is_leaf = 1;
+    }
+    stats_add(STAT_BYTES_READ, BP_PAGE_SIZE);
+    stats_add(STAT_CACHE_MISSES, 1);
+    if (tree->cache) bc_put(tree->cache, 0, off, buf);
+}
+
+// The node a ref names, as a view: the in-memory node itself, or buf
+// holding the page. Only valid inside the caller's epoch (or write_lock).
+static void cow_node(CowBTree *tree, uint64_t ref, char *buf, BTreeNode *n) {
+    char *data = buf;
+    if (cow_is_mem(ref)) data = cow_mem_node(ref);
+    else cow_read_page(tree, ref, buf);
+    btree_node_layout(tree->t, data, n);
+}
+
+// --- Reads ---
+
+static bool cow_find_in(CowBTree *tree, uint64_t root, uint64_t key, uint64_t *value) {
+    static __thread char buf[BP_PAGE_SIZE] __attribute__((aligned(BP_PAGE_SIZE)));
+    stats_add(STAT_LOOKUPS, 1);
+    stats_add(STAT_LOOKUP_FILES, 1);
+    uint64_t ref = root;
+    int pages = 0;
+    BTreeNode n;
+    for (;;) {
+        cow_node(tree, ref, buf, &n);
+        pages++;
+        if (n.hdr->is_leaf) break;
+        ref = n.children[cow_child_index(&n, key)];
+    }
+    stats_add(STAT_LOOKUP_BLOCKS, pages);
+    int i = cow_find(&n, key);
+    if (i >= (int)n.hdr->num_keys || n.keys[i] != key) return false;
+    if (value) *value = n.values[i];
+    return true;
+}
+
+void cow_snapshot_open(CowBTree *tree, CowSnapshot *s) {
+    s->tree = tree;
+    s->ticket = ebr_enter(&tree->ebr);
+    s->root = atomic_load(&tree->root);
+}
+
+void cow_snapshot_close(CowSnapshot *s) {
+    ebr_exit(&s->tree->ebr, s->ticket);
+}
+
+bool cow_snapshot_search(const CowSnapshot *s, uint64_t key, uint64_t *value) {
+    return cow_find_in(s->tree, s->root, key, value);
+}
+
+bool cow_search(CowBTree *tree, uint64_t key, uint64_t *value) {
+    CowSnapshot s;
+    cow_snapshot_open(tree, &s);
+    bool found = cow_snapshot_search(&s, key, value);
+    cow_snapshot_close(&s);
+    return found;
+}
+
+typedef struct {
+    CowBTree *tree;
+    uint64_t start;
+    size_t limit;
+    size_t count;
+    CowScanFn cb;
+    void *arg;
+    bool stopped;
+    char *bufs[COW_MAX_DEPTH]; // One page per level, allocated on first use
+} CowScan;
+
+// In-order walk below ref, from the first key >= start
+static void cow_scan_node(CowScan *s, uint64_t ref, int depth) {
+    if (!cow_is_mem(ref) && !s->bufs[depth]) s->bufs[depth] = cow_alloc_page();
+    BTreeNode n;
+    cow_node(s->tree, ref, s->bufs[depth], &n);
+    if (n.hdr->is_leaf) {
+        for (int i = cow_find(&n, s->start); i < (int)n.hdr->num_keys; i++) {
+            if (s->limit && s->count == s->limit) {
+                s->stopped = true;
+                return;
+            }
+            s->count++;
+            if (!s->cb(s->arg, n.keys[i], &n.values[i], sizeof(uint64_t))) {
+                s->stopped = true;
+                return;
+            }
+        }
+        return;
+    }
+    for (int i = cow_child_index(&n, s->start); i <= (int)n.hdr->num_keys && !s->stopped; i++) {
+        cow_scan_node(s, n.children[i], depth + 1);
+    }
+}
+
+size_t cow_snapshot_scan(const CowSnapshot *snap, uint64_t start, size_t limit, CowScanFn cb, void *arg) {
+    CowScan s;
+    memset(&s, 0, sizeof(s));
+    s.tree = snap->tree;
+    s.start = start;
+    s.limit = limit;
+    s.cb = cb;
+    s.arg = arg;
+    cow_scan_node(&s, snap->root, 0);
+    for (int i = 0; i < COW_MAX_DEPTH; i++) free(s.bufs[i]);
+    return s.count;
+}
+
+size_t cow_scan(CowBTree *tree, uint64_t start, size_t limit, CowScanFn cb, void *arg) {
+    CowSnapshot s;
+    cow_snapshot_open(tree, &s);
+    size_t count = cow_snapshot_scan(&s, start, limit, cb, arg);
+    cow_snapshot_close(&s);
+    return count;
+}
+
+// --- Commit ---
+
+static uint32_t cow_meta_checksum(const CowMeta *m) {
+    uint64_t h = m->magic * 0x9E3779B97F4A7C15ULL;
+    h ^= m->txn_id + 0x7F4A7C15ULL + (h << 6) + (h >> 2);
+    h ^= m->root + 0x9E3779B9ULL + (h << 6) + (h >> 2);
+    h ^= m->num_pages + 0x7F4A7C15ULL + (h << 6) + (h >> 2);
+    h ^= m->t + 0x9E3779B9ULL + (h << 6) + (h >> 2);
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+typedef struct {
+    char *buf; // Pages of the commit in file order, 4KB aligned
+    uint64_t count, cap;
+    uint64_t first_page;
+    char **nodes; // The in-memory nodes they were made from, garbage once the commit is durable
+    size_t num_nodes, cap_nodes;
+} CowCommitRun;
+
+// Remembers a node replaced in the open transaction (write_lock held)
+static void cow_garbage(CowBTree *tree, char *node) {
+    if (tree->num_garbage == tree->cap_garbage) {
+        tree->cap_garbage = tree->cap_garbage ? tree->cap_garbage * 2 : 256;
+        tree->garbage = (char**)realloc(tree->garbage, sizeof(char*) * tree->cap_garbage);
+    }
+    tree->garbage[tree->num_garbage++] = node;
+}
+
+static char* cow_run_slot(CowCommitRun *r) {
+    if (r->count == r->cap) {
+        uint64_t cap = r->cap ? r->cap * 2 : 64;
+        char *buf;
+        if (posix_memalign((void**)&buf, BP_PAGE_SIZE, cap * BP_PAGE_SIZE) != 0) {
+            perror("COW B-Tree commit buffer allocation failed");
+            abort();
+        }
+        if (r->count) memcpy(buf, r->buf, r->count * BP_PAGE_SIZE);
+        free(r->buf);
+        r->buf = buf;
+        r->cap = cap;
+    }
+    return r->buf + r->count++ * BP_PAGE_SIZE;
+}
+
+// Lays out the uncommitted nodes under ref children first, so each page
+// only points back into the file, and returns ref's page number. The
+// in-memory nodes themselves aren't touched: readers may be in them.
+static uint64_t cow_commit_node(CowBTree *tree, uint64_t ref, CowCommitRun *r) {
+    if (!cow_is_mem(ref)) return ref;
+    char *node = cow_mem_node(ref);
+    BTreeNode n;
+    btree_node_layout(tree->t, node, &n);
+    uint64_t children[2 * BTREE_MAX_T];
+    if (!n.hdr->is_leaf) {
+        for (uint32_t i = 0; i <= n.hdr->num_keys; i++) children[i] = cow_commit_node(tree, n.children[i], r);
+    }
+    uint64_t page_no = r->first_page + r->count;
+    char *page = cow_run_slot(r);
+    memcpy(page, node, BP_PAGE_SIZE);
+    if (!n.hdr->is_leaf) {
+        BTreeNode p;
+        btree_node_layout(tree->t, page, &p);
+        memcpy(p.children, children, sizeof(uint64_t) * (n.hdr->num_keys + 1));
+    }
+    if (r->num_nodes == r->cap_nodes) {
+        r->cap_nodes = r->cap_nodes ? r->cap_nodes * 2 : 64;
+        r->nodes = (char**)realloc(r->nodes, sizeof(char*) * r->cap_nodes);
+    }
+    r->nodes[r->num_nodes++] = node;
+    return page_no;
+}
+
+static bool cow_sync(CowBTree *tree) {
+    if (fdatasync(tree->fd) == 0) return true;
+    perror("COW B-Tree sync failed");
+    return false;
+}
+
+static bool cow_write(CowBTree *tree, const char *buf, size_t len, uint64_t off) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(tree->fd, buf + done, len - done, off + done);
+        if (n <= 0) {
+            perror("COW B-Tree write failed");
+            return false;
+        }
+        done += n;
+    }
+    // WAF Metric: every page of the commit, meta page included
+    atomic_fetch_add(&physical_bytes_written, len);
+    return true;
+}
+
+static void cow_retire_nodes(void *arg) {
+    char **nodes = (char**)arg;
+    for (size_t i = 0; nodes[i]; i++) free(nodes[i]);
+    free(nodes);
+}
+
+// write_lock held
+static void cow_commit_locked(CowBTree *tree) {
+    uint64_t root = atomic_load(&tree->root);
+    if (!cow_is_mem(root) && tree->txn_updates == 0) return;
+
+    CowCommitRun r;
+    memset(&r, 0, sizeof(r));
+    r.first_page = tree->num_pages;
+    uint64_t root_page = cow_commit_node(tree, root, &r);
+    // Data pages first, durable before any meta page names them
+    bool ok = r.count == 0 || cow_write(tree, r.buf, r.count * BP_PAGE_SIZE, r.first_page * BP_PAGE_SIZE);
+    ok = ok && cow_sync(tree);
+
+    char *page = cow_alloc_page();
+    memset(page, 0, BP_PAGE_SIZE);
+    CowMeta *m = (CowMeta*)page;
+    m->magic = COW_MAGIC;
+    m->txn_id = tree->txn_id + 1;
+    m->root = root_page;
+    m->num_pages = tree->num_pages + r.count;
+    m->t = tree->t;
+    m->checksum = cow_meta_checksum(m);
+    // The older meta page: the current one stays intact if this write tears
+    ok = ok && cow_write(tree, page, BP_PAGE_SIZE, (m->txn_id % COW_META_PAGES) * BP_PAGE_SIZE);
+    ok = ok && cow_sync(tree);
+    free(page);
+    if (!ok) {
+        // The transaction stays open, its nodes still in the tree. Its pages
+        // are skipped, not rewritten: a meta page naming them may be on disk
+        // after all, and it keeps the older slot, so the next try overwrites
+        // it rather than the current one.
+        tree->num_pages += r.count;
+        free(r.buf);
+        free(r.nodes);
+        return;
+    }
+
+    // Fresh pages are the hot ones
+    for (uint64_t i = 0; tree->cache && i < r.count; i++) {
+        bc_put(tree->cache, 0, (r.first_page + i) * BP_PAGE_SIZE, r.buf + i * BP_PAGE_SIZE);
+    }
+    free(r.buf);
+    tree->txn_id++;
+    tree->num_pages += r.count;
+    tree->txn_updates = 0;
+    atomic_fetch_add(&tree->commits, 1);
+    atomic_fetch_add(&tree->pages_written, r.count);
+    atomic_store(&tree->root, root_page);
+
+    // Every in-memory node of the transaction is unreachable now
+    for (size_t i = 0; i < r.num_nodes; i++) cow_garbage(tree, r.nodes[i]);
+    free(r.nodes);
+    if (tree->num_garbage) {
+        char **nodes = (char**)malloc(sizeof(char*) * (tree->num_garbage + 1));
+        memcpy(nodes, tree->garbage, sizeof(char*) * tree->num_garbage);
+        nodes[tree->num_garbage] = NULL;
+        tree->num_garbage = 0;
+        ebr_retire(&tree->ebr, nodes, cow_retire_nodes);
+    }
+}
+
+void cow_commit(CowBTree *tree) {
+    stats_mutex_lock(&tree->write_lock);
+    cow_commit_locked(tree);
+    pthread_mutex_unlock(&tree->write_lock);
+}
+
+// --- Updates (write_lock held) ---
+
+// A private copy of the node ref names, for the current update to change
+// before it publishes it. An in-memory original is replaced by it.
+static char* cow_copy(CowBTree *tree, uint64_t ref) {
+    char *copy = cow_alloc_page();
+    if (cow_is_mem(ref)) {
+        memcpy(copy, cow_mem_node(ref), BP_PAGE_SIZE);
+        cow_garbage(tree, cow_mem_node(ref));
+    } else {
+        cow_read_page(tree, ref, copy);
+    }
+    atomic_fetch_add(&tree->pages_copied, 1);
+    return copy;
+}
+
+static char* cow_new_node(CowBTree *tree, bool is_leaf, BTreeNode *n) {
+    char *node = cow_alloc_page();
+    memset(node, 0, BP_PAGE_SIZE);
+    btree_node_layout(tree->t, node, n);
+    n->hdr->is_leaf = is_leaf;
+    n->hdr->next_leaf = BTREE_NO_PAGE;
+    return node;
+}
+
+// Splits x's full i-th child y (private copies both) and returns the new
+// right half, linked into x
+static char* cow_split_child(CowBTree *tree, BTreeNode *x, int i, char *y_node) {
+    BTreeNode y, z;
+    btree_node_layout(tree->t, y_node, &y);
+    char *z_node = cow_new_node(tree, y.hdr->is_leaf, &z);
+    uint64_t sep = btree_node_split(tree->t, &y, &z);
+    btree_node_add_child(x, i, sep, cow_mem_ref(z_node));
+    return z_node;
+}
+
+static bool cow_full(CowBTree *tree, const BTreeNode *n) {
+    return n->hdr->num_keys == 2 * (uint32_t)tree->t - 1;
+}
+
+// One update of the open transaction is in: publish it, and commit if the
+// transaction is full
+static void cow_publish(CowBTree *tree, char *root) {
+    atomic_store(&tree->root, cow_mem_ref(root));
+    if (++tree->txn_updates >= tree->txn_ops) cow_commit_locked(tree);
+}
+
+// Copies the root path, splitting full nodes on the way down like the
+// B-Tree's pessimistic insert, so the leaf always has room
+static void cow_store(CowBTree *tree, uint64_t key, uint64_t value) {
+    char *root = cow_copy(tree, atomic_load(&tree->root));
+    BTreeNode cur;
+    btree_node_layout(tree->t, root, &cur);
+    if (cow_full(tree, &cur)) {
+        BTreeNode s;
+        char *s_node = cow_new_node(tree, false, &s);
+        s.children[0] = cow_mem_ref(root);
+        cow_split_child(tree, &s, 0, root);
+        root = s_node;
+        cur = s;
+    }
+    while (!cur.hdr->is_leaf) {
+        int i = cow_child_index(&cur, key);
+        char *child = cow_copy(tree, cur.children[i]);
+        cur.children[i] = cow_mem_ref(child);
+        BTreeNode c;
+        btree_node_layout(tree->t, child, &c);
+        if (cow_full(tree, &c)) {
+            char *right = cow_split_child(tree, &cur, i, child);
+            if (key >= cur.keys[i]) btree_node_layout(tree->t, right, &c);
+        }
+        cur = c;
+    }
+
+    int i = cow_find(&cur, key);
+    if (i < (int)cur.hdr->num_keys && cur.keys[i] == key) {
+        cur.values[i] = value;
+    } else {
+        int n = cur.hdr->num_keys;
+        memmove(cur.keys + i + 1, cur.keys + i, sizeof(uint64_t) * (n - i));
+        memmove(cur.values + i + 1, cur.values + i, sizeof(uint64_t) * (n - i));
+        cur.keys[i] = key;
+        cur.values[i] = value;
+        cur.hdr->num_keys++;
+    }
+    cow_publish(tree, root);
+}
+
+void cow_insert(CowBTree *tree, uint64_t key, uint64_t value) {
+    // WAF Metric: Logical Write = 16 bytes (Key 8 + Value 8), like the B-Tree
+    atomic_fetch_add(&logical_bytes_written, sizeof(uint64_t) * 2);
+    stats_mutex_lock(&tree->write_lock);
+    cow_store(tree, key, value);
+    pthread_mutex_unlock(&tree->write_lock);
+}
+
+void cow_put(CowBTree *tree, uint64_t key, const void *value, uint32_t len) {
+    uint64_t v = 0;
+    memcpy(&v, value, len < sizeof(v) ? len : sizeof(v));
+    // WAF Metric: key + value bytes, as the caller wrote them (like btree_put / lsm_put)
+    atomic_fetch_add(&logical_bytes_written, sizeof(uint64_t) + len);
+    stats_mutex_lock(&tree->write_lock);
+    cow_store(tree, key, v);
+    pthread_mutex_unlock(&tree->write_lock);
+}
+
+void cow_insert_batch(CowBTree *tree, const uint64_t *keys, const uint64_t *values, size_t n) {
+    atomic_fetch_add(&logical_bytes_written, sizeof(uint64_t) * 2 * n);
+    stats_mutex_lock(&tree->write_lock);
+    uint32_t txn_ops = tree->txn_ops;
+    tree->txn_ops = UINT32_MAX; // One transaction, whatever its size
+    for (size_t i = 0; i < n; i++) cow_store(tree, keys[i], values[i]);
+    tree->txn_ops = txn_ops;
+    cow_commit_locked(tree);
+    pthread_mutex_unlock(&tree->write_lock);
+}
+
+// Unlinks x's i-th child. false if it was the only one: x is empty now.
+static bool cow_remove_child(BTreeNode *x, int i) {
+    int n = x->hdr->num_keys;
+    if (n == 0) return false;
+    // The separator on the side of the gap goes with it
+    int k = i > 0 ? i - 1 : 0;
+    memmove(x->keys + k, x->keys + k + 1, sizeof(uint64_t) * (n - k - 1));
+    memmove(x->children + i, x->children + i + 1, sizeof(uint64_t) * (n - i));
+    x->hdr->num_keys--;
+    return true;
+}
+
+void cow_delete(CowBTree *tree, uint64_t key) {
+    // Same logical cost as an LSM tombstone, so the WAFs compare
+    atomic_fetch_add(&logical_bytes_written, sizeof(uint64_t) * 2);
+    stats_mutex_lock(&tree->write_lock);
+    // Nothing to copy for a missing key (no reader can be freeing under the writer)
+    if (!cow_find_in(tree, atomic_load(&tree->root), key, NULL)) {
+        pthread_mutex_unlock(&tree->write_lock);
+        return;
+    }
+
+    char *path[COW_MAX_DEPTH];
+    int idx[COW_MAX_DEPTH], depth = 0;
+    BTreeNode n;
+    path[0] = cow_copy(tree, atomic_load(&tree->root));
+    btree_node_layout(tree->t, path[0], &n);
+    while (!n.hdr->is_leaf) {
+        idx[depth] = cow_child_index(&n, key);
+        char *child = cow_copy(tree, n.children[idx[depth]]);
+        n.children[idx[depth]] = cow_mem_ref(child);
+        path[++depth] = child;
+        btree_node_layout(tree->t, child, &n);
+    }
+    int i = cow_find(&n, key);
+    int rest = n.hdr->num_keys - i - 1;
+    memmove(n.keys + i, n.keys + i + 1, sizeof(uint64_t) * rest);
+    memmove(n.values + i, n.values + i + 1, sizeof(uint64_t) * rest);
+    n.hdr->num_keys--;
+
+    // Emptied nodes leave their parent, bottom up. A root with nothing
+    // left is an empty leaf again.
+    bool empty = n.hdr->num_keys == 0;
+    int d = depth;
+    while (empty && d > 0) {
+        cow_garbage(tree, path[d]);
+        btree_node_layout(tree->t, path[--d], &n);
+        empty = !cow_remove_child(&n, idx[d]);
+    }
+    if (empty) {
+        btree_node_layout(tree->t, path[0], &n);
+        n.hdr->is_leaf = 1;
+        n.hdr->num_keys = 0;
+    }
+    // A root left with one child hands over to it
+    int top = 0;
+    for (; top < d; top++) {
+        btree_node_layout(tree->t, path[top], &n);
+        if (n.hdr->num_keys > 0) break;
+        cow_garbage(tree, path[top]);
+    }
+    cow_publish(tree, path[top]);
+    pthread_mutex_unlock(&tree->write_lock);
+}
+
+// --- Open / close ---
+
+CowBTree* cow_open(const char *path, const CowBTreeOptions *opts) {
+    int fd;
+#ifdef __linux__
+    fd = open(path, O_RDWR | O_CREAT | O_DIRECT, 0666);
+#else
+    fd = open(path, O_RDWR | O_CREAT, 0666);
+#endif
+    if (fd == -1) {
+        perror("COW B-Tree open failed");
+        return NULL;
+    }
+    ks_init();
+
+    CowBTree *tree = (CowBTree*)calloc(1, sizeof(CowBTree));
+    tree->fd = fd;
+    tree->t = opts->t;
+    if (tree->t > (int)BTREE_MAX_T) tree->t = BTREE_MAX_T;
+    if (tree->t < 2) tree->t = 2;
+    tree->txn_ops = opts->txn_ops ? opts->txn_ops : 1;
+    tree->cache = bc_create(opts->cache_bytes, BC_DEFAULT_SHARDS);
+    ebr_init(&tree->ebr);
+    pthread_mutex_init(&tree->write_lock, NULL);
+
+    // The newer of the two meta pages that checks out
+    CowMeta best = {0};
+    bool found = false;
+    char *page = cow_alloc_page();
+    for (int i = 0; i < COW_META_PAGES; i++) {
+        if (pread(fd, page, BP_PAGE_SIZE, (off_t)i * BP_PAGE_SIZE) != BP_PAGE_SIZE) continue;
+        CowMeta m;
+        memcpy(&m, page, sizeof(m));
+        if (m.magic != COW_MAGIC || m.checksum != cow_meta_checksum(&m)) continue;
+        if (!found || m.txn_id > best.txn_id) best = m;
+        found = true;
+    }
+    free(page);
+
+    if (found) {
+        // Pages past num_pages belong to a commit that never got its meta
+        // page: the next commit writes over them
+        tree->t = best.t;
+        tree->txn_id = best.txn_id;
+        tree->num_pages = best.num_pages;
+        atomic_init(&tree->root, best.root);
+        return tree;
+    }
+
+    // New tree: an empty root leaf, committed right away so the file has a meta page
+    tree->num_pages = COW_META_PAGES;
+    BTreeNode root;
+    atomic_init(&tree->root, cow_mem_ref(cow_new_node(tree, true, &root)));
+    cow_commit(tree);
+    return tree;
+}
+
+void cow_reset_stats(CowBTree *tree) {
+    tree->commits = 0;
+    tree->pages_written = 0;
+    tree->pages_copied = 0;
+    if (tree->cache) bc_reset_stats(tree->cache);
+}
+
+void cow_print_stats(CowBTree *tree, const char *label) {
+    uint64_t commits = atomic_load(&tree->commits), written = atomic_load(&tree->pages_written);
+    pthread_mutex_lock(&tree->write_lock);
+    uint64_t num_pages = tree->num_pages, txn_id = tree->txn_id;
+    pthread_mutex_unlock(&tree->write_lock);
+    printf("%s Commits: %lu (txn %lu, up to %u updates each), %lu pages written (%.1f per commit), %lu node copies, %.1f MB file\n",
+           label, commits, txn_id, tree->txn_ops, written, commits ? (double)written / commits : 0.0,
+           atomic_load(&tree->pages_copied), num_pages * BP_PAGE_SIZE / 1048576.0);
+    if (tree->cache) {
+        uint64_t hits, misses, evictions;
+        size_t used;
+        bc_counters(tree->cache, &hits, &misses, &evictions, &used);
+        printf("%s Page cache: %lu hits / %lu misses (%.1f%% hit rate), %lu evictions, %zu / %zu KB\n", label, hits,
+               misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0, evictions, used / 1024,
+               tree->cache->capacity / 1024);
+    }
+    printf("%s Epochs: %lu node batches retired, %lu still pending\n", label, tree->ebr.reclaimed, tree->ebr.pending);
+}
+
+static bool cow_count_entry(void *arg, uint64_t key, const void *value, uint32_t len) {
+    (void)key;
+    (void)value;
+    *(uint64_t*)arg += sizeof(uint64_t) + len;
+    return true;
+}
+
+void cow_space_usage(CowBTree *tree, uint64_t *live_bytes, uint64_t *disk_bytes) {
+    *live_bytes = 0;
+    cow_scan(tree, 0, 0, cow_count_entry, live_bytes);
+    pthread_mutex_lock(&tree->write_lock);
+    *disk_bytes = tree->num_pages * BP_PAGE_SIZE;
+    pthread_mutex_unlock(&tree->write_lock);
+}
+
+void cow_close(CowBTree *tree) {
+    if (!tree) return;
+    cow_commit(tree);
+    ebr_destroy(&tree->ebr); // No reader left
+    free(tree->garbage);
+    close(tree->fd);
+    bc_free(tree->cache);
+    pthread_mutex_destroy(&tree->write_lock);
+    free(tree);
+}
@@ -0,0 +1,121 @@
+#ifndef COWBTREE_H
+#define COWBTREE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "btree.h"
+#include "blockcache.h"
+#include "epoch.h"
+
+// Copy-on-write B+-Tree, LMDB style: the third contender next to the
+// in-place B-Tree and the LSM.
+//
+// Same node pages as btree.h and the same split rule, but a page on disk is
+// never written twice. An update copies the nodes on its root path, changes
+// the copies and publishes the new root; the file only grows at its end.
+// Pages 0 and 1 are two meta pages written in turn, each naming a root: a
+// commit appends its pages, syncs, then overwrites the older meta page and
+// syncs again. A crash anywhere leaves one of the two naming a complete
+// tree, with no log to replay.
+//
+// Copies made since the last commit stay in memory and readers follow them
+// like pages, so child pointers and roots are "refs": a page number, or an
+// in-memory node tagged with COW_MEM_REF. A write transaction groups up to
+// txn_ops updates, and a node copied several times in it is written once,
+// at commit, in one sequential write with the rest. Updates in the open
+// transaction are lost in a crash, like a periodic WAL sync.
+//
+// Readers take no lock: a published root names a tree nobody changes any
+// more, so a reader loads it inside an epoch (epoch.h) and walks it, and an
+// in-memory node that a later update replaces is retired rather than freed.
+// Every read is thus served from a snapshot; cow_snapshot_* keeps one
+// across calls. Writers are serialized by one mutex, as in LMDB.
+//
+// Leaves aren't linked (a copy would have to rewrite its left neighbour
+// too), so scans walk down from the root. Deletes drop empty nodes but
+// don't merge underfull ones. Values are u64 only: engine_open refuses a
+// COW B-Tree with byte values, and cow_put keeps the first 8 bytes.
+
+#define COW_MAGIC 0x31304557434f43ULL // "COWC01"
+#define COW_META_PAGES 2
+#define COW_MEM_REF (1ULL << 63) // Ref bit: the rest is a pointer to an uncommitted node
+#define COW_MAX_DEPTH 64
+
+typedef struct {
+    int t;              // Min degree, up to BTREE_MAX_T
+    uint32_t txn_ops;   // Updates per write transaction (1: every update is durable on return)
+    size_t cache_bytes; // Block cache for committed pages, which never change: nothing to invalidate
+} CowBTreeOptions;
+
+// One of the two meta pages
+typedef struct {
+    uint64_t magic;
+    uint64_t txn_id;    // Commit number: the valid page with the larger one is current
+    uint64_t root;      // Page number
+    uint64_t num_pages; // File end after the commit
+    uint32_t t;
+    uint32_t checksum;  // Over the fields above, so a torn meta write only loses its commit
+} CowMeta;
+
+typedef struct {
+    int fd;
+    int t;
+    _Atomic uint64_t root; // Ref of the newest tree, where readers start
+    EBR ebr;               // Keeps replaced in-memory nodes alive for the readers still in them
+    BlockCache *cache;
+    uint32_t txn_ops;
+
+    // Writer state, guarded by write_lock
+    pthread_mutex_t write_lock;
+    uint64_t txn_id;       // Last commit
+    uint64_t num_pages;    // Where the next commit appends
+    uint32_t txn_updates;  // Updates in the open transaction
+    char **garbage;        // Nodes replaced in the open transaction, retired at commit
+    size_t num_garbage, cap_garbage;
+
+    _Atomic uint64_t commits;
+    _Atomic uint64_t pages_written; // Node pages appended by commits (meta pages not included)
+    _Atomic uint64_t pages_copied;  // Nodes copied by updates, most never written
+} CowBTree;
+
+// A consistent view of the tree as of cow_snapshot_open, whatever is
+// written meanwhile. Holds an epoch: while it is open no node replaced
+// after it is freed, so don't keep one for long.
+typedef struct {
+    CowBTree *tree;
+    uint64_t root;
+    uint64_t ticket;
+} CowSnapshot;
+
+typedef bool (*CowScanFn)(void *arg, uint64_t key, const void *value, uint32_t len);
+
+CowBTreeOptions cow_default_options(void);
+// Reopens the newest commit of an existing file, or starts a new one
+CowBTree* cow_open(const char *path, const CowBTreeOptions *opts);
+void cow_insert(CowBTree *tree, uint64_t key, uint64_t value); // Insert or update
+// Stores the first 8 bytes (the rest is dropped), logged as len bytes written
+void cow_put(CowBTree *tree, uint64_t key, const void *value, uint32_t len);
+bool cow_search(CowBTree *tree, uint64_t key, uint64_t *value); // Copies the value out (value may be NULL)
+void cow_delete(CowBTree *tree, uint64_t key);
+// All n in one transaction, committed when done
+void cow_insert_batch(CowBTree *tree, const uint64_t *keys, const uint64_t *values, size_t n);
+// Calls cb for up to limit entries (0: no limit) with key >= start, in key
+// order, on one snapshot. Returns how many entries were passed to cb.
+size_t cow_scan(CowBTree *tree, uint64_t start, size_t limit, CowScanFn cb, void *arg);
+void cow_commit(CowBTree *tree); // Every update so far is durable on return
+
+void cow_snapshot_open(CowBTree *tree, CowSnapshot *s);
+bool cow_snapshot_search(const CowSnapshot *s, uint64_t key, uint64_t *value);
+size_t cow_snapshot_scan(const CowSnapshot *s, uint64_t start, size_t limit, CowScanFn cb, void *arg);
+void cow_snapshot_close(CowSnapshot *s);
+
+void cow_reset_stats(CowBTree *tree);
+void cow_print_stats(CowBTree *tree, const char *label);
+// 16 bytes per entry (walks every leaf) and the file size, superseded pages included
+void cow_space_usage(CowBTree *tree, uint64_t *live_bytes, uint64_t *disk_bytes);
+void cow_close(CowBTree *tree); // Commits first
+
+#endif
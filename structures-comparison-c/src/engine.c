@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "engine.h"
+
+// --- B-Tree ---
+
+static void bt_insert(void *impl, uint64_t key, uint64_t value) {
+    btree_insert((BTree*)impl, key, value);
+}
+
+static bool bt_search(void *impl, uint64_t key, uint64_t *value) {
+    return btree_search((BTree*)impl, key, value);
+}
+
+static void bt_delete(void *impl, uint64_t key) {
+    btree_delete((BTree*)impl, key);
+}
+
+static void bt_put(void *impl, uint64_t key, const void *value, uint32_t len) {
+    btree_put((BTree*)impl, key, value, len);
+}
+
+static bool bt_get(void *impl, uint64_t key, void *buf, uint32_t cap, uint32_t *len) {
+    return btree_get((BTree*)impl, key, buf, cap, len);
+}
+
+static size_t bt_scan(void *impl, uint64_t start, size_t limit, EngineScanFn cb, void *arg) {
+    return btree_scan((BTree*)impl, start, limit, cb, arg);
+}
+
+static void bt_insert_batch(void *impl, const uint64_t *keys, const uint64_t *values, size_t n) {
+    btree_insert_batch((BTree*)impl, keys, values, n);
+}
+
+static void bt_sync(void *impl) {
+    btree_checkpoint((BTree*)impl);
+}
+
+static void bt_reset_stats(void *impl) {
+    btree_reset_stats((BTree*)impl);
+}
+
+static void bt_space(void *impl, uint64_t *live_bytes, uint64_t *disk_bytes) {
+    btree_space_usage((BTree*)impl, live_bytes, disk_bytes);
+}
+
+static void bt_print_stats(void *impl, const char *label) {
+    btree_print_stats((BTree*)impl, label);
+}
+
+static void bt_close(void *impl) {
+    btree_free((BTree*)impl);
+}
+
+const StorageEngineOps btree_engine_ops = {
+    "B-Tree", bt_insert, bt_search, bt_delete, bt_put, bt_get, bt_scan, bt_insert_batch,
+    bt_sync, bt_reset_stats, bt_space, bt_print_stats, bt_close,
+};
+
+// --- LSM-Tree ---
+
+static void lsm_e_insert(void *impl, uint64_t key, uint64_t value) {
+    lsm_insert((LSMTree*)impl, key, value);
+}
+
+static bool lsm_e_search(void *impl, uint64_t key, uint64_t *value) {
+    return lsm_search((LSMTree*)impl, key, value);
+}
+
+static void lsm_e_delete(void *impl, uint64_t key) {
+    lsm_delete((LSMTree*)impl, key);
+}
+
+static void lsm_e_put(void *impl, uint64_t key, const void *value, uint32_t len) {
+    lsm_put((LSMTree*)impl, key, value, len);
+}
+
+static bool lsm_e_get(void *impl, uint64_t key, void *buf, uint32_t cap, uint32_t *len) {
+    return lsm_get((LSMTree*)impl, key, buf, cap, len);
+}
+
+static size_t lsm_e_scan(void *impl, uint64_t start, size_t limit, EngineScanFn cb, void *arg) {
+    return lsm_scan((LSMTree*)impl, start, limit, cb, arg);
+}
+
+static void lsm_e_insert_batch(void *impl, const uint64_t *keys, const uint64_t *values, size_t n) {
+    lsm_write_batch((LSMTree*)impl, keys, values, n);
+}
+
+static void lsm_e_sync(void *impl) {
+    lsm_compact_wait((LSMTree*)impl);
+}
+
+static void lsm_e_reset_stats(void *impl) {
+    lsm_reset_stats((LSMTree*)impl);
+}
+
+static void lsm_e_space(void *impl, uint64_t *live_bytes, uint64_t *disk_bytes) {
+    lsm_space_usage((LSMTree*)impl, live_bytes, disk_bytes);
+}
+
+static void lsm_e_print_stats(void *impl, const char *label) {
+    printf("%s Bloom: %lu probes skipped / %lu false positives\n", label, bloom_negatives, bloom_false_positives);
+    lsm_print_levels((LSMTree*)impl, label);
+}
+
+static void lsm_e_close(void *impl) {
+    lsm_free((LSMTree*)impl);
+}
+
+const StorageEngineOps lsm_engine_ops = {
+    "LSM-Tree", lsm_e_insert, lsm_e_search, lsm_e_delete, lsm_e_put, lsm_e_get, lsm_e_scan, lsm_e_insert_batch,
+    lsm_e_sync, lsm_e_reset_stats, lsm_e_space, lsm_e_print_stats, lsm_e_close,
+};
+
+const StorageEngineOps lsm_vlog_engine_ops = {
+    "LSM-Tree+VLog", lsm_e_insert, lsm_e_search, lsm_e_delete, lsm_e_put, lsm_e_get, lsm_e_scan, lsm_e_insert_batch,
+    lsm_e_sync, lsm_e_reset_stats, lsm_e_space, lsm_e_print_stats, lsm_e_close,
+};
+
+// --- Copy-on-write B-Tree ---
+
+static void cow_e_insert(void *impl, uint64_t key, uint64_t value) {
+    cow_insert((CowBTree*)impl, key, value);
+}
+
+static bool cow_e_search(void *impl, uint64_t key, uint64_t *value) {
+    return cow_search((CowBTree*)impl, key, value);
+}
+
+static void cow_e_delete(void *impl, uint64_t key) {
+    cow_delete((CowBTree*)impl, key);
+}
+
+static void cow_e_put(void *impl, uint64_t key, const void *value, uint32_t len) {
+    cow_put((CowBTree*)impl, key, value, len);
+}
+
+static bool cow_e_get(void *impl, uint64_t key, void *buf, uint32_t cap, uint32_t *len) {
+    uint64_t value;
+    if (!cow_search((CowBTree*)impl, key, &value)) return false;
+    memcpy(buf, &value, cap < sizeof(value) ? cap : sizeof(value));
+    *len = sizeof(value);
+    return true;
+}
+
+static size_t cow_e_scan(void *impl, uint64_t start, size_t limit, EngineScanFn cb, void *arg) {
+    return cow_scan((CowBTree*)impl, start, limit, cb, arg);
+}
+
+static void cow_e_insert_batch(void *impl, const uint64_t *keys, const uint64_t *values, size_t n) {
+    cow_insert_batch((CowBTree*)impl, keys, values, n);
+}
+
+static void cow_e_sync(void *impl) {
+    cow_commit((CowBTree*)impl);
+}
+
+static void cow_e_reset_stats(void *impl) {
+    cow_reset_stats((CowBTree*)impl);
+}
+
+static void cow_e_space(void *impl, uint64_t *live_bytes, uint64_t *disk_bytes) {
+    cow_space_usage((CowBTree*)impl, live_bytes, disk_bytes);
+}
+
+static void cow_e_print_stats(void *impl, const char *label) {
+    cow_print_stats((CowBTree*)impl, label);
+}
+
+static void cow_e_close(void *impl) {
+    cow_close((CowBTree*)impl);
+}
+
+const StorageEngineOps cow_engine_ops = {
+    "COW B-Tree", cow_e_insert, cow_e_search, cow_e_delete, cow_e_put, cow_e_get, cow_e_scan, cow_e_insert_batch,
+    cow_e_sync, cow_e_reset_stats, cow_e_space, cow_e_print_stats, cow_e_close,
+};
+
+StorageEngine engine_btree(BTree *tree) {
+    StorageEngine e = {&btree_engine_ops, tree};
+    return e;
+}
+
+StorageEngine engine_lsm(LSMTree *tree) {
+    StorageEngine e = {&lsm_engine_ops, tree};
+    return e;
+}
+
+StorageEngine engine_lsm_vlog(LSMTree *tree) {
+    StorageEngine e = {&lsm_vlog_engine_ops, tree};
+    return e;
+}
+
+StorageEngine engine_cow(CowBTree *tree) {
+    StorageEngine e = {&cow_engine_ops, tree};
+    return e;
+}
+
+bool engine_open(StorageEngine *e, const char *kind, const char *path, bool byte_values) {
+    if (strcmp(kind, "btree") == 0) {
+        BTreeOptions o = btree_default_options();
+        o.byte_values = byte_values;
+        BTree *tree = btree_create_opts(path, &o);
+        if (!tree) return false;
+        *e = engine_btree(tree);
+        return true;
+    }
+    bool vlog = strcmp(kind, "lsm-vlog") == 0;
+    if (vlog || strcmp(kind, "lsm") == 0) {
+        mkdir(path, 0755);
+        LSMOptions o = lsm_default_options();
+        o.value_log = vlog;
+        LSMTree *tree = lsm_create_opts(path, &o);
+        if (!tree) return false;
+        *e = vlog ? engine_lsm_vlog(tree) : engine_lsm(tree);
+        return true;
+    }
+    if (strcmp(kind, "cow-btree") == 0) {
+        if (byte_values) return false; // u64 values only: byte values would come back cut short
+        CowBTreeOptions o = cow_default_options();
+        CowBTree *tree = cow_open(path, &o);
+        if (!tree) return false;
+        *e = engine_cow(tree);
+        return true;
+    }
+    return false;
+}
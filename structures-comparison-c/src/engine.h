@@ -0,0 +1,88 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "btree.h"
+#include "lsm.h"
+#include "cowbtree.h"
+#include "stats.h"
+
+// One interface over the trees (the StorageEngine trait of the Rust
+// bench.rs), so a workload is written once and runs on any of them. Every
+// call is thread safe as far as the engine behind it is.
+//
+// Keys are u64. Values are either u64 (insert/search) or byte strings of up
+// to ENGINE_MAX_VALUE_BYTES (put/get); a u64 is stored as its 8 bytes, so
+// the two views mix. Scans hand back the bytes either way.
+
+#define ENGINE_MAX_VALUE_BYTES (32 * 1024)
+
+typedef bool (*EngineScanFn)(void *arg, uint64_t key, const void *value, uint32_t len);
+
+typedef struct {
+    const char *name;
+    void (*insert)(void *impl, uint64_t key, uint64_t value); // Insert or update
+    bool (*search)(void *impl, uint64_t key, uint64_t *value); // value may be NULL
+    void (*delete)(void *impl, uint64_t key);
+    void (*put)(void *impl, uint64_t key, const void *value, uint32_t len);
+    bool (*get)(void *impl, uint64_t key, void *buf, uint32_t cap, uint32_t *len); // First cap bytes, full length in len
+    size_t (*scan)(void *impl, uint64_t start, size_t limit, EngineScanFn cb, void *arg);
+    void (*insert_batch)(void *impl, const uint64_t *keys, const uint64_t *values, size_t n); // Sorted keys load fastest
+    void (*sync)(void *impl);        // Buffered writes reach the disk (B-Tree checkpoint, LSM flush + compaction, COW commit)
+    void (*reset_stats)(void *impl);
+    void (*space)(void *impl, uint64_t *live_bytes, uint64_t *disk_bytes); // Full scan: between phases only
+    void (*print_stats)(void *impl, const char *label);
+    void (*close)(void *impl);
+} StorageEngineOps;
+
+typedef struct {
+    const StorageEngineOps *ops;
+    void *impl; // BTree*, LSMTree* or CowBTree*
+} StorageEngine;
+
+extern const StorageEngineOps btree_engine_ops;
+extern const StorageEngineOps lsm_engine_ops;
+extern const StorageEngineOps lsm_vlog_engine_ops; // The same, named for a tree with a value log
+extern const StorageEngineOps cow_engine_ops;
+
+StorageEngine engine_btree(BTree *tree);
+StorageEngine engine_lsm(LSMTree *tree);
+StorageEngine engine_lsm_vlog(LSMTree *tree);
+StorageEngine engine_cow(CowBTree *tree);
+// "btree" or "cow-btree" (path is the page file), "lsm" or "lsm-vlog" (path
+// is the data directory, created if missing), default options. byte_values
+// gives a new B-Tree a value heap; the LSM stores byte values either way,
+// and lsm-vlog moves the large ones to its value log. The COW B-Tree only
+// holds u64 values, so it isn't opened with byte_values. false on an
+// unknown kind, that case, or if the engine can't be opened.
+bool engine_open(StorageEngine *e, const char *kind, const char *path, bool byte_values);
+
+static inline const char* engine_name(const StorageEngine *e) { return e->ops->name; }
+static inline void engine_insert(StorageEngine *e, uint64_t key, uint64_t value) { e->ops->insert(e->impl, key, value); }
+static inline bool engine_search(StorageEngine *e, uint64_t key, uint64_t *value) { return e->ops->search(e->impl, key, value); }
+static inline void engine_delete(StorageEngine *e, uint64_t key) { e->ops->delete(e->impl, key); }
+static inline void engine_put(StorageEngine *e, uint64_t key, const void *value, uint32_t len) {
+    e->ops->put(e->impl, key, value, len);
+}
+static inline bool engine_get(StorageEngine *e, uint64_t key, void *buf, uint32_t cap, uint32_t *len) {
+    return e->ops->get(e->impl, key, buf, cap, len);
+}
+static inline size_t engine_scan(StorageEngine *e, uint64_t start, size_t limit, EngineScanFn cb, void *arg) {
+    return e->ops->scan(e->impl, start, limit, cb, arg);
+}
+static inline void engine_insert_batch(StorageEngine *e, const uint64_t *keys, const uint64_t *values, size_t n) {
+    e->ops->insert_batch(e->impl, keys, values, n);
+}
+static inline void engine_sync(StorageEngine *e) { e->ops->sync(e->impl); }
+static inline void engine_reset_stats(StorageEngine *e) { e->ops->reset_stats(e->impl); }
+static inline void engine_print_stats(StorageEngine *e) { e->ops->print_stats(e->impl, e->ops->name); }
+static inline void engine_close(StorageEngine *e) { e->ops->close(e->impl); }
+// The shared counters (stats.h) plus this engine's live and on-disk bytes
+static inline void engine_stats(StorageEngine *e, EngineStats *out) {
+    stats_snapshot(out);
+    e->ops->space(e->impl, &out->live_bytes, &out->disk_bytes);
+}
+
+#endif
@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include "epoch.h"
+
+struct EBRRetired {
+    EBRRetired *next;
+    void *ptr;
+    void (*fn)(void*);
+    uint64_t epoch; // Global epoch when it was retired
+};
+
+static _Atomic unsigned next_stripe;
+static __thread int thread_stripe = -1;
+
+// Threads are spread round-robin so a stripe is mostly touched by one of them
+static int ebr_stripe(void) {
+    if (thread_stripe < 0) thread_stripe = (int)(atomic_fetch_add(&next_stripe, 1) % EBR_STRIPES);
+    return thread_stripe;
+}
+
+void ebr_init(EBR *d) {
+    atomic_init(&d->epoch, 2); // Leaves room for e-1 below the first epoch
+    for (int i = 0; i < EBR_STRIPES; i++) {
+        atomic_init(&d->stripes[i].active[0], 0);
+        atomic_init(&d->stripes[i].active[1], 0);
+    }
+    pthread_mutex_init(&d->lock, NULL);
+    d->retired = NULL;
+    d->pending = 0;
+    d->reclaimed = 0;
+}
+
+uint64_t ebr_enter(EBR *d) {
+    EBRStripe *s = &d->stripes[ebr_stripe()];
+    for (;;) {
+        uint64_t e = atomic_load(&d->epoch);
+        atomic_fetch_add(&s->active[e & 1], 1);
+        // Announced: unless the epoch moved before that, it can't pass e+1
+        // until we leave. If it did move, the counter may be one an
+        // advance is already checking, so back out and use the new epoch.
+        if (atomic_load(&d->epoch) == e) return (uint64_t)(s - d->stripes) * 2 + (e & 1);
+        atomic_fetch_sub(&s->active[e & 1], 1);
+    }
+}
+
+void ebr_exit(EBR *d, uint64_t ticket) {
+    atomic_fetch_sub(&d->stripes[ticket / 2].active[ticket & 1], 1);
+}
+
+// e -> e+1 once nobody is left in e-1, whose parity e+1 is about to reuse
+static bool ebr_try_advance(EBR *d) {
+    uint64_t e = atomic_load(&d->epoch);
+    int64_t readers = 0;
+    for (int i = 0; i < EBR_STRIPES; i++) readers += atomic_load(&d->stripes[i].active[(e + 1) & 1]);
+    if (readers != 0) return false;
+    return atomic_compare_exchange_strong(&d->epoch, &e, e + 1);
+}
+
+void ebr_collect(EBR *d) {
+    pthread_mutex_lock(&d->lock);
+    if (!d->retired) {
+        pthread_mutex_unlock(&d->lock);
+        return;
+    }
+    // Two steps free what was retired just now if no reader is in the way
+    for (int i = 0; i < 2 && ebr_try_advance(d); i++) {}
+    uint64_t safe = atomic_load(&d->epoch);
+    EBRRetired **p = &d->retired, *done = NULL;
+    while (*p) {
+        EBRRetired *r = *p;
+        if (r->epoch + 2 <= safe) {
+            // Everything after it was retired earlier still
+            done = r;
+            *p = NULL;
+            break;
+        }
+        p = &r->next;
+    }
+    uint64_t freed = 0;
+    for (EBRRetired *r = done; r; r = r->next) freed++;
+    d->pending -= freed;
+    d->reclaimed += freed;
+    pthread_mutex_unlock(&d->lock);
+
+    while (done) {
+        EBRRetired *next = done->next;
+        done->fn(done->ptr);
+        free(done);
+        done = next;
+    }
+}
+
+void ebr_retire(EBR *d, void *ptr, void (*fn)(void*)) {
+    EBRRetired *r = (EBRRetired*)malloc(sizeof(EBRRetired));
+    r->ptr = ptr;
+    r->fn = fn;
+    pthread_mutex_lock(&d->lock);
+    // Read after the caller unlinked ptr: any reader that saw it is in this
+    // epoch or the one before
+    r->epoch = atomic_load(&d->epoch);
+    r->next = d->retired;
+    d->retired = r;
+    d->pending++;
+    pthread_mutex_unlock(&d->lock);
+    ebr_collect(d);
+}
+
+void ebr_destroy(EBR *d) {
+    EBRRetired *r = d->retired;
+    while (r) {
+        EBRRetired *next = r->next;
+        r->fn(r->ptr);
+        free(r);
+        r = next;
+    }
+    d->retired = NULL;
+    pthread_mutex_destroy(&d->lock);
+}
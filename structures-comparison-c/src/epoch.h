@@ -0,0 +1,56 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Epoch-based reclamation: lets readers walk shared structures without
+// taking any lock, while whoever unlinks a piece of them hands it to
+// ebr_retire instead of freeing it. It is freed once every reader that
+// could still be looking at it has left.
+//
+// A reader brackets its traversal with ebr_enter / ebr_exit, announcing the
+// global epoch it saw in a counter (one of two, by epoch parity) of its
+// stripe. The epoch moves from e to e+1 only when nobody is left in e-1, so
+// whatever was retired in epoch r is unreachable once the epoch gets to r+2.
+// Entering costs two atomic ops on a counter mostly private to the thread,
+// and sections nest.
+//
+// Reader sections should be short: a thread parked inside one holds back
+// every retired object of its domain.
+
+#define EBR_STRIPES 64
+
+typedef struct {
+    _Atomic int64_t active[2]; // Readers inside, by parity of the epoch they entered
+    char pad[64 - 2 * sizeof(int64_t)];
+} EBRStripe;
+
+typedef struct EBRRetired EBRRetired;
+
+typedef struct {
+    _Atomic uint64_t epoch;
+    EBRStripe stripes[EBR_STRIPES];
+    pthread_mutex_t lock; // Guards the retired list
+    EBRRetired *retired;  // Oldest last
+    uint64_t pending;
+    uint64_t reclaimed;
+} EBR;
+
+void ebr_init(EBR *d);
+void ebr_destroy(EBR *d); // No reader may be left: frees everything still retired
+
+// Returns the ticket to hand back to ebr_exit
+uint64_t ebr_enter(EBR *d);
+void ebr_exit(EBR *d, uint64_t ticket);
+
+// ptr is already unreachable for new readers: fn(ptr) runs after the current
+// ones are gone, on whichever thread happens to collect it
+void ebr_retire(EBR *d, void *ptr, void (*fn)(void*));
+// Advances the epoch if it can and frees what is safe. Called on every
+// retire; worth calling at quiet points so nothing lingers.
+void ebr_collect(EBR *d);
+
+#endif
@@ -0,0 +1,69 @@
+#include <string.h>
+#include <time.h>
+#include "histogram.h"
+
+#define HIST_HALF (HIST_SUB_BUCKETS / 2)
+
+static inline int hist_index(uint64_t v) {
+    if (v < HIST_SUB_BUCKETS) return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - 5;             // Keeps the top 6 bits: sub in [32, 64)
+    uint64_t sub = v >> shift;
+    return HIST_SUB_BUCKETS + (shift - 1) * HIST_HALF + (int)(sub - HIST_HALF);
+}
+
+// Largest value that lands in bucket i
+static inline uint64_t hist_bucket_top(int i) {
+    if (i < HIST_SUB_BUCKETS) return (uint64_t)i;
+    int shift = (i - HIST_SUB_BUCKETS) / HIST_HALF + 1;
+    uint64_t sub = (uint64_t)((i - HIST_SUB_BUCKETS) % HIST_HALF + HIST_HALF);
+    return ((sub + 1) << shift) - 1;
+}
+
+void hist_reset(Histogram *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void hist_record(Histogram *h, uint64_t value) {
+    h->buckets[hist_index(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value < h->min) h->min = value;
+    if (value > h->max) h->max = value;
+}
+
+void hist_merge(Histogram *dst, const Histogram *src) {
+    if (!src->count) return;
+    for (int i = 0; i < HIST_BUCKETS; i++) dst->buckets[i] += src->buckets[i];
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+uint64_t hist_percentile(const Histogram *h, double q) {
+    if (!h->count) return 0;
+    if (q >= 1.0) return h->max;
+    uint64_t rank = (uint64_t)(q * h->count + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t top = hist_bucket_top(i);
+            return top < h->max ? top : h->max;
+        }
+    }
+    return h->max;
+}
+
+double hist_mean(const Histogram *h) {
+    return h->count ? (double)h->sum / h->count : 0.0;
+}
+
+uint64_t hist_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
@@ -0,0 +1,35 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// HDR-style latency histogram: values below 64 get a bucket each, above
+// that every power of two is split into 32 linear buckets, so any value is
+// kept to within ~3% over the whole u64 range, in a fixed 15KB array.
+// Recording is one increment and no lock: give each thread its own
+// histogram and hist_merge them at the end.
+
+#define HIST_SUB_BUCKETS 64
+#define HIST_BUCKETS (HIST_SUB_BUCKETS + 58 * (HIST_SUB_BUCKETS / 2))
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+} Histogram;
+
+void hist_reset(Histogram *h);
+void hist_record(Histogram *h, uint64_t value);
+void hist_merge(Histogram *dst, const Histogram *src);
+// Smallest recorded value (up to bucket precision) that q of the samples
+// are at or below, q in [0, 1]. 0 for an empty histogram.
+uint64_t hist_percentile(const Histogram *h, double q);
+double hist_mean(const Histogram *h);
+
+// Nanoseconds on the monotonic clock, for timing what goes into a histogram
+uint64_t hist_now_ns(void);
+
+#endif
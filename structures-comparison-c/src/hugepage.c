@@ -0,0 +1,56 @@
+#define _GNU_SOURCE // Needed for MAP_ANONYMOUS, MAP_HUGETLB and MADV_HUGEPAGE
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "hugepage.h"
+
+bool hp_alloc(HugeMem *m, size_t size, bool huge_pages) {
+    m->ptr = NULL;
+    m->kind = HP_NONE;
+    if (huge_pages) size = (size + HP_HUGE_PAGE_SIZE - 1) & ~(size_t)(HP_HUGE_PAGE_SIZE - 1);
+    m->size = size;
+
+#ifdef MAP_HUGETLB
+    if (huge_pages) {
+        void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            m->ptr = p;
+            m->kind = HP_HUGETLB;
+            return true;
+        }
+    }
+#endif
+
+    // THP only backs 2MB-aligned ranges: map a huge page extra and trim
+    // both ends so the region starts on a boundary
+    size_t slack = huge_pages ? HP_HUGE_PAGE_SIZE : 0;
+    char *p = (char*)mmap(NULL, size + slack, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap failed");
+        return false;
+    }
+    if (slack) {
+        size_t head = (HP_HUGE_PAGE_SIZE - ((uintptr_t)p & (HP_HUGE_PAGE_SIZE - 1))) & (HP_HUGE_PAGE_SIZE - 1);
+        if (head) munmap(p, head);
+        if (slack - head) munmap(p + head + size, slack - head);
+        p += head;
+    }
+    m->ptr = p;
+#ifdef MADV_HUGEPAGE
+    if (huge_pages && madvise(p, size, MADV_HUGEPAGE) == 0) m->kind = HP_TRANSPARENT;
+#endif
+    return true;
+}
+
+void hp_free(HugeMem *m) {
+    if (m->ptr) munmap(m->ptr, m->size);
+    m->ptr = NULL;
+}
+
+const char* hp_kind_name(HugePageKind kind) {
+    switch (kind) {
+        case HP_HUGETLB: return "hugetlb";
+        case HP_TRANSPARENT: return "transparent";
+        default: return "off";
+    }
+}
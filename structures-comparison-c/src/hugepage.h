@@ -0,0 +1,34 @@
+#ifndef HUGEPAGE_H
+#define HUGEPAGE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Page-aligned anonymous memory for the big, long-lived allocations (buffer
+// pool frames, memtable arena blocks), optionally backed by 2MB huge pages so
+// a walk over them costs far fewer TLB misses.
+//
+// With huge pages asked for, explicit hugetlbfs pages (MAP_HUGETLB) are tried
+// first. Those need pages reserved in /proc/sys/vm/nr_hugepages, so usually
+// the fallback is a plain mapping with MADV_HUGEPAGE, which transparent huge
+// pages honour when enabled. Either way the size is rounded up to 2MB.
+
+#define HP_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+typedef enum {
+    HP_NONE,        // Regular 4KB pages
+    HP_TRANSPARENT, // madvise(MADV_HUGEPAGE), up to the kernel
+    HP_HUGETLB      // Reserved huge pages
+} HugePageKind;
+
+typedef struct {
+    void *ptr;
+    size_t size; // What was mapped, for hp_free
+    HugePageKind kind;
+} HugeMem;
+
+bool hp_alloc(HugeMem *m, size_t size, bool huge_pages); // Zeroed, 4KB aligned at least
+void hp_free(HugeMem *m);
+const char* hp_kind_name(HugePageKind kind);
+
+#endif
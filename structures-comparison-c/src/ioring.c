@@ -0,0 +1,274 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "ioring.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define IOR_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#define IOR_MAX_DEPTH 256
+
+typedef struct {
+    uint64_t ticket; // 0: free
+    size_t len;
+} IOSlot;
+
+struct IORing {
+    unsigned depth;
+    bool uring;
+    bool sqpoll;
+    bool failed;
+    uint64_t next_ticket;
+    unsigned inflight;  // Queued or submitted, not yet reaped
+    unsigned unsubmitted;
+    IOSlot *slots;      // Ticket t lives in slot t % depth
+
+#ifdef IOR_URING
+    int fd;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_flags, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+#endif
+};
+
+IORingOptions ior_default_options(void) {
+    IORingOptions o;
+    o.enabled = true;
+    o.depth = 4;
+    o.sqpoll = false;
+    return o;
+}
+
+#ifdef IOR_URING
+static int ior_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int ior_enter(IORing *r, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, r->fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+// Maps the rings of a fresh io_uring fd. Returns false (nothing left mapped) on failure.
+static bool ior_map(IORing *r, struct io_uring_params *p) {
+    r->sq_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    r->cq_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    bool single = p->features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        if (r->cq_size > r->sq_size) r->sq_size = r->cq_size;
+        r->cq_size = r->sq_size;
+    }
+    r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) return false;
+    r->cq_ptr = single ? r->sq_ptr
+                       : mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    if (r->cq_ptr == MAP_FAILED) {
+        munmap(r->sq_ptr, r->sq_size);
+        return false;
+    }
+    r->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = (struct io_uring_sqe*)mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                         r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        if (!single) munmap(r->cq_ptr, r->cq_size);
+        munmap(r->sq_ptr, r->sq_size);
+        return false;
+    }
+
+    char *sq = (char*)r->sq_ptr, *cq = (char*)r->cq_ptr;
+    r->sq_head = (unsigned*)(sq + p->sq_off.head);
+    r->sq_tail = (unsigned*)(sq + p->sq_off.tail);
+    r->sq_mask = (unsigned*)(sq + p->sq_off.ring_mask);
+    r->sq_flags = (unsigned*)(sq + p->sq_off.flags);
+    r->sq_array = (unsigned*)(sq + p->sq_off.array);
+    r->cq_head = (unsigned*)(cq + p->cq_off.head);
+    r->cq_tail = (unsigned*)(cq + p->cq_off.tail);
+    r->cq_mask = (unsigned*)(cq + p->cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(cq + p->cq_off.cqes);
+    return true;
+}
+
+static bool ior_uring_init(IORing *r, bool sqpoll) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    if (sqpoll) {
+        p.flags = IORING_SETUP_SQPOLL;
+        p.sq_thread_idle = 100; // ms before the poller sleeps
+    }
+    r->fd = ior_setup(r->depth, &p);
+    if (r->fd < 0) return false;
+    if (!ior_map(r, &p)) {
+        close(r->fd);
+        return false;
+    }
+    r->sqpoll = sqpoll;
+    return true;
+}
+
+static void ior_complete(IORing *r, uint64_t ticket, int res) {
+    IOSlot *s = &r->slots[ticket % r->depth];
+    if (res < 0 || (size_t)res != s->len) {
+        if (!r->failed) {
+            fprintf(stderr, "io_uring op failed: %s\n", res < 0 ? strerror(-res) : "short transfer");
+        }
+        r->failed = true;
+    }
+    s->ticket = 0;
+    r->inflight--;
+}
+
+// Hands queued ops to the kernel and, with wait, blocks for at least one completion
+static void ior_submit_and_reap(IORing *r, bool wait) {
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    unsigned to_submit = r->unsubmitted;
+    if (r->sqpoll) {
+        // The poller picks the ops up by itself; it only needs a kick once it went idle
+        to_submit = 0;
+        if (__atomic_load_n(r->sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_NEED_WAKEUP) flags |= IORING_ENTER_SQ_WAKEUP;
+    }
+    if (to_submit || flags) {
+        int ret = ior_enter(r, to_submit, wait ? 1 : 0, flags);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            perror("io_uring_enter failed");
+            r->failed = true;
+        }
+        if (ret > 0 && !r->sqpoll) r->unsubmitted -= (unsigned)ret;
+    }
+    if (r->sqpoll) r->unsubmitted = 0;
+
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        ior_complete(r, cqe->user_data, cqe->res);
+        head++;
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+#endif
+
+IORing* ior_create(const IORingOptions *opts) {
+    IORing *r = (IORing*)calloc(1, sizeof(IORing));
+    r->depth = opts->depth < 1 ? 1 : opts->depth > IOR_MAX_DEPTH ? IOR_MAX_DEPTH : opts->depth;
+    r->slots = (IOSlot*)calloc(r->depth, sizeof(IOSlot));
+    r->next_ticket = 1;
+#ifdef IOR_URING
+    if (opts->enabled) {
+        // SQPOLL may need privileges the process lacks: try without it before giving up
+        r->uring = ior_uring_init(r, opts->sqpoll) || (opts->sqpoll && ior_uring_init(r, false));
+    }
+#endif
+    return r;
+}
+
+// Synchronous fallback: the whole transfer or a failure
+static void ior_sync(IORing *r, int fd, char *buf, size_t len, uint64_t off, bool is_write) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = is_write ? pwrite(fd, buf + done, len - done, off + done) : pread(fd, buf + done, len - done, off + done);
+        if (n <= 0) {
+            perror(is_write ? "Sync write failed" : "Sync read failed");
+            r->failed = true;
+            return;
+        }
+        done += n;
+    }
+}
+
+static uint64_t ior_queue(IORing *r, int fd, void *buf, size_t len, uint64_t off, bool is_write) {
+    uint64_t ticket = r->next_ticket++;
+    if (!r->uring) {
+        ior_sync(r, fd, (char*)buf, len, off, is_write);
+        return ticket;
+    }
+#ifdef IOR_URING
+    // Ticket t takes slot t % depth; out-of-order completions can leave it
+    // busy even with fewer than depth ops in flight
+    IOSlot *s = &r->slots[ticket % r->depth];
+    while (s->ticket != 0) ior_submit_and_reap(r, true);
+    s->ticket = ticket;
+    s->len = len;
+
+    unsigned tail = *r->sq_tail;
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = is_write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)len;
+    sqe->off = off;
+    sqe->user_data = ticket;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->inflight++;
+    r->unsubmitted++;
+    // Batch: the kernel only hears about queued ops when the ring is full
+    // (or someone waits), unless it is polling for them anyway
+    if (r->sqpoll || r->unsubmitted == r->depth) ior_submit_and_reap(r, false);
+#endif
+    return ticket;
+}
+
+uint64_t ior_write(IORing *r, int fd, const void *buf, size_t len, uint64_t off) {
+    return ior_queue(r, fd, (void*)buf, len, off, true);
+}
+
+uint64_t ior_read(IORing *r, int fd, void *buf, size_t len, uint64_t off) {
+    return ior_queue(r, fd, buf, len, off, false);
+}
+
+bool ior_wait(IORing *r, uint64_t ticket) {
+#ifdef IOR_URING
+    if (r->uring) {
+        while (r->slots[ticket % r->depth].ticket == ticket) ior_submit_and_reap(r, true);
+    }
+#endif
+    (void)ticket;
+    return !r->failed;
+}
+
+bool ior_wait_all(IORing *r) {
+#ifdef IOR_URING
+    while (r->uring && r->inflight > 0) ior_submit_and_reap(r, true);
+#endif
+    bool ok = !r->failed;
+    r->failed = false;
+    return ok;
+}
+
+unsigned ior_depth(const IORing *r) {
+    return r->depth;
+}
+
+const char* ior_backend(const IORing *r) {
+    if (!r->uring) return "sync";
+    return r->sqpoll ? "io_uring+sqpoll" : "io_uring";
+}
+
+void ior_destroy(IORing *r) {
+    if (!r) return;
+    ior_wait_all(r);
+#ifdef IOR_URING
+    if (r->uring) {
+        munmap(r->sqes, r->sqes_size);
+        if (r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_size);
+        munmap(r->sq_ptr, r->sq_size);
+        close(r->fd);
+    }
+#endif
+    free(r->slots);
+    free(r);
+}
@@ -0,0 +1,43 @@
+#ifndef IORING_H
+#define IORING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Asynchronous I/O for the O_DIRECT paths of both engines (SSTable writes,
+// buffer pool checkpoints), on io_uring without liburing.
+//
+// A ring keeps up to `depth` reads and writes in flight. Queued ops are
+// handed to the kernel in one io_uring_enter when the caller waits for
+// something or the ring is full, or picked up by the kernel's polling
+// thread with SQPOLL. Each op gets a ticket to wait on; its buffer must stay
+// untouched until then. When io_uring is off or unavailable (old kernel,
+// seccomp, kernel.io_uring_disabled) every op runs synchronously with
+// pread/pwrite as it is queued, behind the same calls.
+//
+// A ring is not thread safe: it belongs to one writer or one checkpoint.
+
+typedef struct {
+    bool enabled;   // false: plain synchronous pread/pwrite
+    unsigned depth; // Ops in flight at most (ring size)
+    bool sqpoll;    // Kernel thread polls the submission queue: no syscall per submit
+} IORingOptions;
+
+typedef struct IORing IORing;
+
+IORingOptions ior_default_options(void);
+IORing* ior_create(const IORingOptions *opts); // Falls back to synchronous I/O, never NULL
+// Queue one op, waiting for a free slot first if depth ops are in flight.
+// Returns its ticket.
+uint64_t ior_write(IORing *r, int fd, const void *buf, size_t len, uint64_t off);
+uint64_t ior_read(IORing *r, int fd, void *buf, size_t len, uint64_t off);
+// Block until that op has completed. Both return false if any op failed or
+// came back short since the last ior_wait_all.
+bool ior_wait(IORing *r, uint64_t ticket);
+bool ior_wait_all(IORing *r);
+unsigned ior_depth(const IORing *r);
+const char* ior_backend(const IORing *r); // "io_uring", "io_uring+sqpoll" or "sync"
+void ior_destroy(IORing *r); // Waits for everything in flight
+
+#endif
@@ -0,0 +1,132 @@
+#include <string.h>
+#include <pthread.h>
+#include "keysearch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KS_X86 1
+#include <immintrin.h>
+#endif
+
+int ks_lower_bound_linear(const uint64_t *keys, int n, uint64_t key) {
+    int i = 0;
+    while (i < n && key > keys[i]) i++;
+    return i;
+}
+
+// Halves the range every step with a conditional move instead of a branch,
+// so the loop runs exactly log2(n) times whatever the keys are.
+int ks_lower_bound_branchless(const uint64_t *keys, int n, uint64_t key) {
+    if (n == 0) return 0;
+    const uint64_t *base = keys;
+    int len = n;
+    while (len > 1) {
+        int half = len / 2;
+        base = (base[half] < key) ? base + half : base;
+        len -= half;
+    }
+    return (int)(base - keys) + (base[0] < key);
+}
+
+#ifdef KS_X86
+// Branchless halving (as above) until at most `window` candidates are left,
+// then the window is compared in one go. Returns where the window starts;
+// the keys before it are all < key and the ones after it all >= key.
+static inline const uint64_t* ks_narrow(const uint64_t *keys, int n, uint64_t key, int window) {
+    const uint64_t *base = keys;
+    int len = n;
+    while (len > window) {
+        int half = len / 2;
+        base = (base[half] < key) ? base + half : base;
+        len -= half;
+    }
+    // Slide the window back to stay inside the node; the keys it picks up
+    // in front of base are < key, so they count as they should
+    const uint64_t *last = keys + n - window;
+    return base < last ? base : last;
+}
+
+__attribute__((target("sse4.2,popcnt")))
+static int ks_lower_bound_sse42(const uint64_t *keys, int n, uint64_t key) {
+    if (n < 8) return ks_lower_bound_branchless(keys, n, key);
+    const uint64_t *w = ks_narrow(keys, n, key, 8);
+    const __m128i sign = _mm_set1_epi64x((long long)0x8000000000000000ULL);
+    const __m128i probe = _mm_xor_si128(_mm_set1_epi64x((long long)key), sign);
+    int m = 0;
+    for (int v = 0; v < 4; v++) {
+        __m128i k = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(w + 2 * v)), sign);
+        m |= _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(probe, k))) << (2 * v);
+    }
+    return (int)(w - keys) + __builtin_popcount(m);
+}
+
+__attribute__((target("avx2,popcnt")))
+static int ks_lower_bound_avx2(const uint64_t *keys, int n, uint64_t key) {
+    if (n < 16) return ks_lower_bound_branchless(keys, n, key);
+    const uint64_t *w = ks_narrow(keys, n, key, 16);
+    const __m256i sign = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+    const __m256i probe = _mm256_xor_si256(_mm256_set1_epi64x((long long)key), sign);
+    int m = 0;
+    for (int v = 0; v < 4; v++) {
+        __m256i k = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(w + 4 * v)), sign);
+        m |= _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(probe, k))) << (4 * v);
+    }
+    return (int)(w - keys) + __builtin_popcount(m);
+}
+#endif
+
+// Best first: ks_init takes the first supported one
+static KSVariant variants[] = {
+#ifdef KS_X86
+    {"avx2", ks_lower_bound_avx2, false},
+    {"sse4.2", ks_lower_bound_sse42, false},
+#endif
+    {"branchless", ks_lower_bound_branchless, true},
+    {"linear", ks_lower_bound_linear, true},
+};
+#define KS_NUM_VARIANTS ((int)(sizeof(variants) / sizeof(variants[0])))
+
+KSLowerBoundFn ks_lower_bound = ks_lower_bound_branchless;
+static const char *selected_name = "branchless";
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static void ks_detect(void) {
+#ifdef KS_X86
+    __builtin_cpu_init();
+    bool popcnt = __builtin_cpu_supports("popcnt");
+    variants[0].supported = popcnt && __builtin_cpu_supports("avx2");
+    variants[1].supported = popcnt && __builtin_cpu_supports("sse4.2");
+#endif
+    for (int i = 0; i < KS_NUM_VARIANTS; i++) {
+        if (variants[i].supported) {
+            ks_lower_bound = variants[i].fn;
+            selected_name = variants[i].name;
+            break;
+        }
+    }
+}
+
+void ks_init(void) {
+    pthread_once(&init_once, ks_detect);
+}
+
+const char* ks_selected_name(void) {
+    return selected_name;
+}
+
+bool ks_select(const char *name) {
+    ks_init();
+    for (int i = 0; i < KS_NUM_VARIANTS; i++) {
+        if (strcmp(variants[i].name, name) == 0 && variants[i].supported) {
+            ks_lower_bound = variants[i].fn;
+            selected_name = variants[i].name;
+            return true;
+        }
+    }
+    return false;
+}
+
+const KSVariant* ks_variants(int *count) {
+    ks_init();
+    *count = KS_NUM_VARIANTS;
+    return variants;
+}
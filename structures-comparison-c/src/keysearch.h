@@ -0,0 +1,38 @@
+#ifndef KEYSEARCH_H
+#define KEYSEARCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Slot search inside a sorted uint64_t key array (a B-Tree node).
+//
+// Every variant returns the first slot whose key is >= key, i.e. how many
+// keys are smaller. The branchless one is a binary search that uses a
+// conditional move instead of a branch. The SIMD ones do the same halving
+// down to a window of 16 (AVX2) or 8 (SSE4.2) keys, then compare the whole
+// window against the probe and count the hits with movemask + popcount, so
+// no data-dependent branch is left. x86 has no unsigned 64-bit compare, so
+// both sides get their sign bit flipped first.
+//
+// ks_init picks the best one the CPU supports (AVX2, SSE4.2, else the
+// branchless binary search). Until it runs, ks_lower_bound is the fallback.
+
+typedef int (*KSLowerBoundFn)(const uint64_t *keys, int n, uint64_t key);
+
+typedef struct {
+    const char *name;
+    KSLowerBoundFn fn;
+    bool supported; // Filled in by ks_init
+} KSVariant;
+
+extern KSLowerBoundFn ks_lower_bound;
+
+void ks_init(void); // Idempotent
+const char* ks_selected_name(void);
+bool ks_select(const char *name); // Forces a variant; false if unknown or unsupported
+const KSVariant* ks_variants(int *count); // Every variant compiled in, for benchmarks
+
+int ks_lower_bound_linear(const uint64_t *keys, int n, uint64_t key);
+int ks_lower_bound_branchless(const uint64_t *keys, int n, uint64_t key);
+
+#endif
@@ -0,0 +1,136 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "keysearch.h"
+
+// Microbenchmark for the B-Tree slot search variants (keysearch.c).
+//
+// For each node fill level it builds sorted random key arrays and times
+// lookups with every variant the CPU supports. "hot" probes a single node
+// (stays in L1, like the upper levels of the tree); "cold" spreads the probes
+// over enough nodes to miss the caches, like a leaf just read from the pool.
+// Half the probes hit an existing key, half fall between keys. Every variant
+// is checked against the linear scan before it is timed.
+
+#define MAX_FILL 169 // 2 * BTREE_MAX_T - 1 with 4KB pages
+#define COLD_NODES 4096
+#define NUM_PROBES (1 << 16)
+#define LOOKUPS 4000000
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_rand(void) {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    uint32_t node;
+    uint64_t key;
+} Probe;
+
+// Full 64-bit range, so the unsigned compare (sign bit flip) is exercised
+static void fill_nodes(uint64_t *keys, int nodes, int fill) {
+    for (int n = 0; n < nodes; n++) {
+        uint64_t *k = keys + (size_t)n * MAX_FILL;
+        for (int i = 0; i < fill; i++) k[i] = next_rand();
+        qsort(k, fill, sizeof(uint64_t), cmp_u64);
+    }
+}
+
+static void make_probes(Probe *probes, const uint64_t *keys, int nodes, int fill) {
+    for (int i = 0; i < NUM_PROBES; i++) {
+        probes[i].node = (uint32_t)(next_rand() % nodes);
+        const uint64_t *k = keys + (size_t)probes[i].node * MAX_FILL;
+        probes[i].key = (i & 1) ? next_rand() : k[next_rand() % fill];
+    }
+}
+
+static bool verify(KSLowerBoundFn fn, const uint64_t *keys, const Probe *probes, int fill) {
+    for (int i = 0; i < NUM_PROBES; i++) {
+        const uint64_t *k = keys + (size_t)probes[i].node * MAX_FILL;
+        if (fn(k, fill, probes[i].key) != ks_lower_bound_linear(k, fill, probes[i].key)) return false;
+    }
+    // Edges: below the first key, above the last, and the extremes
+    const uint64_t edges[] = {0, 1, keys[0], keys[fill - 1], keys[fill - 1] + 1, UINT64_MAX - 1, UINT64_MAX};
+    for (size_t e = 0; e < sizeof(edges) / sizeof(edges[0]); e++) {
+        if (fn(keys, fill, edges[e]) != ks_lower_bound_linear(keys, fill, edges[e])) return false;
+    }
+    return true;
+}
+
+static double time_lookups(KSLowerBoundFn fn, const uint64_t *keys, const Probe *probes, int fill, uint64_t *sink) {
+    uint64_t acc = 0;
+    double start = now_sec();
+    for (int i = 0; i < LOOKUPS; i++) {
+        const Probe *p = &probes[i & (NUM_PROBES - 1)];
+        acc += fn(keys + (size_t)p->node * MAX_FILL, fill, p->key);
+    }
+    double elapsed = now_sec() - start;
+    *sink += acc;
+    return elapsed * 1e9 / LOOKUPS;
+}
+
+int main(void) {
+    ks_init();
+    int num_variants;
+    const KSVariant *variants = ks_variants(&num_variants);
+
+    printf("Key search microbenchmark (%d lookups per cell, ns/lookup)\n", LOOKUPS);
+    printf("Selected at startup: %s\n\n", ks_selected_name());
+
+    uint64_t *keys = (uint64_t*)malloc(sizeof(uint64_t) * MAX_FILL * COLD_NODES);
+    Probe *probes = (Probe*)malloc(sizeof(Probe) * NUM_PROBES);
+    const int fills[] = {4, 8, 16, 32, 64, 127, MAX_FILL};
+    const int sets[] = {1, COLD_NODES};
+    uint64_t sink = 0;
+    int failures = 0;
+
+    for (int s = 0; s < 2; s++) {
+        printf("%-5s %5s", s == 0 ? "hot" : "cold", "fill");
+        for (int v = 0; v < num_variants; v++) printf(" %11s", variants[v].name);
+        printf("\n");
+
+        for (size_t f = 0; f < sizeof(fills) / sizeof(fills[0]); f++) {
+            int fill = fills[f];
+            fill_nodes(keys, sets[s], fill);
+            make_probes(probes, keys, sets[s], fill);
+            printf("%-5s %5d", "", fill);
+            for (int v = 0; v < num_variants; v++) {
+                if (!variants[v].supported) {
+                    printf(" %11s", "n/a");
+                    continue;
+                }
+                if (!verify(variants[v].fn, keys, probes, fill)) {
+                    printf(" %11s", "WRONG");
+                    failures++;
+                    continue;
+                }
+                printf(" %11.2f", time_lookups(variants[v].fn, keys, probes, fill, &sink));
+            }
+            printf("\n");
+        }
+        printf("\n");
+    }
+
+    printf("(checksum %lu)\n", sink);
+    free(keys);
+    free(probes);
+    return failures ? 1 : 0;
+}
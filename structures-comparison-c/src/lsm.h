@@ -3,17 +3,102 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include <stdatomic.h>
+#include "ioring.h"
+#include "sstable.h"
 
 extern _Atomic uint64_t physical_bytes_written;
 extern _Atomic uint64_t logical_bytes_written;
+extern _Atomic uint64_t bloom_negatives;       // SSTable probes skipped by a Bloom filter
+extern _Atomic uint64_t bloom_false_positives; // Probes that passed the filter but missed
 
 typedef struct LSMTree LSMTree;
 
-LSMTree* lsm_create(size_t threshold, const char* data_dir);
-void lsm_insert(LSMTree* tree, uint64_t key, uint64_t value);
-uint64_t* lsm_search(LSMTree* tree, uint64_t key); // Ret ptr to value or NULL
-void lsm_delete(LSMTree* tree, uint64_t key);
+typedef enum {
+    LSM_COMPACTION_NONE,    // Never merge: every flush adds a file forever
+    LSM_COMPACTION_LEVELED, // One sorted run per level, L(n+1) is ratio x L(n)
+    LSM_COMPACTION_TIERED   // Up to ratio overlapping runs per level, merged together into the next
+} LSMCompactionPolicy;
+
+typedef enum {
+    LSM_WAL_OFF,            // No log: the memtable is lost on a crash
+    LSM_WAL_SYNC_PER_WRITE, // Each write does its own log write + fdatasync
+    LSM_WAL_SYNC_GROUP,     // Concurrent writers share one log write + fdatasync
+    LSM_WAL_SYNC_PERIODIC   // Log synced every wal_sync_interval_ms; a crash loses at most that window
+} LSMWalMode;
+
+typedef struct {
+    size_t memtable_threshold; // Entries per memtable before flushing to an SSTable
+    int max_immutable_memtables; // Full memtables waiting for the flush thread before writers block
+    bool memtable_huge_pages;  // Memtable arena blocks on 2MB huge pages (falls back to 4KB pages)
+    int bloom_bits_per_key;    // Per-SSTable Bloom filter size, 0 disables filters
+    SSTEncoding sst_encoding;  // Data block format of new tables (existing ones keep theirs)
+    size_t block_cache_bytes;  // SSTable block cache budget (reads are O_DIRECT), 0 disables it
+    int block_cache_shards;
+    LSMWalMode wal_mode;
+    int wal_sync_interval_ms;  // LSM_WAL_SYNC_PERIODIC only
+
+    LSMCompactionPolicy compaction_policy;
+    int level_size_ratio;       // Leveled: size ratio between levels. Tiered: runs per level
+    int l0_compaction_trigger;  // L0 files that trigger a compaction out of L0
+    int l0_slowdown_trigger;    // L0 files at which each write is delayed
+    int l0_stop_trigger;        // L0 files at which writes block until compaction catches up
+    uint64_t level_base_bytes;  // Leveled: target size of L1
+    uint64_t target_file_bytes; // Leveled: compaction output is split at this size
+
+    IORingOptions io;           // SSTable writes (flush, compaction, ingest): io_uring depth, SQPOLL, or sync
+
+    // Key-value separation (vlog.c): byte values of at least vlog_min_value
+    // bytes go to a value log and the tree only holds a pointer to them
+    bool value_log;
+    uint32_t vlog_min_value;
+    uint64_t vlog_segment_bytes; // Segment file size, at most 16MB
+    double vlog_gc_ratio;        // Dead fraction at which a sealed segment is collected
+} LSMOptions;
+
+#define LSM_MAX_VALUE_BYTES (32 * 1024) // One WAL payload
+
+LSMOptions lsm_default_options(void);
+// Opens the tree in data_dir: the SSTables listed in its MANIFEST (opened
+// lazily, so the time taken doesn't grow with the data), then any WAL left
+// there is replayed into the memtable. Tables the manifest doesn't list are
+// leftovers of an interrupted flush or compaction and are deleted. An empty
+// or new directory (created if missing) is an empty tree. NULL, with every
+// file left alone, if the manifest is damaged, a table it lists won't open,
+// or there are tables but no manifest. Reopen with the compaction policy the
+// tree was written with.
+LSMTree* lsm_open(const char* data_dir, const LSMOptions* opts);
+LSMTree* lsm_create_opts(const char* data_dir, const LSMOptions* opts); // Same as lsm_open
+LSMTree* lsm_create(size_t threshold, const char* data_dir); // Default options otherwise
+// Writes return 0, or -1 if the write-ahead log couldn't make the record
+// durable; it is then not applied.
+int lsm_insert(LSMTree* tree, uint64_t key, uint64_t value);
+// Copies the value out (value may be NULL): nothing is left pointing into a
+// memtable or table that may go away. First 8 bytes of a byte value.
+bool lsm_search(LSMTree* tree, uint64_t key, uint64_t* value);
+// Byte string values, up to LSM_MAX_VALUE_BYTES (longer ones are cut). A
+// u64 value reads back as its 8 bytes.
+int lsm_put(LSMTree* tree, uint64_t key, const void* value, uint32_t len);
+// Copies the first cap bytes of the value into buf and sets *len to its full length
+bool lsm_get(LSMTree* tree, uint64_t key, void* buf, uint32_t cap, uint32_t* len);
+int lsm_delete(LSMTree* tree, uint64_t key);
+// Writes n entries. Strictly increasing keys are ingested as new SSTables,
+// bypassing the WAL and memtable; anything else falls back to lsm_insert.
+void lsm_write_batch(LSMTree* tree, const uint64_t* keys, const uint64_t* values, size_t n);
+
+// Range scan: calls cb for each live key >= start in order, newest value
+// only, until limit keys (0 = no limit) or cb returns false. Sees a snapshot
+// taken when the scan starts; cb runs with no lock held. Returns keys visited.
+// value is only valid during the call; u64 values come as their 8 bytes.
+typedef bool (*LSMScanFn)(void *arg, uint64_t key, const void *value, uint32_t len);
+size_t lsm_scan(LSMTree* tree, uint64_t start, size_t limit, LSMScanFn cb, void *arg);
+void lsm_compact_wait(LSMTree* tree); // Blocks until no flush or compaction is pending
+void lsm_print_levels(LSMTree* tree, const char* label);
+void lsm_reset_stats(LSMTree* tree); // Bloom and block cache counters
+// Space amplification inputs: 8 bytes + the value per live key (a full
+// scan, so not cheap) and the size of every file in the data directory
+void lsm_space_usage(LSMTree* tree, uint64_t* live_bytes, uint64_t* disk_bytes);
 void lsm_free(LSMTree* tree);
 
 #endif
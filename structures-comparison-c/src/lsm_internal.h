@@ -0,0 +1,167 @@
+#ifndef LSM_INTERNAL_H
+#define LSM_INTERNAL_H
+
+// Private LSMTree layout, shared by lsm.c and compaction.c only.
+
+#include <stdbool.h>
+#include <pthread.h>
+#include "lsm.h"
+#include "sstable.h"
+#include "skiplist.h"
+#include "wal.h"
+#include "stats.h"
+#include "vlog.h"
+#include "manifest.h"
+#include "epoch.h"
+
+#define LSM_MAX_LEVELS 7
+
+// Record kinds in the memtable, WAL and SSTables (opaque to all three)
+enum {
+    LSM_KIND_VALUE = 0,     // u64 value
+    LSM_KIND_TOMBSTONE = 1,
+    LSM_KIND_BYTES = 2,     // Value bytes next to the record (arena, WAL payload, SST value pages)
+    LSM_KIND_VPTR = 3       // Value log pointer
+};
+
+// One live SSTable in the level structure
+typedef struct {
+    uint64_t file_no; // Sequence number: within a level, a larger number holds newer data
+    uint64_t min_key;
+    uint64_t max_key;
+    char *name;
+    SSTable *sst;     // Reference owned by the level structure
+} LSMTableMeta;
+
+typedef struct {
+    LSMTableMeta **files; // L0 and tiered levels: oldest first. Leveled L1+: sorted by min key
+    int count;
+    int cap;
+    uint64_t bytes;
+    uint64_t compact_cursor; // Leveled: round-robin position for picking the next input file
+} LSMLevel;
+
+// In-memory manifest: an immutable snapshot of the live SSTables in lookup
+// order (L0 newest to oldest by sequence number, then each deeper level),
+// rebuilt whenever the level structure changes. Point lookups walk the
+// current one inside an epoch (the tree's reference to a replaced version is
+// only dropped through ebr_retire); scans pin it with a reference. Neither
+// takes a lock or touches the directory.
+typedef struct {
+    uint64_t file_no;
+    uint64_t min_key;
+    uint64_t max_key;
+    SSTable *sst; // Own reference, so a retired table outlives pinned snapshots
+} LSMManifestEntry;
+
+typedef struct {
+    _Atomic int refs;
+    int num_files;
+    int level_start[LSM_MAX_LEVELS + 1]; // Level i is files[level_start[i] .. level_start[i+1])
+    bool sorted[LSM_MAX_LEVELS];         // Non-overlapping level, ordered by key range
+    LSMManifestEntry files[];
+} LSMVersion;
+
+// Memtables a reader searches, newest first: the active one, then the
+// immutable ones. Rebuilt with t->lock held exclusively on every rotation and
+// flush, and published with one pointer store, so readers load it without
+// any lock; the old set and a flushed memtable are retired through the
+// tree's epochs.
+typedef struct {
+    int num;
+    SkipList *lists[];
+} LSMMemSet;
+
+struct LSMTree {
+    // MemTables: the active concurrent skiplist plus the full ones waiting
+    // for the flush thread. Writers share `lock` (read side) and insert
+    // concurrently; it is only taken exclusively to swap the active memtable
+    // out or drop a flushed immutable one. Readers don't take it: they go
+    // through `memtables`.
+    SkipList *mem;
+    SkipList **imm;            // Immutable memtables, oldest first
+    uint64_t *imm_wal_no;      // Log file of each immutable memtable, deleted once it is flushed
+    WAL *wal;                  // Log of the active memtable, NULL with LSM_WAL_OFF
+    uint64_t wal_no;
+    WALStats wal_stats;
+    int num_imm;               // Changed with both lock (write) and flush_lock held
+    _Atomic uint64_t last_seq; // Sequence number of the newest write
+    _Atomic(LSMMemSet*) memtables;
+    EBR ebr;                   // Reclaims memtables, memtable sets and versions readers may still be in
+    LSMOptions opts;
+    char *data_dir;
+    BlockCache *cache;         // SSTable data blocks, shared by every table; NULL without one
+    pthread_rwlock_t lock;
+
+    // Background flush of immutable memtables, guarded by flush_lock
+    pthread_mutex_t flush_lock;
+    pthread_cond_t flush_cv; // Wakes the flush thread
+    pthread_cond_t imm_cv;   // Wakes writers waiting for a free immutable slot
+    pthread_t flush_thread;
+    bool flush_shutdown;
+    uint64_t flushes;
+    uint64_t flush_stalls;
+
+    // Level structure and compaction state, guarded by levels_lock
+    LSMLevel levels[LSM_MAX_LEVELS];
+    _Atomic(LSMVersion*) current; // Published manifest snapshot
+    Manifest *manifest;  // On disk: level changes are logged to it when published
+    uint64_t next_file_no;
+    pthread_mutex_t levels_lock;
+    pthread_cond_t compaction_cv; // Wakes the compaction thread
+    pthread_cond_t stall_cv;      // Wakes stalled writers and lsm_compact_wait
+    pthread_t compaction_thread;
+    bool compaction_started;
+    bool compaction_running;
+    bool shutting_down;
+    uint64_t compactions;
+    uint64_t compaction_bytes;
+    uint64_t write_slowdowns;
+    uint64_t write_stops;
+    uint64_t ingests;      // lsm_write_batch calls that went straight to SSTables
+    uint64_t ingest_files;
+    uint64_t ingest_bytes;
+
+    // Value log, NULL unless opts.value_log. Writers hold gc_lock shared
+    // from the log append to the memtable insert; GC takes it exclusively to
+    // repoint keys, so no newer write can slip in between its check and write.
+    VLog *vlog;
+    pthread_rwlock_t gc_lock;
+    bool gc_running;  // The compaction thread is collecting a segment (levels_lock)
+    bool gc_disabled; // Set after a failed GC, so the thread doesn't spin on it
+};
+
+// lsm.c
+LSMTableMeta* lsm_table_create(LSMTree *t, SSTWriter **w); // levels_lock NOT held
+LSMTableMeta* lsm_table_finish(LSMTree *t, LSMTableMeta *m, SSTWriter *w);
+void lsm_table_retire(LSMTree *t, LSMTableMeta *m); // Unlinks the file and drops the level's reference
+void lsm_level_add(LSMTree *t, int level, LSMTableMeta *m); // levels_lock held
+void lsm_level_remove(LSMTree *t, int level, LSMTableMeta *m); // levels_lock held
+// levels_lock held, after a batch of level changes: commits them to the
+// on-disk manifest (durable on return), then publishes the new snapshot
+void lsm_manifest_publish(LSMTree *t);
+LSMVersion* lsm_version_acquire(LSMTree *t); // Pinned with a reference, no lock taken
+void lsm_version_release(LSMVersion *v);
+// Newest version of k: returns its kind (-1 if absent) and value. For
+// LSM_KIND_BYTES the first cap bytes are copied into buf (if not NULL) and
+// the full length goes to *len.
+int lsm_lookup(LSMTree *t, uint64_t k, uint64_t *value, void *buf, uint32_t cap, uint32_t *len);
+// Logs and inserts one record: no throttling, gc_lock as the caller holds
+// it. -1 (and nothing inserted) if the log write or sync failed.
+int lsm_write_record(LSMTree *t, uint64_t k, int kind, uint64_t v, const void *bytes, uint32_t len);
+int lsm_wal_sync(LSMTree *t); // Everything written so far is durable (-1 if the log failed)
+
+// compaction.c
+void lsm_compaction_start(LSMTree *t);
+void lsm_compaction_stop(LSMTree *t);
+int lsm_compaction_pick_level(LSMTree *t); // levels_lock held, -1 when nothing to do
+uint64_t lsm_vlog_gc_pick(LSMTree *t); // Segment to collect, 0 if none
+
+// lsm_scan.c
+// lsm_scan, choosing whether SSTable blocks it reads go into the block cache
+// (full-tree scans for statistics shouldn't wipe it). Without fill_cache
+// values kept apart from the records (table value pages, value log) aren't
+// read either: cb gets a NULL value with its length.
+size_t lsm_scan_fill(LSMTree *t, uint64_t start, size_t limit, LSMScanFn cb, void *arg, bool fill_cache);
+
+#endif
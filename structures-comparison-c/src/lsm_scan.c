@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <string.h>
+#include "lsm_internal.h"
+
+// Range scans: a k-way merge over every source that can hold a key, with a
+// binary heap ordered by (key, source). Sources are numbered newest first
+// (active memtable, immutable ones newest to oldest, then the manifest in
+// lookup order), so the first time the heap yields a key it comes from the
+// newest version; the rest of that key is skipped, and a tombstone hides it.
+//
+// The scan works on a snapshot: the memtables are pinned with a reference,
+// the SSTables with the manifest version, and memtable entries written after
+// the scan started (higher seq) are ignored. No lock is held while the heap
+// runs, so the callback may do anything, including writing to the tree.
+// One exception to the snapshot: a value log segment collected mid-scan is
+// gone, and the key's current value is read instead.
+
+typedef enum {
+    SCAN_MEM,   // A skiplist memtable
+    SCAN_TABLE, // One SSTable of an overlapping level (L0, tiered)
+    SCAN_LEVEL  // A sorted level: its files one after the other
+} ScanSourceKind;
+
+typedef struct {
+    ScanSourceKind kind;
+    bool valid;
+    uint64_t key;
+    uint64_t value;
+    int rec_kind;          // LSM_KIND_*
+    const void *mem_bytes; // LSM_KIND_BYTES in a memtable
+    uint32_t mem_len;
+
+    SkipList *list; // SCAN_MEM
+    SLIterator sl;
+    SSTIterator sst; // SCAN_TABLE, SCAN_LEVEL
+    LSMVersion *v;   // SCAN_LEVEL: files [next_file, end_file) are still to come
+    int next_file;
+    int end_file;
+} ScanSource;
+
+typedef struct {
+    ScanSource *srcs;
+    int num_srcs;
+    int *heap;
+    int heap_len;
+    uint64_t snapshot_seq;
+    bool fill_cache;
+    char *buf; // Value bytes read from a table or the value log
+} ScanMerger;
+
+// Skips memtable versions newer than the snapshot
+static void scan_mem_settle(ScanSource *s, uint64_t snapshot_seq) {
+    while (sl_iter_valid(&s->sl) && s->sl.node->seq > snapshot_seq) sl_iter_next(&s->sl);
+    s->valid = sl_iter_valid(&s->sl);
+    if (s->valid) {
+        s->key = s->sl.node->key;
+        s->value = s->sl.node->value;
+        s->rec_kind = s->sl.node->kind;
+        s->mem_bytes = sl_node_bytes(s->sl.node);
+        s->mem_len = s->sl.node->value_len;
+    }
+}
+
+static void scan_sst_settle(ScanSource *s) {
+    // A sorted level moves on to its next file when one runs out
+    while (!s->sst.valid && s->kind == SCAN_LEVEL && s->next_file < s->end_file) {
+        bool fill_cache = s->sst.fill_cache;
+        sst_iter_destroy(&s->sst);
+        sst_iter_init(&s->sst, s->v->files[s->next_file++].sst, fill_cache);
+    }
+    s->valid = s->sst.valid;
+    if (s->valid) {
+        s->key = s->sst.key;
+        s->value = s->sst.value;
+        s->rec_kind = s->sst.kind;
+    }
+}
+
+static void scan_advance(ScanMerger *m, ScanSource *s) {
+    if (s->kind == SCAN_MEM) {
+        sl_iter_next(&s->sl);
+        scan_mem_settle(s, m->snapshot_seq);
+    } else {
+        sst_iter_next(&s->sst);
+        scan_sst_settle(s);
+    }
+}
+
+static bool scan_less(ScanMerger *m, int a, int b) {
+    if (m->srcs[a].key != m->srcs[b].key) return m->srcs[a].key < m->srcs[b].key;
+    return a < b; // Newer source wins the tie
+}
+
+static void scan_sift_down(ScanMerger *m, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, s = i;
+        if (l < m->heap_len && scan_less(m, m->heap[l], m->heap[s])) s = l;
+        if (r < m->heap_len && scan_less(m, m->heap[r], m->heap[s])) s = r;
+        if (s == i) return;
+        int tmp = m->heap[i];
+        m->heap[i] = m->heap[s];
+        m->heap[s] = tmp;
+        i = s;
+    }
+}
+
+// The value bytes of the source's current record. False if they can't be
+// read or the key turns out deleted (value log fallback).
+static bool scan_value(LSMTree *t, ScanMerger *m, ScanSource *s, const void **value, uint32_t *len) {
+    int n;
+    switch (s->rec_kind) {
+    case LSM_KIND_VALUE:
+        *value = &s->value;
+        *len = sizeof(s->value);
+        return true;
+    case LSM_KIND_BYTES:
+        if (s->kind == SCAN_MEM) {
+            *value = s->mem_bytes;
+            *len = s->mem_len;
+            return true;
+        }
+        if (!m->fill_cache) {
+            *value = NULL;
+            *len = sst_value_len(s->value);
+            return true;
+        }
+        n = sst_read_value(s->sst.t, s->value, m->buf, SST_MAX_VALUE_BYTES, true);
+        break;
+    case LSM_KIND_VPTR:
+        if (!m->fill_cache) {
+            *value = NULL;
+            *len = vlog_ptr_len(s->value);
+            return true;
+        }
+        n = t->vlog ? vlog_read(t->vlog, s->value, m->buf, LSM_MAX_VALUE_BYTES) : -1;
+        if (n < 0 && t->vlog) {
+            uint32_t cur;
+            n = lsm_get(t, s->key, m->buf, LSM_MAX_VALUE_BYTES, &cur) ? (int)cur : -1;
+        }
+        break;
+    default:
+        return false;
+    }
+    if (n < 0) return false;
+    *value = m->buf;
+    *len = (uint32_t)n;
+    return true;
+}
+
+size_t lsm_scan(LSMTree* t, uint64_t start, size_t limit, LSMScanFn cb, void *arg) {
+    return lsm_scan_fill(t, start, limit, cb, arg, true);
+}
+
+size_t lsm_scan_fill(LSMTree *t, uint64_t start, size_t limit, LSMScanFn cb, void *arg, bool fill_cache) {
+    // Pin the memtables, then the manifest, with references taken inside an
+    // epoch (no lock): an immutable memtable leaves the set only after its
+    // SSTable is published, so nothing falls in between. The snapshot comes
+    // first, so every write it covers is in a memtable of the set or below.
+    uint64_t snapshot_seq = atomic_load(&t->last_seq);
+    uint64_t e = ebr_enter(&t->ebr);
+    LSMMemSet *set = atomic_load(&t->memtables);
+    int num_mem = set->num;
+    SkipList **mems = (SkipList**)malloc(sizeof(SkipList*) * num_mem);
+    for (int i = 0; i < num_mem; i++) {
+        mems[i] = set->lists[i];
+        sl_ref(mems[i]);
+    }
+    ebr_exit(&t->ebr, e);
+    LSMVersion *v = lsm_version_acquire(t);
+
+    ScanMerger m;
+    m.snapshot_seq = snapshot_seq;
+    m.fill_cache = fill_cache;
+    m.buf = (char*)malloc(SST_MAX_VALUE_BYTES);
+    m.srcs = (ScanSource*)calloc(num_mem + v->num_files, sizeof(ScanSource));
+    m.heap = (int*)malloc(sizeof(int) * (num_mem + v->num_files));
+    m.num_srcs = 0;
+
+    for (int i = 0; i < num_mem; i++) {
+        ScanSource *s = &m.srcs[m.num_srcs++];
+        s->kind = SCAN_MEM;
+        s->list = mems[i];
+        sl_iter_seek(&s->sl, mems[i], start);
+        scan_mem_settle(s, snapshot_seq);
+    }
+    for (int level = 0; level < LSM_MAX_LEVELS; level++) {
+        int lo = v->level_start[level], hi = v->level_start[level + 1];
+        if (v->sorted[level]) {
+            // Non-overlapping files: one source, starting at the file holding start
+            while (lo < hi && v->files[lo].max_key < start) lo++;
+            if (lo == hi) continue;
+            ScanSource *s = &m.srcs[m.num_srcs++];
+            s->kind = SCAN_LEVEL;
+            s->v = v;
+            s->next_file = lo + 1;
+            s->end_file = hi;
+            sst_iter_seek(&s->sst, v->files[lo].sst, start, fill_cache);
+            scan_sst_settle(s);
+        } else {
+            for (int i = lo; i < hi; i++) {
+                if (v->files[i].max_key < start) continue;
+                ScanSource *s = &m.srcs[m.num_srcs++];
+                s->kind = SCAN_TABLE;
+                sst_iter_seek(&s->sst, v->files[i].sst, start, fill_cache);
+                scan_sst_settle(s);
+            }
+        }
+    }
+
+    m.heap_len = 0;
+    for (int i = 0; i < m.num_srcs; i++) {
+        if (m.srcs[i].valid) m.heap[m.heap_len++] = i;
+    }
+    for (int i = m.heap_len / 2 - 1; i >= 0; i--) scan_sift_down(&m, i);
+
+    size_t count = 0;
+    bool have_last = false;
+    uint64_t last_key = 0;
+    while (m.heap_len > 0 && !(limit && count == limit)) {
+        ScanSource *s = &m.srcs[m.heap[0]];
+        if (!have_last || s->key != last_key) {
+            // Newest version of this key: older ones are skipped below
+            have_last = true;
+            last_key = s->key;
+            const void *value;
+            uint32_t len;
+            if (s->rec_kind != LSM_KIND_TOMBSTONE && scan_value(t, &m, s, &value, &len)) {
+                count++;
+                if (!cb(arg, s->key, value, len)) break;
+            }
+        }
+        scan_advance(&m, s);
+        if (!s->valid) m.heap[0] = m.heap[--m.heap_len];
+        scan_sift_down(&m, 0);
+    }
+
+    for (int i = 0; i < m.num_srcs; i++) {
+        if (m.srcs[i].kind != SCAN_MEM) sst_iter_destroy(&m.srcs[i].sst);
+    }
+    for (int i = 0; i < num_mem; i++) sl_free(mems[i]);
+    lsm_version_release(v);
+    free(mems);
+    free(m.srcs);
+    free(m.heap);
+    free(m.buf);
+    return count;
+}
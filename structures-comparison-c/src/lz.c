@@ -0,0 +1,113 @@
+#include <string.h>
+#include "lz.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 65535
+
+static uint32_t lz_load32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t lz_hash(uint32_t seq) {
+    return (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// A length past the 15 the token holds, as bytes of 255 and a remainder
+static size_t lz_put_length(uint8_t *dst, size_t op, size_t cap, size_t len) {
+    for (; len >= 255; len -= 255) {
+        if (op == cap) return 0;
+        dst[op++] = 255;
+    }
+    if (op == cap) return 0;
+    dst[op++] = (uint8_t)len;
+    return op;
+}
+
+// One sequence: literals [lit, lit + lit_len), then a match unless match_len is 0
+static size_t lz_emit(uint8_t *dst, size_t op, size_t cap, const uint8_t *lit, size_t lit_len, size_t offset,
+                      size_t match_len) {
+    if (op == cap) return 0;
+    size_t token_at = op++;
+    size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+    dst[token_at] = (uint8_t)((lit_len < 15 ? lit_len : 15) << 4 | (ml < 15 ? ml : 15));
+    if (lit_len >= 15 && !(op = lz_put_length(dst, op, cap, lit_len - 15))) return 0;
+    if (lit_len > cap - op) return 0;
+    memcpy(dst + op, lit, lit_len);
+    op += lit_len;
+    if (!match_len) return op;
+
+    if (cap - op < 2) return 0;
+    dst[op++] = (uint8_t)offset;
+    dst[op++] = (uint8_t)(offset >> 8);
+    if (ml >= 15 && !(op = lz_put_length(dst, op, cap, ml - 15))) return 0;
+    return op;
+}
+
+size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    uint32_t table[1 << LZ_HASH_BITS]; // Position + 1 of the last 4 bytes with each hash, 0 if none
+    memset(table, 0, sizeof(table));
+
+    size_t i = 0, anchor = 0, op = 0;
+    while (i + LZ_MIN_MATCH <= n) {
+        uint32_t seq = lz_load32(src + i);
+        uint32_t h = lz_hash(seq);
+        size_t cand = table[h];
+        table[h] = (uint32_t)(i + 1);
+        if (!cand || i - (cand - 1) > LZ_MAX_OFFSET || lz_load32(src + cand - 1) != seq) {
+            i++;
+            continue;
+        }
+
+        size_t m = cand - 1, len = LZ_MIN_MATCH;
+        while (i + len < n && src[m + len] == src[i + len]) len++;
+        op = lz_emit(dst, op, cap, src + anchor, i - anchor, i - m, len);
+        if (!op) return 0;
+        i += len;
+        anchor = i;
+    }
+    return lz_emit(dst, op, cap, src + anchor, n - anchor, 0, 0);
+}
+
+static int lz_get_length(const uint8_t *src, size_t n, size_t *ip, size_t *len) {
+    uint8_t b;
+    do {
+        if (*ip >= n) return 0;
+        b = src[(*ip)++];
+        *len += b;
+    } while (b == 255);
+    return 1;
+}
+
+size_t lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    size_t ip = 0, op = 0;
+    while (ip < n) {
+        uint8_t token = src[ip++];
+        size_t lit = token >> 4;
+        if (lit == 15 && !lz_get_length(src, n, &ip, &lit)) return 0;
+        if (lit > n - ip || lit > cap - op) return 0;
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == n) break; // The last sequence has no match
+
+        if (n - ip < 2) return 0;
+        size_t offset = src[ip] | (size_t)src[ip + 1] << 8;
+        ip += 2;
+        size_t len = token & 15;
+        if (len == 15 && !lz_get_length(src, n, &ip, &len)) return 0;
+        len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || len > cap - op) return 0;
+
+        const uint8_t *from = dst + op - offset;
+        if (offset >= len) {
+            memcpy(dst + op, from, len);
+        } else {
+            for (size_t k = 0; k < len; k++) dst[op + k] = from[k]; // Overlapping: repeats the last offset bytes
+        }
+        op += len;
+    }
+    return op;
+}
@@ -0,0 +1,23 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Small LZ77 block compressor in the LZ4 mould, no dependencies: a greedy
+// matcher with one hash table probe per position, and a decoder that is a
+// literal copy plus a match copy per token. Offsets are 16 bits, so it is
+// meant for blocks up to 64KB (SSTable blocks are much smaller).
+//
+// Stream: sequences of
+//   token (literal length << 4 | match length - 4), extra literal length
+//   bytes, literals, 2-byte offset, extra match length bytes
+// where a 15 in either half of the token continues in bytes of 255 until
+// one is smaller. The last sequence stops after its literals.
+
+// Returns the compressed size, or 0 if it doesn't fit in cap bytes
+size_t lz_compress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap);
+// Returns the decompressed size, or 0 if src is corrupt or needs more than cap bytes
+size_t lz_decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t cap);
+
+#endif
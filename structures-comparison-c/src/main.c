@@ -5,8 +5,14 @@
 #include <string.h>
 #include <pthread.h>
 #include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "btree.h"
 #include "lsm.h"
+#include "sstable.h"
+#include "engine.h"
+#include "ycsb.h"
+#include "shard.h"
 
 #define NUM_THREADS 8
 
@@ -20,11 +26,21 @@ double get_time_sec() {
 // Global Atomic Counters for WAF
 _Atomic uint64_t physical_bytes_written = 0;
 _Atomic uint64_t logical_bytes_written = 0;
+_Atomic uint64_t bloom_negatives = 0;
+_Atomic uint64_t bloom_false_positives = 0;
 // We need atomics because multiple threads will update this
 // Using C11 atomics or GCC builtins?
 // GCC builtins (__atomic_add_fetch) are standard enough for this environment.
 // Or just <stdatomic.h> if C11. Docker Alpine uses musl/gcc so C11 is fine.
 
+// Keys 0..n-1, used as their own values: the sorted run the pre-loads
+// hand to the batch APIs
+static uint64_t* sequential_keys(int n) {
+    uint64_t *keys = (uint64_t*)malloc(sizeof(uint64_t) * n);
+    for (int i = 0; i < n; i++) keys[i] = i;
+    return keys;
+}
+
 typedef struct {
     int start;
     int end;
@@ -35,164 +51,624 @@ typedef struct {
 void* btree_insert_worker(void *arg) {
     ThreadArg *t = (ThreadArg*)arg;
     for (int i = t->start; i < t->end; i++) {
-        // Use a simple mutex in BTree if shared? 
-        // Oh right, B-Trees are not thread safe by default.
-        // We need a lock!
-        // For benchmark "Queue Depth", we want multiple writers hitting DISK.
-        // But B-Tree structure update in memory must be atomic.
-        // Adding a global lock reduces this to single threaded CPU + parallel I/O blocks?
-        // Yes, if I/O blocks (pwrite), other threads can run.
-        // So we need a mutex in BTree Insert.
-        
-        // Wait, `pwrite` blocks the calling thread. If we hold the lock while calling `simulate_disk_write`, we serialize everything.
-        // Crucial optimization: `simulate_disk_write` must be called OUTSIDE the critical section of B-Tree structure update?
-        // The prompt asked to "not change code logic" too much but we are effectively refactoring for NVMe.
-        // To see QD benefit, we must allow concurrent `pwrite`.
-        
-        // Let's modify btree_insert to take a lock only for structure update, 
-        // but `simulate_disk_write` represents writing the node. 
-        // If we write NEW data, we typically write WAL or Node *before* linking?
-        
-        // For this benchmark: We will wrap `btree_insert` with a lock, 
-        // BUT `simulate_disk_write` inside it will hold the lock... 
-        // That kills parallelism.
-        
-        // Correct approach for benchmark: Call `simulate_disk_write` OUTSIDE.
-        // But `btree_insert` calls it.
-        // We will define a `btree_insert_concurrent` or just rely on OS scheduling if we ignore logic correctness? No.
-        
-        // Let's assume we implement a coarse lock around `btree_insert_non_full`, 
-        // but `simulate_disk_write` acts as a WAL append which can be parallel? 
-        // Actually, let's just use a mutex for now. 
-        // If `pwrite` sleeps, the mutex is held, blocking others. 
-        // This confirms B-Tree (Pointer based) is hard to parallelize for I/O efficiency compared to LSM (Batch).
-        
-        // Wait, if we use O_DIRECT `pwrite`, it blocks thread.
-        // If Mutex is held, no other thread enters.
-        // So QD will stay 1 unless we unlock during I/O.
-        
-        // Modifying B-Tree to unlock during I/O is complex.
-        // Maybe we just run multiple *independent* B-Trees? 
-        // No, that changes the test.
-        
-        // Let's accept the limitation: B-Tree with Coarse Lock = Low QD (Bad on NVMe). 
-        // This effectively PROVES LSM superiority (Batching allow high QD).
-        // I will add the lock.
-        
+        // btree_insert latches node by node (crabbing) and the buffer pool
+        // does its I/O without holding a latch, so threads only wait for each
+        // other on the pages they actually share.
         btree_insert_mt(t->btree, i, i);
     }
     return NULL;
 }
 
-void* workload_a_worker(void *arg) {
-    ThreadArg *t = (ThreadArg*)arg;
-    unsigned int seed = t->start; // Simple seed
-    
-    for (int i = t->start; i < t->end; i++) {
-        int op = rand_r(&seed) % 2; // 0=Read, 1=Write
-        uint64_t key = rand_r(&seed) % 5000; // Random key in range
-        
-        if (t->btree) {
-            if (op == 0) {
-                 btree_search(t->btree, key);
-            } else {
-                 btree_insert_mt(t->btree, key, i);
-            }
-        } else if (t->lsm) {
-            if (op == 0) {
-                lsm_search(t->lsm, key);
-            } else {
-                // LSM needs mutex for memtable? 
-                // Our current LSM is NOT thread safe.
-                // We need to add mutex to LSM insert too!
-                // For now, let's assume single thread LSM or add simple lock.
-                // Let's add a lock to LSM struct similar to BTree.
-                // Or just run single threaded LSM for Workload A? 
-                // Benchmarking requires fairness.
-                // We should add lock to LSM.
-                lsm_insert(t->lsm, key, i); 
+// Every YCSB phase also goes to this file as one JSON array, for
+// benchmarks/analysis/analyze_results.py
+#define RESULTS_JSON "benchmark_results.json"
+static FILE *results_json = NULL;
+static int results_json_count = 0;
+
+// Pre-loads and runs one YCSB workload on an engine (NUM_THREADS threads)
+static void run_ycsb_phase(const YCSBWorkload *w, StorageEngine *e) {
+    YCSBResult r;
+    memset(&r, 0, sizeof(r));
+    printf("Pre-loading %s...\n", engine_name(e));
+    ycsb_load(w, e, &r);
+    printf("Running %s %s...\n", engine_name(e), w->name);
+    ycsb_run(w, e, NUM_THREADS, &r);
+    ycsb_print_result(w, engine_name(e), &r);
+    engine_print_stats(e);
+    if (results_json) {
+        fputs(results_json_count++ ? ",\n" : "[\n", results_json);
+        ycsb_write_json(results_json, w, engine_name(e), &r);
+    }
+}
+
+// The YCSB core workloads (the same definitions ycsb_bench reads from
+// benchmarks/configs), scaled down to n records and n operations
+void run_ycsb_workloads(int n) {
+    static const char *titles[] = {
+        "50/50 Read/Update", "95/5 Read/Update", "Read Only", "95/5 Read Latest/Insert",
+        "95% Scan 1-100 / 5% Insert", "50/50 Read/Read-Modify-Write",
+    };
+    results_json = fopen(RESULTS_JSON, "w");
+    if (!results_json) perror(RESULTS_JSON);
+    for (char letter = 'a'; letter <= 'f'; letter++) {
+        YCSBWorkload w;
+        ycsb_workload_core(&w, letter);
+        w.record_count = n;
+        w.operation_count = n;
+        printf("\n=== Workload %c (%s, N=%d) ===\n", letter - 'a' + 'A', titles[letter - 'a'], n);
+
+        system("rm -f btree_data.db");
+        StorageEngine e = engine_btree(btree_create(64));
+        run_ycsb_phase(&w, &e);
+        engine_close(&e);
+
+        system("rm -rf lsm_data_ycsb");
+        system("mkdir -p lsm_data_ycsb");
+        e = engine_lsm(lsm_create(1000, "lsm_data_ycsb")); // Threshold 1000 like before
+        run_ycsb_phase(&w, &e);
+        engine_close(&e);
+
+        system("rm -f cow_data.db");
+        engine_open(&e, "cow-btree", "cow_data.db", false);
+        run_ycsb_phase(&w, &e);
+        engine_close(&e);
+    }
+    system("rm -rf lsm_data_ycsb cow_data.db");
+    if (results_json) {
+        fputs(results_json_count ? "\n]\n" : "[]\n", results_json);
+        fclose(results_json);
+        results_json = NULL;
+        printf("\nYCSB results written to %s\n", RESULTS_JSON);
+    }
+}
+
+// Workload A on the B-Tree with growing buffer pools: WAF and throughput as a
+// function of how much of the tree fits in memory.
+void run_btree_cache_sweep(int n) {
+    static const size_t frames[] = {BP_MIN_FRAMES, 48, 64, 96, 128, 256};
+    printf("\n=== B-Tree Cache Size Sweep (Workload A, N=%d) ===\n", n);
+
+    YCSBWorkload w;
+    ycsb_workload_core(&w, 'a');
+    w.record_count = n;
+    w.operation_count = n;
+    for (size_t f = 0; f < sizeof(frames) / sizeof(frames[0]); f++) {
+        system("rm -f btree_data.db");
+        BTreeOptions o = btree_default_options();
+        o.cache_frames = frames[f];
+        BTree* btree = btree_create_opts("btree_data.db", &o);
+        StorageEngine e = engine_btree(btree);
+        YCSBResult r;
+        memset(&r, 0, sizeof(r));
+        ycsb_load(&w, &e, &r);
+        ycsb_run(&w, &e, NUM_THREADS, &r);
+
+        uint64_t accesses = btree->pool->hits + btree->pool->misses;
+        printf("B-Tree cache=%4zu frames (%5zu KB, tree %lu pages): %10.2f ops/sec, WAF %7.2f, hit rate %5.1f%%\n",
+               frames[f], frames[f] * BP_PAGE_SIZE / 1024, btree->pool->num_pages, n / r.run_sec,
+               (double)r.physical_bytes / (double)r.logical_bytes,
+               accesses ? 100.0 * btree->pool->hits / accesses : 0.0);
+        engine_close(&e);
+    }
+}
+
+// Workload C (read only, zipfian) on the LSM-Tree with block caches from none
+// to twice the data: SSTables are read with O_DIRECT, so the cache is the
+// only thing between a lookup and the device.
+void run_lsm_cache_sweep(int n) {
+    static const double ratios[] = {0, 0.0625, 0.125, 0.25, 0.5, 1, 2};
+    size_t data_bytes = (n + SST_RECORDS_PER_BLOCK - 1) / SST_RECORDS_PER_BLOCK * SST_BLOCK_SIZE;
+    printf("\n=== LSM-Tree Block Cache Sweep (Workload C, N=%d, %zu KB of data blocks) ===\n", n, data_bytes / 1024);
+
+    YCSBWorkload w;
+    ycsb_workload_core(&w, 'c');
+    w.record_count = n;
+    w.operation_count = n;
+    for (size_t i = 0; i < sizeof(ratios) / sizeof(ratios[0]); i++) {
+        system("rm -rf lsm_data_cache");
+        system("mkdir -p lsm_data_cache");
+        LSMOptions o = lsm_default_options();
+        o.block_cache_bytes = (size_t)(ratios[i] * data_bytes);
+        StorageEngine e = engine_lsm(lsm_create_opts("lsm_data_cache", &o));
+        YCSBResult r;
+        memset(&r, 0, sizeof(r));
+        ycsb_load(&w, &e, &r);
+        ycsb_run(&w, &e, NUM_THREADS, &r);
+
+        const uint64_t *c = r.run_stats.counters;
+        uint64_t accesses = c[STAT_CACHE_HITS] + c[STAT_CACHE_MISSES];
+        printf("LSM-Tree cache=%6zu KB (%5.3fx data): %10.2f ops/sec, hit rate %5.1f%%, %6.0f bytes read per op\n",
+               o.block_cache_bytes / 1024, ratios[i], n / r.run_sec, accesses ? 100.0 * c[STAT_CACHE_HITS] / accesses : 0.0,
+               (double)c[STAT_BYTES_READ] / n);
+        engine_close(&e);
+    }
+    system("rm -rf lsm_data_cache");
+}
+
+// Workload A on the LSM-Tree with each SSTable block encoding, for hashed
+// keys (YCSB's default: random 64-bit keys and values, little to squeeze)
+// and ordered ones (small key deltas and values)
+void run_encoding_compare(int n) {
+    printf("\n=== SSTable Encoding Comparison (Workload A, N=%d) ===\n", n);
+    YCSBWorkload w;
+    ycsb_workload_core(&w, 'a');
+    w.record_count = n;
+    w.operation_count = n;
+    for (int ordered = 0; ordered <= 1; ordered++) {
+        w.ordered_inserts = ordered;
+        for (int enc = SST_ENCODING_PLAIN; enc <= SST_ENCODING_DELTA_LZ; enc++) {
+            system("rm -rf lsm_data_enc");
+            system("mkdir -p lsm_data_enc");
+            LSMOptions o = lsm_default_options();
+            o.sst_encoding = (SSTEncoding)enc;
+            StorageEngine e = engine_lsm(lsm_create_opts("lsm_data_enc", &o));
+            YCSBResult r;
+            memset(&r, 0, sizeof(r));
+            ycsb_load(&w, &e, &r);
+            ycsb_run(&w, &e, NUM_THREADS, &r);
+
+            const EngineStats *l = &r.load_stats, *s = &r.run_stats;
+            printf("LSM-Tree %-8s %s keys: load WAF %.2f, run WAF %6.2f, SA %.2f (%.1f MB on disk / %.1f MB live), %10.2f ops/sec\n",
+                   sst_encoding_name((SSTEncoding)enc), ordered ? "ordered" : "hashed ",
+                   (double)l->physical_bytes / l->logical_bytes, (double)s->physical_bytes / s->logical_bytes,
+                   (double)s->disk_bytes / s->live_bytes, s->disk_bytes / 1e6, s->live_bytes / 1e6, n / r.run_sec);
+            engine_close(&e);
+        }
+    }
+    system("rm -rf lsm_data_enc");
+}
+
+// Workload A with 1 to core-count threads (at least NUM_THREADS, since the
+// threads also overlap their I/O), each point on one engine and on as many
+// hash shards as threads. Both use the sharded front-end so the options
+// match: one shard is the plain engine with the full cache.
+void run_shard_scaling(int n) {
+    static const char *kinds[] = {"btree", "lsm"};
+    static const StorageEngineOps *kind_ops[] = {&btree_engine_ops, &lsm_engine_ops};
+    int max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads < NUM_THREADS) max_threads = NUM_THREADS;
+    printf("\n=== Shard Scaling (Workload A, N=%d, 1..%d threads, hash partitioned) ===\n", n, max_threads);
+
+    YCSBWorkload w;
+    ycsb_workload_core(&w, 'a');
+    w.record_count = n;
+    w.operation_count = n;
+    for (int k = 0; k < 2; k++) {
+        for (int t = 1; t <= max_threads; t = (t < max_threads && t * 2 > max_threads) ? max_threads : t * 2) {
+            double ops_sec[2];
+            for (int c = 0; c < 2; c++) {
+                if (c == 1 && t == 1) { // One thread, one shard: same run
+                    ops_sec[1] = ops_sec[0];
+                    break;
+                }
+                system("rm -rf shard_data");
+                StorageEngine e;
+                engine_open_sharded(&e, kinds[k], "shard_data", false, c ? t : 1, SHARD_HASH);
+                YCSBResult r;
+                memset(&r, 0, sizeof(r));
+                ycsb_load(&w, &e, &r);
+                ycsb_run(&w, &e, t, &r);
+                ops_sec[c] = n / r.run_sec;
+                engine_close(&e);
             }
+            printf("%s threads=%2d: 1 shard %10.2f ops/sec, %2d shards %10.2f ops/sec (%.2fx)\n", kind_ops[k]->name,
+                   t, ops_sec[0], t, ops_sec[1], ops_sec[1] / ops_sec[0]);
         }
     }
-    return NULL;
+    system("rm -rf shard_data");
 }
 
-void run_workload_a(int n) {
-    printf("\n=== Workload A (50/50 Read/Update, N=%d) ===\n", n);
-    
-    // --- B-Tree ---
-    logical_bytes_written = 0;
-    physical_bytes_written = 0;
-    
-    BTree* btree = btree_create(64);
-    // Pre-populate
-    printf("Pre-loading B-Tree...\n");
-    for(int i=0; i<n; i++) btree_insert(btree, i, i);
-    
-    // Reset counters after load? Actually TCC cares about total WAF including load? 
-    // Usually WAF is measured during the stable phase.
-    // Let's reset.
-    logical_bytes_written = 0;
-    physical_bytes_written = 0;
-    
-    printf("Running B-Tree Workload A...\n");
-    double start = get_time_sec();
-    
+// Loading n sorted keys one insert at a time vs through the batch APIs
+// (bottom-up B-Tree build, SSTable ingest). Timed through the final
+// checkpoint / compaction so the write-back and merge work is included.
+void run_bulk_load_compare(int n) {
+    printf("\n=== Bulk Load (N=%d sorted keys) ===\n", n);
+    uint64_t *keys = sequential_keys(n);
+
+    for (int batch = 0; batch <= 1; batch++) {
+        system("rm -f btree_data.db");
+        BTree* btree = btree_create(64);
+        logical_bytes_written = 0;
+        physical_bytes_written = 0;
+        double start = get_time_sec();
+        if (batch) btree_insert_batch(btree, keys, keys, n);
+        else for (int i = 0; i < n; i++) btree_insert(btree, keys[i], keys[i]);
+        btree_checkpoint(btree);
+        double end = get_time_sec();
+        printf("B-Tree %-9s %.4f s (%.2f ops/sec), WAF %.2f, %lu pages\n", batch ? "batch:" : "per-key:",
+               end - start, n / (end - start), (double)physical_bytes_written / (double)logical_bytes_written,
+               btree->pool->num_pages);
+        btree_free(btree);
+    }
+
+    for (int batch = 0; batch <= 1; batch++) {
+        system("rm -rf lsm_bulk_data");
+        system("mkdir -p lsm_bulk_data");
+        LSMTree* lsm = lsm_create(1000, "lsm_bulk_data");
+        logical_bytes_written = 0;
+        physical_bytes_written = 0;
+        double start = get_time_sec();
+        if (batch) lsm_write_batch(lsm, keys, keys, n);
+        else for (int i = 0; i < n; i++) lsm_insert(lsm, keys[i], keys[i]);
+        lsm_compact_wait(lsm);
+        double end = get_time_sec();
+        printf("LSM-Tree %-9s %.4f s (%.2f ops/sec), WAF %.2f\n", batch ? "batch:" : "per-key:",
+               end - start, n / (end - start), (double)physical_bytes_written / (double)logical_bytes_written);
+        lsm_print_levels(lsm, "LSM-Tree");
+        lsm_free(lsm);
+    }
+    system("rm -rf lsm_bulk_data");
+    free(keys);
+}
+
+// NVMe queue depth: the same I/O issued synchronously and then with 1..64
+// ops in flight through io_uring. Raw O_DIRECT writes and random reads of a
+// scratch file, an LSM SSTable written by a batch ingest (flush path, 16KB
+// writes), and a B-Tree checkpoint of a fully dirty cache (4KB writes).
+#define IO_SWEEP_MAX_DEPTH 64
+#define IO_SWEEP_WRITE_BYTES (64 << 20)
+#define IO_SWEEP_READS 32768
+
+void run_io_depth_sweep(int n) {
+    static const unsigned depths[] = {0, 1, 2, 4, 8, 16, 32, IO_SWEEP_MAX_DEPTH}; // 0: synchronous
+    printf("\n=== I/O Queue Depth Sweep (16KB writes / 4KB random reads, N=%d) ===\n", n);
+
+    int fd = open("io_sweep.dat", O_RDWR | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+    char *bufs;
+    if (fd < 0 || posix_memalign((void**)&bufs, 4096, (size_t)IO_SWEEP_MAX_DEPTH * 16384) != 0) {
+        perror("I/O sweep setup failed");
+        if (fd >= 0) close(fd);
+        return;
+    }
+    memset(bufs, 0xab, (size_t)IO_SWEEP_MAX_DEPTH * 16384);
+    uint64_t *keys = sequential_keys(n);
+
+    for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+        IORingOptions io = ior_default_options();
+        io.enabled = depths[d] > 0;
+        io.depth = depths[d] > 0 ? depths[d] : 1;
+
+        // Raw file: each in-flight op has its own buffer slot
+        IORing *ring = ior_create(&io);
+        unsigned depth = ior_depth(ring);
+        uint64_t tickets[IO_SWEEP_MAX_DEPTH] = {0};
+        double start = get_time_sec();
+        for (uint64_t off = 0, i = 0; off < IO_SWEEP_WRITE_BYTES; off += 16384, i++) {
+            unsigned slot = i % depth;
+            if (tickets[slot]) ior_wait(ring, tickets[slot]);
+            tickets[slot] = ior_write(ring, fd, bufs + (size_t)slot * 16384, 16384, off);
+        }
+        ior_wait_all(ring);
+        double write_sec = get_time_sec() - start;
+
+        unsigned int seed = 11;
+        memset(tickets, 0, sizeof(tickets));
+        start = get_time_sec();
+        for (int i = 0; i < IO_SWEEP_READS; i++) {
+            unsigned slot = i % depth;
+            if (tickets[slot]) ior_wait(ring, tickets[slot]);
+            uint64_t off = (uint64_t)(rand_r(&seed) % (IO_SWEEP_WRITE_BYTES / 4096)) * 4096;
+            tickets[slot] = ior_read(ring, fd, bufs + (size_t)slot * 16384, 4096, off);
+        }
+        ior_wait_all(ring);
+        double read_sec = get_time_sec() - start;
+        const char *backend = ior_backend(ring);
+        ior_destroy(ring);
+
+        // LSM: one SSTable of n entries, written 16KB at a time
+        system("rm -rf lsm_io_data");
+        system("mkdir -p lsm_io_data");
+        LSMOptions lo = lsm_default_options();
+        lo.compaction_policy = LSM_COMPACTION_NONE;
+        lo.wal_mode = LSM_WAL_OFF;
+        lo.io = io;
+        LSMTree* lsm = lsm_create_opts("lsm_io_data", &lo);
+        physical_bytes_written = 0;
+        start = get_time_sec();
+        lsm_write_batch(lsm, keys, keys, n);
+        double sst_sec = get_time_sec() - start;
+        uint64_t sst_bytes = physical_bytes_written;
+        lsm_free(lsm);
+
+        // B-Tree: whole tree cached, every leaf dirtied, then one checkpoint
+        system("rm -f btree_data.db");
+        BTreeOptions bo = btree_default_options();
+        bo.cache_frames = n / 32;
+        bo.io = io;
+        BTree* btree = btree_create_opts("btree_data.db", &bo);
+        btree_insert_batch(btree, keys, keys, n);
+        for (int i = 0; i < n; i += 32) btree_insert(btree, i, i + 1);
+        btree_reset_stats(btree);
+        start = get_time_sec();
+        btree_checkpoint(btree);
+        double cp_sec = get_time_sec() - start;
+        uint64_t cp_pages = btree->pool->writebacks;
+        btree_free(btree);
+
+        printf("%-9s depth %2u: raw write %7.1f MB/s, raw read %7.0f IOPS, SSTable %7.1f MB/s, B-Tree checkpoint %7.0f pages/s\n",
+               backend, depths[d], IO_SWEEP_WRITE_BYTES / 1e6 / write_sec, IO_SWEEP_READS / read_sec,
+               sst_bytes / 1e6 / sst_sec, cp_pages / cp_sec);
+    }
+
+    close(fd);
+    unlink("io_sweep.dat");
+    system("rm -rf lsm_io_data");
+    free(bufs);
+    free(keys);
+}
+
+// Parallel inserts into one B-Tree with a cache smaller than the tree, so
+// threads overlap their page I/O as well as their CPU work.
+void run_btree_insert_scaling(int n) {
+    static const int thread_counts[] = {1, 2, 4, NUM_THREADS};
+    printf("\n=== B-Tree Insert Scaling (N=%d, %d frames) ===\n", n, BP_MIN_FRAMES);
+
     pthread_t threads[NUM_THREADS];
     ThreadArg targs[NUM_THREADS];
-    int chunk = n / NUM_THREADS;
-    
-    for (int i = 0; i < NUM_THREADS; i++) {
-        targs[i].start = i * chunk;
-        targs[i].end = (i == NUM_THREADS - 1) ? n : (i + 1) * chunk;
-        targs[i].btree = btree;
-        targs[i].lsm = NULL;
-        pthread_create(&threads[i], NULL, workload_a_worker, &targs[i]);
+    for (size_t c = 0; c < sizeof(thread_counts) / sizeof(thread_counts[0]); c++) {
+        int nt = thread_counts[c];
+        system("rm -f btree_data.db");
+        BTreeOptions o = btree_default_options();
+        o.cache_frames = BP_MIN_FRAMES;
+        BTree* btree = btree_create_opts("btree_data.db", &o);
+
+        int chunk = n / nt;
+        double start = get_time_sec();
+        for (int i = 0; i < nt; i++) {
+            targs[i].start = i * chunk;
+            targs[i].end = (i == nt - 1) ? n : (i + 1) * chunk;
+            targs[i].btree = btree;
+            targs[i].lsm = NULL;
+            pthread_create(&threads[i], NULL, btree_insert_worker, &targs[i]);
+        }
+        for (int i = 0; i < nt; i++) pthread_join(threads[i], NULL);
+        double end = get_time_sec();
+        printf("B-Tree Insert threads=%d: %.4f s (%.2f ops/sec)\n", nt, end - start, n / (end - start));
+        btree_free(btree);
     }
-    for (int i = 0; i < NUM_THREADS; i++) pthread_join(threads[i], NULL);
-    
-    double end = get_time_sec();
-    printf("B-Tree Throughput: %.2f ops/sec\n", n / (end - start));
-    printf("B-Tree WAF: %.2f (Phys: %lu / Log: %lu)\n", 
-           (double)physical_bytes_written / (double)logical_bytes_written, 
-           physical_bytes_written, logical_bytes_written);
-           
-    btree_free(btree);
+}
+
+// Deletes half the keys, in random order, from a B-Tree (strict CLRS
+// rebalancing, then lazy underflow) and from an LSM-Tree holding the same
+// data. Dirty pages are checkpointed at the end so every page the deletes
+// touched shows up in the physical bytes.
+void run_delete_compare(int n) {
+    printf("\n=== Delete Comparison (N=%d, deleting %d keys) ===\n", n, n / 2);
+    uint64_t *keys = (uint64_t*)malloc(sizeof(uint64_t) * n);
+    for (int i = 0; i < n; i++) keys[i] = i;
+    unsigned int seed = 7;
+    for (int i = n - 1; i > 0; i--) { // Fisher-Yates
+        int j = rand_r(&seed) % (i + 1);
+        uint64_t tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+
+    // The default cache (smaller than the tree) and one that holds all of it
+    static const size_t frames[] = {256, 1024};
+    for (size_t f = 0; f < sizeof(frames) / sizeof(frames[0]); f++) {
+        for (int lazy = 0; lazy <= 1; lazy++) {
+            system("rm -f btree_data.db");
+            BTreeOptions o = btree_default_options();
+            o.cache_frames = frames[f];
+            o.lazy_underflow = lazy;
+            BTree* btree = btree_create_opts("btree_data.db", &o);
+            for (int i = 0; i < n; i++) btree_insert(btree, i, i);
+            btree_checkpoint(btree);
+
+            logical_bytes_written = 0;
+            physical_bytes_written = 0;
+            btree_reset_stats(btree);
+            double start = get_time_sec();
+            for (int i = 0; i < n / 2; i++) btree_delete(btree, keys[i]);
+            btree_checkpoint(btree);
+            double end = get_time_sec();
+            printf("B-Tree Delete cache=%4zu lazy=%d: %10.2f ops/sec, WAF %7.2f, %6lu pages modified, %5lu borrows, %4lu merges, %6lu write-backs\n",
+                   frames[f], lazy, (n / 2) / (end - start),
+                   (double)physical_bytes_written / (double)logical_bytes_written, btree->delete_pages,
+                   btree->borrows, btree->merges, btree->pool->writebacks);
+            btree_free(btree);
+        }
+    }
+
+    system("rm -rf lsm_delete_data");
+    system("mkdir -p lsm_delete_data");
+    LSMTree* lsm = lsm_create(1000, "lsm_delete_data");
+    for (int i = 0; i < n; i++) lsm_insert(lsm, i, i);
+    lsm_compact_wait(lsm);
 
-    // --- LSM-Tree ---
-    logical_bytes_written = 0;
-    physical_bytes_written = 0;
-    
-    LSMTree* lsm = lsm_create(1000, "."); // Threshold 1000 like before
-    printf("Pre-loading LSM-Tree...\n");
-    for(int i=0; i<n; i++) lsm_insert(lsm, i, i);
-    
     logical_bytes_written = 0;
     physical_bytes_written = 0;
+    double start = get_time_sec();
+    for (int i = 0; i < n / 2; i++) lsm_delete(lsm, keys[i]);
+    lsm_compact_wait(lsm);
+    double end = get_time_sec();
+    printf("LSM-Tree Delete: %.2f ops/sec, WAF %.2f (tombstones, WAL and the compactions they caused)\n",
+           (n / 2) / (end - start), (double)physical_bytes_written / (double)logical_bytes_written);
+    lsm_free(lsm);
+    system("rm -rf lsm_delete_data");
+    free(keys);
+}
 
-    printf("Running LSM-Tree Workload A...\n");
-    start = get_time_sec();
-    
-    // Note: LSM insert is NOT thread safe yet. We need to fix LSM struct.
-    // For this step, I'll run single threaded LSM or fail?
-    // I will Assume I'll fix LSM safety in next step.
-    
-    for (int i = 0; i < NUM_THREADS; i++) {
-        targs[i].start = i * chunk;
-        targs[i].end = (i == NUM_THREADS - 1) ? n : (i + 1) * chunk;
-        targs[i].btree = NULL;
-        targs[i].lsm = lsm;
-        pthread_create(&threads[i], NULL, workload_a_worker, &targs[i]);
+// Memory footprint over TLB reach: a B-Tree pool and a memtable both much
+// bigger than what 4KB TLB entries cover, with and without huge pages.
+// Every memtable allocation is a bump in an arena block, so the number of
+// trips to the system allocator is the block count.
+void run_huge_page_compare(int n) {
+    printf("\n=== Huge Pages (N=%d, random lookups) ===\n", n);
+    for (int huge = 0; huge <= 1; huge++) {
+        system("rm -f btree_data.db");
+        BTreeOptions o = btree_default_options();
+        o.cache_frames = n / 32; // Whole tree cached (~60% full leaves)
+        o.huge_pages = huge;
+        BTree* btree = btree_create_opts("btree_data.db", &o);
+        for (int i = 0; i < n; i++) btree_insert(btree, i, i);
+
+        unsigned int seed = 42;
+        double start = get_time_sec();
+        for (int i = 0; i < n; i++) btree_search(btree, rand_r(&seed) % n, NULL);
+        double end = get_time_sec();
+        printf("B-Tree huge_pages=%d: %.2f search ops/sec, %lu pages, huge pages: %s\n", huge,
+               n / (end - start), btree->pool->num_pages, hp_kind_name(btree->pool->mem.kind));
+        btree_free(btree);
+
+        system("rm -rf lsm_huge_data");
+        LSMOptions lo = lsm_default_options();
+        lo.memtable_threshold = n; // Everything stays in the memtable
+        lo.wal_mode = LSM_WAL_OFF;
+        lo.compaction_policy = LSM_COMPACTION_NONE;
+        lo.memtable_huge_pages = huge;
+        LSMTree* lsm = lsm_create_opts("lsm_huge_data", &lo);
+        for (int i = 0; i < n - 1; i++) lsm_insert(lsm, (uint64_t)rand_r(&seed) * 2654435761u, i);
+
+        seed = 42;
+        start = get_time_sec();
+        for (int i = 0; i < n - 1; i++) lsm_search(lsm, (uint64_t)rand_r(&seed) * 2654435761u, NULL);
+        end = get_time_sec();
+        printf("LSM-Tree huge_pages=%d: %.2f memtable search ops/sec\n", huge, (n - 1) / (end - start));
+        lsm_print_levels(lsm, "LSM-Tree");
+        lsm_free(lsm);
     }
-    for (int i = 0; i < NUM_THREADS; i++) pthread_join(threads[i], NULL);
-    
-    end = get_time_sec();
-    printf("LSM-Tree Throughput: %.2f ops/sec\n", n / (end - start));
-    printf("LSM-Tree WAF: %.2f (Phys: %lu / Log: %lu)\n", 
-           (double)physical_bytes_written / (double)logical_bytes_written, 
-           physical_bytes_written, logical_bytes_written);
-           
-    lsm_free(lsm);
+    system("rm -rf lsm_huge_data");
+}
+
+// Workload A with byte-string values of a few sizes, up to n records or
+// 16MB of values: how the write amplification of each layout grows with
+// the value. The B-Tree keeps values in its heap, the LSM inline in its
+// SSTables (so compaction rewrites them), LSM+VLog only a pointer.
+// The value heap has no vacuum: replaced and deleted tuples stay in their
+// pages, while the value log is garbage collected. So the B-Tree's disk
+// figure is printed with the dead tuple bytes in it alongside, which are
+// heap garbage rather than space amplification of the tree itself.
+void run_value_size_compare(int n) {
+    static const uint32_t sizes[] = {16, 1024, 16384};
+    static const char *kinds[] = {"btree", "lsm", "lsm-vlog"};
+    static const char *paths[] = {"btree_data.db", "lsm_value_data", "lsm_value_data"};
+    printf("\n=== Value Size (Workload A, up to N=%d records / 16MB of values) ===\n", n);
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        YCSBWorkload w;
+        ycsb_workload_core(&w, 'a');
+        w.value_size = sizes[i];
+        w.record_count = (16u << 20) / sizes[i] < (uint64_t)n ? (16u << 20) / sizes[i] : (uint64_t)n;
+        w.operation_count = w.record_count;
+        for (int k = 0; k < 3; k++) {
+            system("rm -rf btree_data.db lsm_value_data");
+            StorageEngine e;
+            engine_open(&e, kinds[k], paths[k], true);
+            YCSBResult r;
+            memset(&r, 0, sizeof(r));
+            ycsb_load(&w, &e, &r);
+            ycsb_run(&w, &e, NUM_THREADS, &r);
+            const EngineStats *ls = &r.load_stats;
+            printf("%-13s value=%5uB records=%6lu: load WAF %6.2f, run WAF %6.2f, %10.2f ops/sec, %.1f MB on disk",
+                   engine_name(&e), sizes[i], w.record_count,
+                   ls->logical_bytes ? (double)ls->physical_bytes / ls->logical_bytes : 0.0,
+                   r.logical_bytes ? (double)r.physical_bytes / r.logical_bytes : 0.0,
+                   w.operation_count / r.run_sec, r.run_stats.disk_bytes / 1048576.0);
+            BTree *bt = k == 0 ? (BTree*)e.impl : NULL;
+            if (bt && bt->heap) printf(" (%.1f MB dead heap tuples, no vacuum)", atomic_load(&bt->heap->dead_bytes) / 1048576.0);
+            printf("\n");
+            engine_close(&e);
+        }
+    }
+    system("rm -rf btree_data.db lsm_value_data");
+}
+
+// Restart cost: a tree of n keys (sorted ingest plus random updates still
+// in the memtable and its log) is closed and reopened from its manifest.
+// Open time should stay flat as n grows, since tables are opened lazily;
+// the first lookups after it pay for loading index and filter blocks (cold),
+// the next ones don't (warm).
+void run_restart_compare(int n) {
+    static const int sizes_div[] = {10, 1};
+    printf("\n=== Restart (MANIFEST reopen, up to N=%d keys) ===\n", n);
+    for (size_t s = 0; s < sizeof(sizes_div) / sizeof(sizes_div[0]); s++) {
+        int keys_n = n / sizes_div[s];
+        system("rm -rf lsm_restart_data");
+        LSMOptions o = lsm_default_options();
+        LSMTree* lsm = lsm_open("lsm_restart_data", &o);
+        uint64_t *keys = sequential_keys(keys_n);
+        lsm_write_batch(lsm, keys, keys, keys_n);
+        free(keys);
+        lsm_compact_wait(lsm);
+        unsigned int seed = 42;
+        for (int i = 0; i < 500; i++) lsm_insert(lsm, rand_r(&seed) % keys_n, i);
+        lsm_free(lsm); // The active memtable stays in its log, replayed by the open
+
+        double start = get_time_sec();
+        lsm = lsm_open("lsm_restart_data", &o);
+        double opened = get_time_sec();
+        for (int i = 0; i < 1000; i++) lsm_search(lsm, rand_r(&seed) % keys_n, NULL);
+        double cold = get_time_sec();
+        for (int i = 0; i < 1000; i++) lsm_search(lsm, rand_r(&seed) % keys_n, NULL);
+        double warm = get_time_sec();
+        printf("LSM-Tree N=%d: open %.2f ms, first 1000 lookups %.2f ms (cold), next 1000 %.2f ms (warm)\n", keys_n,
+               (opened - start) * 1e3, (cold - opened) * 1e3, (warm - cold) * 1e3);
+        lsm_print_levels(lsm, "LSM-Tree");
+        lsm_free(lsm);
+    }
+    system("rm -rf lsm_restart_data");
+}
+
+// Workload A on the copy-on-write B-Tree with growing write transactions,
+// next to the in-place B-Tree and the LSM: every commit rewrites the root
+// paths it touched, so its WAF falls as a transaction covers more updates,
+// which then become durable later. Then a snapshot taken before a round of
+// updates keeps reading the old values.
+void run_cow_compare(int n) {
+    static const uint32_t txn_ops[] = {1, 16, 256, 4096};
+    printf("\n=== Copy-on-Write B-Tree (Workload A, N=%d) ===\n", n);
+    YCSBWorkload w;
+    ycsb_workload_core(&w, 'a');
+    w.record_count = n;
+    w.operation_count = n;
+    size_t num_runs = sizeof(txn_ops) / sizeof(txn_ops[0]);
+    for (size_t i = 0; i < num_runs + 2; i++) {
+        system("rm -rf btree_data.db lsm_cow_data cow_data.db");
+        StorageEngine e;
+        char label[64];
+        if (i < num_runs) {
+            CowBTreeOptions o = cow_default_options();
+            o.txn_ops = txn_ops[i];
+            e = engine_cow(cow_open("cow_data.db", &o));
+            snprintf(label, sizeof(label), "COW B-Tree txn=%u", txn_ops[i]);
+        } else {
+            engine_open(&e, i == num_runs ? "btree" : "lsm", i == num_runs ? "btree_data.db" : "lsm_cow_data", false);
+            snprintf(label, sizeof(label), "%s", engine_name(&e));
+        }
+        YCSBResult r;
+        memset(&r, 0, sizeof(r));
+        ycsb_load(&w, &e, &r);
+        ycsb_run(&w, &e, NUM_THREADS, &r);
+        printf("%-21s run WAF %7.2f, %10.2f ops/sec, %.1f MB on disk\n", label,
+               r.logical_bytes ? (double)r.physical_bytes / r.logical_bytes : 0.0, w.operation_count / r.run_sec,
+               r.run_stats.disk_bytes / 1048576.0);
+        if (i == num_runs - 1) engine_print_stats(&e);
+        engine_close(&e);
+    }
+
+    // MVCC: the snapshot holds the tree as of its root, whatever commits after it
+    system("rm -f cow_data.db");
+    CowBTreeOptions o = cow_default_options();
+    CowBTree *cow = cow_open("cow_data.db", &o);
+    uint64_t *keys = sequential_keys(n);
+    cow_insert_batch(cow, keys, keys, n);
+    free(keys);
+    CowSnapshot snap;
+    cow_snapshot_open(cow, &snap);
+    for (int i = 0; i < n; i++) cow_insert(cow, i, i + 1);
+    cow_commit(cow);
+    int old_seen = 0, new_seen = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t v;
+        if (cow_snapshot_search(&snap, i, &v) && v == (uint64_t)i) old_seen++;
+        if (cow_search(cow, i, &v) && v == (uint64_t)i + 1) new_seen++;
+    }
+    cow_snapshot_close(&snap);
+    printf("COW B-Tree snapshot: %d/%d keys still at their old value after %d updates, %d/%d new in the tree\n",
+           old_seen, n, n, new_seen, n);
+    cow_close(cow);
+    system("rm -rf btree_data.db lsm_cow_data cow_data.db");
 }
 
 void run_benchmarks() {
@@ -201,6 +677,7 @@ void run_benchmarks() {
 
 // --- B-Tree ---
     printf("\n=== B-Tree Benchmark (Direct I/O, N=%d) ===\n", n);
+    system("rm -f btree_data.db");
     BTree* btree = btree_create(64);
 
     // Threads
@@ -230,7 +707,7 @@ void run_benchmarks() {
     // Actually, let's keep search simple to focus on WRITE optimization which is the goal of O_DIRECT/NVMe
     start = get_time_sec();
     for (int i = 0; i < n; i++) {
-        btree_search(btree, i); 
+        btree_search(btree, i, NULL);
     }
     end = get_time_sec();
     printf("B-Tree Search: %.4f s (%.2f ops/sec)\n", end - start, n / (end - start));
@@ -242,6 +719,7 @@ void run_benchmarks() {
     }
     end = get_time_sec();
     printf("B-Tree Delete: %.4f s (%.2f ops/sec)\n", end - start, (n/10) / (end - start));
+    btree_print_stats(btree, "B-Tree");
 
     btree_free(btree);
 
@@ -254,10 +732,10 @@ void run_benchmarks() {
     
     LSMTree* lsm = lsm_create(1000, "lsm_data_c");
 
-    // Insert
+    // Insert (even keys only, so the odd keys in between are in-range misses)
     start = get_time_sec();
     for (int i = 0; i < n; i++) {
-        lsm_insert(lsm, i, i);
+        lsm_insert(lsm, 2 * i, i);
     }
     end = get_time_sec();
     printf("LSM-Tree Insert: %.4f s (%.2f ops/sec)\n", end - start, n / (end - start));
@@ -265,21 +743,45 @@ void run_benchmarks() {
     // Search
     start = get_time_sec();
     for (int i = 0; i < n; i++) {
-        lsm_search(lsm, i);
+        lsm_search(lsm, 2 * i, NULL);
     }
     end = get_time_sec();
     printf("LSM-Tree Search: %.4f s (%.2f ops/sec)\n", end - start, n / (end - start));
 
+    // Negative lookups: odd keys were never inserted, the filters should skip nearly every file
+    bloom_negatives = 0;
+    bloom_false_positives = 0;
+    start = get_time_sec();
+    for (int i = 0; i < n; i++) {
+        lsm_search(lsm, 2 * i + 1, NULL);
+    }
+    end = get_time_sec();
+    printf("LSM-Tree Search (missing keys): %.4f s (%.2f ops/sec)\n", end - start, n / (end - start));
+    printf("LSM-Tree Bloom: %lu probes skipped / %lu false positives\n", bloom_negatives, bloom_false_positives);
+
     // LSM Delete (Tombstone)
     start = get_time_sec();
     for (int i = 0; i < n / 10; i++) {
-        lsm_delete(lsm, i);
+        lsm_delete(lsm, 2 * i);
     }
     end = get_time_sec();
     printf("LSM-Tree Delete: %.4f s (%.2f ops/sec)\n", end - start, (n/10) / (end - start));
+    lsm_print_levels(lsm, "LSM-Tree");
 
     lsm_free(lsm);
-    run_workload_a(n);
+    run_ycsb_workloads(n);
+    run_bulk_load_compare(200000);
+    run_io_depth_sweep(300000);
+    run_btree_cache_sweep(n);
+    run_lsm_cache_sweep(200000);
+    run_encoding_compare(100000);
+    run_btree_insert_scaling(n);
+    run_shard_scaling(50000);
+    run_delete_compare(50000);
+    run_huge_page_compare(500000);
+    run_value_size_compare(100000);
+    run_restart_compare(10000000);
+    run_cow_compare(20000);
 }
 
 int main() {
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "manifest.h"
+
+// Record kinds. ADD carries the ManifestTable as its payload, REMOVE only
+// (file_no, level) in key / value, COMMIT the next file number in key.
+enum {
+    MANIFEST_ADD = 1,
+    MANIFEST_REMOVE = 2,
+    MANIFEST_COMMIT = 3
+};
+
+#define MANIFEST_MIN_REWRITE 1024 // Records in the log before a snapshot is worth writing
+
+struct Manifest {
+    WAL *wal;
+    uint64_t records; // In the log, commits included
+    uint64_t live;    // Tables live once the queued edits are in
+    bool pending;
+};
+
+static void manifest_path(const char *dir, const char *name, char *path, size_t len) {
+    snprintf(path, len, "%s/%s", dir, name);
+}
+
+// --- Replay ---
+
+typedef struct {
+    int kind;
+    ManifestTable t;
+} ManifestEdit;
+
+typedef struct {
+    ManifestTable *tables; // State as of the last commit
+    int num, cap;
+    ManifestEdit *edits;   // Group not committed yet
+    int num_edits, cap_edits;
+    uint64_t next_file_no;
+    bool committed;
+} ManifestReplay;
+
+static void replay_apply(ManifestReplay *r, const ManifestEdit *e) {
+    if (e->kind == MANIFEST_ADD) {
+        if (r->num == r->cap) {
+            r->cap = r->cap ? r->cap * 2 : 64;
+            r->tables = (ManifestTable*)realloc(r->tables, sizeof(ManifestTable) * r->cap);
+        }
+        r->tables[r->num++] = e->t;
+        return;
+    }
+    for (int i = 0; i < r->num; i++) {
+        if (r->tables[i].file_no == e->t.file_no && r->tables[i].level == e->t.level) {
+            memmove(&r->tables[i], &r->tables[i + 1], sizeof(ManifestTable) * (r->num - i - 1));
+            r->num--;
+            return;
+        }
+    }
+}
+
+static void replay_record(void *arg, const WALRecord *rec, const void *payload, uint64_t payload_off) {
+    ManifestReplay *r = (ManifestReplay*)arg;
+    (void)payload_off;
+    if (rec->kind == MANIFEST_COMMIT) {
+        for (int i = 0; i < r->num_edits; i++) replay_apply(r, &r->edits[i]);
+        r->num_edits = 0;
+        r->next_file_no = rec->key;
+        r->committed = true;
+        return;
+    }
+    if (rec->kind != MANIFEST_ADD && rec->kind != MANIFEST_REMOVE) return;
+    if (rec->kind == MANIFEST_ADD && rec->payload_len != sizeof(ManifestTable)) return;
+
+    if (r->num_edits == r->cap_edits) {
+        r->cap_edits = r->cap_edits ? r->cap_edits * 2 : 16;
+        r->edits = (ManifestEdit*)realloc(r->edits, sizeof(ManifestEdit) * r->cap_edits);
+    }
+    ManifestEdit *e = &r->edits[r->num_edits++];
+    e->kind = rec->kind;
+    if (rec->kind == MANIFEST_ADD) {
+        memcpy(&e->t, payload, sizeof(ManifestTable));
+    } else {
+        memset(&e->t, 0, sizeof(ManifestTable));
+        e->t.file_no = rec->key;
+        e->t.level = (int32_t)rec->value;
+    }
+}
+
+int manifest_load(const char *dir, ManifestTable **tables, int *num_tables, uint64_t *next_file_no) {
+    char path[512];
+    manifest_path(dir, "MANIFEST", path, sizeof(path));
+    if (access(path, F_OK) != 0) return 0;
+    ManifestReplay r;
+    memset(&r, 0, sizeof(r));
+    // A group cut off by a crash never got its commit: it is dropped here.
+    // The file is only ever renamed into place holding a committed snapshot,
+    // so no commit at all means it is damaged.
+    if (wal_replay(path, replay_record, &r) < 0 || !r.committed) {
+        free(r.tables);
+        free(r.edits);
+        return -1;
+    }
+    free(r.edits);
+    *tables = r.tables;
+    *num_tables = r.num;
+    *next_file_no = r.next_file_no;
+    return 1;
+}
+
+// --- Writing ---
+
+Manifest* manifest_create(const char *dir, const ManifestTable *tables, int num_tables, uint64_t next_file_no) {
+    char tmp[512], path[512];
+    manifest_path(dir, "MANIFEST.tmp", tmp, sizeof(tmp));
+    manifest_path(dir, "MANIFEST", path, sizeof(path));
+    WAL *w = wal_open(tmp, WAL_SYNC_GROUP, 0, NULL);
+    if (!w) return NULL;
+
+    Manifest *m = (Manifest*)calloc(1, sizeof(Manifest));
+    m->wal = w;
+    for (int i = 0; i < num_tables; i++) manifest_add(m, &tables[i]);
+    manifest_commit(m, next_file_no);
+
+    // The snapshot is durable: swap it in, and make the rename durable too
+    if (rename(tmp, path) != 0) {
+        perror("MANIFEST rename failed");
+        wal_close(w);
+        free(m);
+        return NULL;
+    }
+    int dfd = open(dir, O_RDONLY);
+    if (dfd >= 0) {
+        fsync(dfd);
+        close(dfd);
+    }
+    return m;
+}
+
+void manifest_add(Manifest *m, const ManifestTable *t) {
+    wal_add(m->wal, t->file_no, (uint64_t)t->level, 0, MANIFEST_ADD, t, sizeof(ManifestTable), NULL);
+    m->records++;
+    m->live++;
+    m->pending = true;
+}
+
+void manifest_remove(Manifest *m, int level, uint64_t file_no) {
+    wal_add(m->wal, file_no, (uint64_t)level, 0, MANIFEST_REMOVE, NULL, 0, NULL);
+    m->records++;
+    m->live--;
+    m->pending = true;
+}
+
+bool manifest_pending(const Manifest *m) {
+    return m->pending;
+}
+
+void manifest_commit(Manifest *m, uint64_t next_file_no) {
+    wal_append(m->wal, next_file_no, 0, 0, MANIFEST_COMMIT, NULL, 0);
+    m->records++;
+    m->pending = false;
+}
+
+bool manifest_needs_rewrite(const Manifest *m) {
+    return m->records > MANIFEST_MIN_REWRITE && m->records > 4 * (m->live + 1);
+}
+
+void manifest_close(Manifest *m) {
+    if (!m) return;
+    wal_close(m->wal);
+    free(m);
+}
@@ -0,0 +1,48 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sstable.h"
+#include "wal.h"
+
+// Persistent manifest of an LSM tree: which SSTables are live and at which
+// level, so a restart reopens them without reading the tables themselves.
+//
+// dir/MANIFEST is a log of version edits written through a WAL (wal.c): a
+// record per table added or removed, then a commit record closing the group.
+// A group is applied on replay only once its commit is there, so a crash in
+// the middle of a compaction's install leaves the previous version. Each
+// added table carries its footer (key range, entry count, index / filter /
+// value map offsets), which is all the LSM needs to open it lazily.
+//
+// The log only grows; once most of it is superseded edits the LSM writes a
+// snapshot of the live tables to a new file and renames it over the old one.
+
+typedef struct {
+    uint64_t file_no;
+    int32_t level;
+    uint32_t reserved;
+    uint64_t file_bytes;
+    SSTFooter footer;
+} ManifestTable;
+
+typedef struct Manifest Manifest;
+
+// Replays dir/MANIFEST: the live tables in the order they were added and the
+// next free file number. 1 if it loaded, 0 if there is no manifest, -1 if
+// it can't be read or holds no committed group (nothing set either way).
+int manifest_load(const char *dir, ManifestTable **tables, int *num_tables, uint64_t *next_file_no);
+// Writes a manifest holding tables and renames it over any old one. NULL if
+// the file can't be created.
+Manifest* manifest_create(const char *dir, const ManifestTable *tables, int num_tables, uint64_t next_file_no);
+// Queued until the next commit
+void manifest_add(Manifest *m, const ManifestTable *t);
+void manifest_remove(Manifest *m, int level, uint64_t file_no);
+bool manifest_pending(const Manifest *m);
+// Writes the queued edits as one group; durable on return
+void manifest_commit(Manifest *m, uint64_t next_file_no);
+bool manifest_needs_rewrite(const Manifest *m); // Mostly superseded edits: time for a snapshot
+void manifest_close(Manifest *m);
+
+#endif
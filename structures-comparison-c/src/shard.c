@@ -0,0 +1,321 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "shard.h"
+
+#define SHARD_SCAN_CHUNK 64 // Entries a merged scan pulls from one shard at a time
+
+// MurmurHash3 finalizer: YCSB's hashed keys are spread already, ordered
+// inserts (0, 1, 2, ...) are not
+static uint64_t mix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+int shard_of(const ShardedEngine *s, uint64_t key) {
+    if (s->partition == SHARD_RANGE) return (int)(((unsigned __int128)key * s->num_shards) >> 64);
+    return (int)(mix64(key) % (uint64_t)s->num_shards);
+}
+
+static StorageEngine* shard_for(ShardedEngine *s, uint64_t key) {
+    return &s->shards[shard_of(s, key)];
+}
+
+static void sh_insert(void *impl, uint64_t key, uint64_t value) {
+    engine_insert(shard_for((ShardedEngine*)impl, key), key, value);
+}
+
+static bool sh_search(void *impl, uint64_t key, uint64_t *value) {
+    return engine_search(shard_for((ShardedEngine*)impl, key), key, value);
+}
+
+static void sh_delete(void *impl, uint64_t key) {
+    engine_delete(shard_for((ShardedEngine*)impl, key), key);
+}
+
+static void sh_put(void *impl, uint64_t key, const void *value, uint32_t len) {
+    engine_put(shard_for((ShardedEngine*)impl, key), key, value, len);
+}
+
+static bool sh_get(void *impl, uint64_t key, void *buf, uint32_t cap, uint32_t *len) {
+    return engine_get(shard_for((ShardedEngine*)impl, key), key, buf, cap, len);
+}
+
+// --- Scans ---
+
+typedef struct {
+    EngineScanFn cb;
+    void *arg;
+    size_t count;
+    bool stopped;
+} RangeScanArg;
+
+static bool range_scan_cb(void *arg, uint64_t key, const void *value, uint32_t len) {
+    RangeScanArg *a = (RangeScanArg*)arg;
+    a->count++;
+    if (a->cb(a->arg, key, value, len)) return true;
+    a->stopped = true;
+    return false;
+}
+
+// Range partitions are already in key order: the shard holding start, then
+// the ones after it, until the limit is reached
+static size_t scan_range(ShardedEngine *s, uint64_t start, size_t limit, EngineScanFn cb, void *arg) {
+    RangeScanArg a = {cb, arg, 0, false};
+    for (int i = shard_of(s, start); i < s->num_shards && !a.stopped; i++) {
+        if (limit && a.count == limit) break;
+        engine_scan(&s->shards[i], start, limit ? limit - a.count : 0, range_scan_cb, &a);
+    }
+    return a.count;
+}
+
+// A shard's next entries in a hash-partitioned scan, refilled from the key
+// after the last one handed out. Each refill is a new engine scan, so a long
+// scan is not one snapshot (the B-Tree scan isn't either). The values of
+// the chunk are copied back to back into data.
+typedef struct {
+    uint64_t keys[SHARD_SCAN_CHUNK];
+    size_t offs[SHARD_SCAN_CHUNK];
+    uint32_t lens[SHARD_SCAN_CHUNK];
+    char *data;
+    size_t data_len, data_cap;
+    int len, pos;
+    uint64_t next;  // Where the next refill starts
+    bool exhausted; // The last refill came back short: nothing left past it
+} ShardCursor;
+
+static bool cursor_fill_cb(void *arg, uint64_t key, const void *value, uint32_t len) {
+    ShardCursor *c = (ShardCursor*)arg;
+    if (c->data_len + len > c->data_cap) {
+        while (c->data_len + len > c->data_cap) c->data_cap = c->data_cap ? c->data_cap * 2 : 4096;
+        c->data = (char*)realloc(c->data, c->data_cap);
+    }
+    if (value) memcpy(c->data + c->data_len, value, len);
+    c->keys[c->len] = key;
+    c->offs[c->len] = c->data_len;
+    c->lens[c->len] = len;
+    c->data_len += len;
+    c->len++;
+    return c->len < SHARD_SCAN_CHUNK;
+}
+
+static void cursor_fill(StorageEngine *shard, ShardCursor *c, size_t want) {
+    c->len = c->pos = 0;
+    c->data_len = 0;
+    if (c->exhausted) return;
+    if (want == 0 || want > SHARD_SCAN_CHUNK) want = SHARD_SCAN_CHUNK;
+    engine_scan(shard, c->next, want, cursor_fill_cb, c);
+    if ((size_t)c->len < want || c->keys[c->len - 1] == UINT64_MAX) c->exhausted = true;
+    else c->next = c->keys[c->len - 1] + 1;
+}
+
+// Hash partitions interleave: merge one cursor per shard. A key lives in
+// exactly one shard, so there are no duplicates to settle, and with a
+// handful of shards a linear pick of the smallest head is enough.
+static size_t scan_hash(ShardedEngine *s, uint64_t start, size_t limit, EngineScanFn cb, void *arg) {
+    ShardCursor *cur = (ShardCursor*)calloc(s->num_shards, sizeof(ShardCursor));
+    for (int i = 0; i < s->num_shards; i++) {
+        cur[i].next = start;
+        cursor_fill(&s->shards[i], &cur[i], limit);
+    }
+
+    size_t count = 0;
+    while (!limit || count < limit) {
+        int best = -1;
+        for (int i = 0; i < s->num_shards; i++) {
+            if (cur[i].pos == cur[i].len) continue;
+            if (best < 0 || cur[i].keys[cur[i].pos] < cur[best].keys[cur[best].pos]) best = i;
+        }
+        if (best < 0) break;
+
+        ShardCursor *c = &cur[best];
+        count++;
+        if (!cb(arg, c->keys[c->pos], c->data + c->offs[c->pos], c->lens[c->pos])) break;
+        if (++c->pos == c->len && (!limit || count < limit)) cursor_fill(&s->shards[best], c, limit ? limit - count : 0);
+    }
+    for (int i = 0; i < s->num_shards; i++) free(cur[i].data);
+    free(cur);
+    return count;
+}
+
+static size_t sh_scan(void *impl, uint64_t start, size_t limit, EngineScanFn cb, void *arg) {
+    ShardedEngine *s = (ShardedEngine*)impl;
+    if (s->partition == SHARD_RANGE) return scan_range(s, start, limit, cb, arg);
+    return scan_hash(s, start, limit, cb, arg);
+}
+
+// --- Batches and syncs: one thread per shard ---
+
+typedef struct {
+    StorageEngine *shard;
+    const uint64_t *keys; // insert_batch only
+    const uint64_t *values;
+    size_t n;
+} ShardJob;
+
+static void* batch_worker(void *arg) {
+    ShardJob *j = (ShardJob*)arg;
+    if (j->n) engine_insert_batch(j->shard, j->keys, j->values, j->n);
+    return NULL;
+}
+
+static void* sync_worker(void *arg) {
+    engine_sync(((ShardJob*)arg)->shard);
+    return NULL;
+}
+
+static void run_on_shards(ShardedEngine *s, ShardJob *jobs, void *(*fn)(void*)) {
+    if (s->num_shards == 1) {
+        fn(&jobs[0]);
+        return;
+    }
+    pthread_t *threads = (pthread_t*)malloc(sizeof(pthread_t) * s->num_shards);
+    for (int i = 0; i < s->num_shards; i++) pthread_create(&threads[i], NULL, fn, &jobs[i]);
+    for (int i = 0; i < s->num_shards; i++) pthread_join(threads[i], NULL);
+    free(threads);
+}
+
+// Splits the batch by shard, keeping the order within each shard (a sorted
+// batch stays sorted, so every shard can still bulk load / ingest it)
+static void sh_insert_batch(void *impl, const uint64_t *keys, const uint64_t *values, size_t n) {
+    ShardedEngine *s = (ShardedEngine*)impl;
+    int *which = (int*)malloc(sizeof(int) * n);
+    size_t *offset = (size_t*)calloc(s->num_shards + 1, sizeof(size_t));
+    for (size_t i = 0; i < n; i++) {
+        which[i] = shard_of(s, keys[i]);
+        offset[which[i] + 1]++;
+    }
+    for (int i = 0; i < s->num_shards; i++) offset[i + 1] += offset[i];
+
+    uint64_t *k = (uint64_t*)malloc(sizeof(uint64_t) * n);
+    uint64_t *v = (uint64_t*)malloc(sizeof(uint64_t) * n);
+    ShardJob *jobs = (ShardJob*)calloc((unsigned)s->num_shards, sizeof(ShardJob));
+    for (int i = 0; i < s->num_shards; i++) {
+        jobs[i].shard = &s->shards[i];
+        jobs[i].keys = k + offset[i];
+        jobs[i].values = v + offset[i];
+    }
+    for (size_t i = 0; i < n; i++) {
+        ShardJob *j = &jobs[which[i]];
+        k[offset[which[i]] + j->n] = keys[i];
+        v[offset[which[i]] + j->n] = values[i];
+        j->n++;
+    }
+    run_on_shards(s, jobs, batch_worker);
+    free(jobs);
+    free(k);
+    free(v);
+    free(offset);
+    free(which);
+}
+
+static void sh_sync(void *impl) {
+    ShardedEngine *s = (ShardedEngine*)impl;
+    ShardJob *jobs = (ShardJob*)calloc(s->num_shards, sizeof(ShardJob));
+    for (int i = 0; i < s->num_shards; i++) jobs[i].shard = &s->shards[i];
+    run_on_shards(s, jobs, sync_worker);
+    free(jobs);
+}
+
+// --- Stats ---
+
+static void sh_reset_stats(void *impl) {
+    ShardedEngine *s = (ShardedEngine*)impl;
+    for (int i = 0; i < s->num_shards; i++) engine_reset_stats(&s->shards[i]);
+}
+
+static void sh_space(void *impl, uint64_t *live_bytes, uint64_t *disk_bytes) {
+    ShardedEngine *s = (ShardedEngine*)impl;
+    *live_bytes = *disk_bytes = 0;
+    for (int i = 0; i < s->num_shards; i++) {
+        uint64_t live, disk;
+        s->shards[i].ops->space(s->shards[i].impl, &live, &disk);
+        *live_bytes += live;
+        *disk_bytes += disk;
+    }
+}
+
+static void sh_print_stats(void *impl, const char *label) {
+    ShardedEngine *s = (ShardedEngine*)impl;
+    for (int i = 0; i < s->num_shards; i++) {
+        char shard_label[96];
+        snprintf(shard_label, sizeof(shard_label), "%s shard %d", label, i);
+        s->shards[i].ops->print_stats(s->shards[i].impl, shard_label);
+    }
+}
+
+static void sh_close(void *impl) {
+    ShardedEngine *s = (ShardedEngine*)impl;
+    for (int i = 0; i < s->num_shards; i++) engine_close(&s->shards[i]);
+    free(s->shards);
+    free(s);
+}
+
+static const StorageEngineOps sharded_engine_ops = {
+    "Sharded", sh_insert, sh_search, sh_delete, sh_put, sh_get, sh_scan, sh_insert_batch,
+    sh_sync, sh_reset_stats, sh_space, sh_print_stats, sh_close,
+};
+
+bool engine_open_sharded(StorageEngine *e, const char *kind, const char *dir, bool byte_values, int num_shards, ShardPartition p) {
+    bool btree = strcmp(kind, "btree") == 0;
+    bool vlog = strcmp(kind, "lsm-vlog") == 0;
+    bool cow = strcmp(kind, "cow-btree") == 0;
+    if ((!btree && !vlog && !cow && strcmp(kind, "lsm") != 0) || num_shards < 1) return false;
+    if (cow && byte_values) return false; // As engine_open
+    mkdir(dir, 0755);
+
+    ShardedEngine *s = (ShardedEngine*)calloc(1, sizeof(ShardedEngine));
+    s->num_shards = num_shards;
+    s->partition = p;
+    s->shards = (StorageEngine*)calloc(num_shards, sizeof(StorageEngine));
+    for (int i = 0; i < num_shards; i++) {
+        char path[512];
+        void *shard = NULL;
+        if (btree) {
+            snprintf(path, sizeof(path), "%s/shard-%d.db", dir, i);
+            BTreeOptions o = btree_default_options();
+            o.cache_frames /= num_shards;
+            if (o.cache_frames < BP_MIN_FRAMES) o.cache_frames = BP_MIN_FRAMES;
+            o.byte_values = byte_values;
+            BTree *tree = btree_create_opts(path, &o);
+            if (tree) s->shards[i] = engine_btree(tree);
+            shard = tree;
+        } else if (cow) {
+            snprintf(path, sizeof(path), "%s/shard-%d.db", dir, i);
+            CowBTreeOptions o = cow_default_options();
+            o.cache_bytes /= num_shards;
+            CowBTree *tree = cow_open(path, &o);
+            if (tree) s->shards[i] = engine_cow(tree);
+            shard = tree;
+        } else {
+            snprintf(path, sizeof(path), "%s/shard-%d", dir, i);
+            mkdir(path, 0755);
+            LSMOptions o = lsm_default_options();
+            o.block_cache_bytes /= num_shards;
+            o.value_log = vlog;
+            LSMTree *tree = lsm_create_opts(path, &o);
+            if (tree) s->shards[i] = vlog ? engine_lsm_vlog(tree) : engine_lsm(tree);
+            shard = tree;
+        }
+        if (!shard) {
+            while (i-- > 0) engine_close(&s->shards[i]);
+            free(s->shards);
+            free(s);
+            return false;
+        }
+    }
+
+    s->ops = sharded_engine_ops;
+    snprintf(s->name, sizeof(s->name), "%s x%d (%s)", s->shards[0].ops->name, num_shards,
+             p == SHARD_RANGE ? "range" : "hash");
+    s->ops.name = s->name;
+    e->ops = &s->ops;
+    e->impl = s;
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "engine.h"
+
+// N independent engines behind one StorageEngine: each shard has its own
+// file or data directory, locks, buffer pool or memtable, and background
+// threads, so threads working on different shards never meet. Point
+// operations go to one shard; scans merge the shards back into key order.
+
+typedef enum {
+    SHARD_HASH,  // Mixed key hash mod N: even load whatever the key order
+    SHARD_RANGE  // N equal slices of the u64 key space: scans stay on few shards, but ordered keys pile up in shard 0
+} ShardPartition;
+
+typedef struct {
+    int num_shards;
+    ShardPartition partition;
+    StorageEngine *shards;
+    StorageEngineOps ops; // sharded_engine_ops with this instance's name
+    char name[64];        // e.g. "LSM-Tree x8 (hash)"
+} ShardedEngine;
+
+// Opens num_shards engines of kind ("btree", "lsm", "lsm-vlog" or
+// "cow-btree", and byte_values, as engine_open) under dir, created if
+// missing: dir/shard-<i>.db or dir/shard-<i>/. The B-Tree buffer pool and
+// the LSM and COW B-Tree caches are split between the shards so the total
+// stays the default; each LSM shard gets a default-sized memtable.
+// false on an unknown kind or if a shard can't be opened.
+bool engine_open_sharded(StorageEngine *e, const char *kind, const char *dir, bool byte_values, int num_shards, ShardPartition p);
+int shard_of(const ShardedEngine *s, uint64_t key);
+
+#endif
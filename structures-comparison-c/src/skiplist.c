@@ -0,0 +1,159 @@
+#include <stdlib.h>
+#include <string.h>
+#include "skiplist.h"
+#include "stats.h"
+
+#define SL_ARENA_BLOCK (64 * 1024)
+
+static __thread uint32_t sl_rng = 0;
+
+// Geometric height with p = 1/SL_BRANCHING, per-thread xorshift state
+static int sl_random_height(void) {
+    if (sl_rng == 0) sl_rng = (uint32_t)(uintptr_t)&sl_rng | 1;
+    int h = 1;
+    while (h < SL_MAX_HEIGHT) {
+        sl_rng ^= sl_rng << 13;
+        sl_rng ^= sl_rng >> 17;
+        sl_rng ^= sl_rng << 5;
+        if (sl_rng % SL_BRANCHING != 0) break;
+        h++;
+    }
+    return h;
+}
+
+// Entry order: key ascending, then newest (highest seq) first
+static inline bool sl_node_before(const SLNode *n, uint64_t key, uint64_t seq) {
+    return n->key < key || (n->key == key && n->seq > seq);
+}
+
+static SLNode* sl_new_node(SkipList *sl, uint64_t key, uint64_t seq, int kind, uint64_t value, const void *bytes,
+                           uint32_t len, int height) {
+    size_t node_bytes = sizeof(SLNode) + sizeof(_Atomic(SLNode*)) * height;
+    SLNode *n = (SLNode*)arena_alloc(&sl->arena, node_bytes + (bytes ? len : 0));
+    n->key = key;
+    n->seq = seq;
+    n->value = value;
+    n->value_len = 0;
+    if (bytes) { // Right behind the next pointers, same allocation
+        memcpy((char*)n + node_bytes, bytes, len);
+        n->value = (uint64_t)(uintptr_t)((char*)n + node_bytes);
+        n->value_len = len;
+    }
+    n->kind = (uint8_t)kind;
+    n->height = (uint8_t)height;
+    for (int i = 0; i < height; i++) atomic_init(&n->next[i], NULL);
+    return n;
+}
+
+SkipList* sl_create(bool huge_pages) {
+    SkipList *sl = (SkipList*)malloc(sizeof(SkipList));
+    arena_init(&sl->arena, SL_ARENA_BLOCK, huge_pages);
+    sl->head = sl_new_node(sl, 0, 0, 0, 0, NULL, 0, SL_MAX_HEIGHT);
+    atomic_init(&sl->max_height, 1);
+    atomic_init(&sl->count, 0);
+    atomic_init(&sl->refs, 1);
+    return sl;
+}
+
+// Starting from `before` at `level`, find prev < (key, seq) <= next.
+// Adds the nodes it compared against to *cmps.
+static void sl_find_splice(SLNode *before, int level, uint64_t key, uint64_t seq, SLNode **prev, SLNode **next,
+                           uint64_t *cmps) {
+    for (;;) {
+        SLNode *n = atomic_load_explicit(&before->next[level], memory_order_acquire);
+        if (n) (*cmps)++;
+        if (n == NULL || !sl_node_before(n, key, seq)) {
+            *prev = before;
+            *next = n;
+            return;
+        }
+        before = n;
+    }
+}
+
+void sl_insert(SkipList *sl, uint64_t key, uint64_t seq, int kind, uint64_t value, const void *bytes, uint32_t len) {
+    int height = sl_random_height();
+    SLNode *x = sl_new_node(sl, key, seq, kind, value, bytes, len, height);
+
+    int max_h = atomic_load_explicit(&sl->max_height, memory_order_relaxed);
+    while (height > max_h) {
+        if (atomic_compare_exchange_weak(&sl->max_height, &max_h, height)) {
+            max_h = height;
+            break;
+        }
+    }
+
+    SLNode *prev[SL_MAX_HEIGHT], *next[SL_MAX_HEIGHT];
+    SLNode *before = sl->head;
+    uint64_t cmps = 0;
+    for (int i = max_h - 1; i >= 0; i--) {
+        sl_find_splice(before, i, key, seq, &prev[i], &next[i], &cmps);
+        before = prev[i];
+    }
+
+    // Link bottom-up: once level 0 is published the entry is visible to readers
+    for (int i = 0; i < height; i++) {
+        for (;;) {
+            atomic_store_explicit(&x->next[i], next[i], memory_order_relaxed);
+            if (atomic_compare_exchange_strong_explicit(&prev[i]->next[i], &next[i], x,
+                                                        memory_order_release, memory_order_relaxed)) {
+                break;
+            }
+            // Lost a race with another insert at this level: redo the splice from prev
+            sl_find_splice(prev[i], i, key, seq, &prev[i], &next[i], &cmps);
+        }
+    }
+    atomic_fetch_add_explicit(&sl->count, 1, memory_order_relaxed);
+    stats_add(STAT_KEY_COMPARISONS, cmps);
+}
+
+// Last node strictly before every entry of `key`
+static SLNode* sl_find_less(SkipList *sl, uint64_t key) {
+    SLNode *x = sl->head;
+    uint64_t cmps = 0;
+    for (int i = atomic_load_explicit(&sl->max_height, memory_order_acquire) - 1; i >= 0; i--) {
+        for (;;) {
+            SLNode *n = atomic_load_explicit(&x->next[i], memory_order_acquire);
+            if (n) cmps++;
+            if (n && n->key < key) x = n;
+            else break;
+        }
+    }
+    stats_add(STAT_KEY_COMPARISONS, cmps);
+    return x;
+}
+
+const SLNode* sl_get(SkipList *sl, uint64_t key) {
+    SLNode *n = atomic_load_explicit(&sl_find_less(sl, key)->next[0], memory_order_acquire);
+    return n && n->key == key ? n : NULL;
+}
+
+size_t sl_count(SkipList *sl) {
+    return atomic_load_explicit(&sl->count, memory_order_relaxed);
+}
+
+size_t sl_memory_usage(SkipList *sl) {
+    return arena_memory_usage(&sl->arena);
+}
+
+void sl_ref(SkipList *sl) {
+    atomic_fetch_add(&sl->refs, 1);
+}
+
+void sl_free(SkipList *sl) {
+    if (!sl || atomic_fetch_sub(&sl->refs, 1) != 1) return;
+    arena_destroy(&sl->arena);
+    free(sl);
+}
+
+void sl_iter_init(SLIterator *it, SkipList *sl) {
+    it->node = atomic_load_explicit(&sl->head->next[0], memory_order_acquire);
+}
+
+void sl_iter_seek(SLIterator *it, SkipList *sl, uint64_t key) {
+    it->node = atomic_load_explicit(&sl_find_less(sl, key)->next[0], memory_order_acquire);
+}
+
+void sl_iter_next(SLIterator *it) {
+    it->node = atomic_load_explicit(&it->node->next[0], memory_order_acquire);
+}
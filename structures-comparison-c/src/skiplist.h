@@ -0,0 +1,62 @@
+#ifndef SKIPLIST_H
+#define SKIPLIST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "arena.h"
+
+// Concurrent skiplist memtable (LevelDB/RocksDB InlineSkipList style).
+//
+// Every write is a new immutable entry ordered by (key asc, seq desc), so an
+// update never modifies a node: inserts only publish next pointers with CAS and
+// readers follow them without any lock. The first entry of a key is its newest
+// version. Nodes live in an arena and are freed together with the list.
+//
+// Each entry carries an opaque kind byte for the caller (value, tombstone...)
+// and a 64-bit value, or value bytes copied into the arena next to it.
+
+#define SL_MAX_HEIGHT 12
+#define SL_BRANCHING 4
+
+typedef struct SLNode {
+    uint64_t key;
+    uint64_t seq;
+    uint64_t value;     // The value, or the address of value_len bytes in the arena
+    uint32_t value_len; // 0 unless the entry was inserted with bytes
+    uint8_t kind;
+    uint8_t height;
+    _Atomic(struct SLNode*) next[]; // height entries
+} SLNode;
+
+typedef struct {
+    Arena arena;
+    SLNode *head;
+    _Atomic int max_height;
+    _Atomic size_t count; // Entries, including older versions of a key
+    _Atomic int refs;     // The LSM holds one; range scans take their own
+} SkipList;
+
+SkipList* sl_create(bool huge_pages); // huge_pages: arena blocks on 2MB pages
+// bytes non-NULL: len bytes are copied into the arena and value is ignored
+void sl_insert(SkipList *sl, uint64_t key, uint64_t seq, int kind, uint64_t value, const void *bytes, uint32_t len);
+// Newest version of key, NULL if absent. Valid as long as the list.
+const SLNode* sl_get(SkipList *sl, uint64_t key);
+static inline const void* sl_node_bytes(const SLNode *n) { return (const void*)(uintptr_t)n->value; }
+size_t sl_count(SkipList *sl);
+size_t sl_memory_usage(SkipList *sl);
+void sl_ref(SkipList *sl);
+void sl_free(SkipList *sl); // Drops a reference; the last one frees the list
+
+// In-order iteration over every entry (all versions, newest first within a key).
+typedef struct {
+    SLNode *node;
+} SLIterator;
+
+void sl_iter_init(SLIterator *it, SkipList *sl);
+void sl_iter_seek(SLIterator *it, SkipList *sl, uint64_t key); // First entry with key >= key
+static inline bool sl_iter_valid(const SLIterator *it) { return it->node != NULL; }
+void sl_iter_next(SLIterator *it);
+
+#endif
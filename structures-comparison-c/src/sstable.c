@@ -0,0 +1,805 @@
+#define _GNU_SOURCE // Needed for O_DIRECT and posix_memalign
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "sstable.h"
+#include "stats.h"
+#include "lz.h"
+
+struct SSTWriter {
+    int fd;
+    IORing *ring;        // Full buffers are written through it, several in flight
+    char *bufs;          // num_bufs buffers of SST_WRITE_BUF_BLOCKS aligned blocks
+    uint64_t *tickets;   // Write in flight from each buffer, 0 if none
+    int num_bufs;
+    int cur_buf;
+    char *buf;           // The one being filled
+    int buf_blocks;      // Completed blocks sitting in buf
+    uint64_t file_off;   // Bytes already written to fd
+    SSTIndexEntry *index;
+    size_t num_index;
+    size_t cap_index;
+    uint64_t num_entries;
+    uint64_t min_key;
+    uint64_t max_key;
+    int bloom_bits_per_key;
+    uint64_t *keys; // Filter is sized at finish, once the entry count is known
+    size_t cap_keys;
+
+    // Records of the block being built, written out once it is full
+    SSTEncoding encoding;
+    uint64_t *blk_keys;
+    uint64_t *blk_values;
+    uint8_t *blk_kinds;
+    uint32_t blk_count;
+    uint8_t *raw;        // Their encoding (DELTA, DELTA_LZ)
+    uint32_t raw_len;
+    uint32_t *raw_end;   // raw_len after each record, to cut a compressed block short
+    // DELTA_LZ: the longest prefix of the block known to fit in 4KB
+    uint8_t *lz;         // Its compressed form
+    uint8_t *lz_try;
+    uint32_t fit_count;
+    uint32_t fit_len;    // Compressed size in lz, 0 while the prefix fits uncompressed
+    uint32_t next_try;   // raw_len at which to try compressing again
+
+    // Value pages: the one being filled, and where the full ones went
+    char *vpage;
+    uint32_t vpage_used;
+    uint64_t value_bytes; // Appended so far, all pages
+    uint64_t *vmap;
+    size_t num_vpages;
+    size_t cap_vpages;
+
+    bool failed; // A write went wrong on the way, seen at finish by callers that don't check each add
+};
+
+// Delta-encoded record: one byte with the 2 kind bits, the low 5 bits of
+// the key delta and a continuation bit, then the rest of the delta and the
+// value as LEB128 varints. The first record of a block is a delta from 0.
+#define SST_MAX_RECORD_BYTES 20
+
+static void* sst_alloc_aligned(size_t size) {
+    void *ptr;
+#ifdef __linux__
+    if (posix_memalign(&ptr, SST_BLOCK_SIZE, size) != 0) return NULL;
+#else
+    ptr = malloc(size);
+#endif
+    return ptr;
+}
+
+// Queues an O_DIRECT write of an aligned region, counted as physical bytes.
+static uint64_t sst_write_aligned(SSTWriter *w, const char *buf, size_t len, uint64_t off) {
+    atomic_fetch_add(&physical_bytes_written, len);
+    return ior_write(w->ring, w->fd, buf, len, off);
+}
+
+// Sends the full buffer off and moves on to the next one, waiting for that
+// one's previous write if it is still in flight. With io depth d, up to d
+// buffers (d x 16KB) are on their way to the device while the writer fills
+// the next.
+static int sst_flush_buf(SSTWriter *w) {
+    if (w->buf_blocks == 0) return 0;
+    size_t len = (size_t)w->buf_blocks * SST_BLOCK_SIZE;
+    w->tickets[w->cur_buf] = sst_write_aligned(w, w->buf, len, w->file_off);
+    w->file_off += len;
+    w->buf_blocks = 0;
+
+    w->cur_buf = (w->cur_buf + 1) % w->num_bufs;
+    w->buf = w->bufs + (size_t)w->cur_buf * SST_WRITE_BUF_BLOCKS * SST_BLOCK_SIZE;
+    int rc = 0;
+    if (w->tickets[w->cur_buf] && !ior_wait(w->ring, w->tickets[w->cur_buf])) rc = -1;
+    if (rc != 0) w->failed = true;
+    w->tickets[w->cur_buf] = 0;
+    memset(w->buf, 0, (size_t)SST_WRITE_BUF_BLOCKS * SST_BLOCK_SIZE);
+    return rc;
+}
+
+SSTWriter* sst_writer_open(const char *path, SSTEncoding encoding, int bloom_bits_per_key, const IORingOptions *io) {
+    int fd;
+#ifdef __linux__
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+#else
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+#endif
+    if (fd == -1) {
+        perror("SSTable open failed");
+        return NULL;
+    }
+
+    SSTWriter *w = (SSTWriter*)calloc(1, sizeof(SSTWriter));
+    w->fd = fd;
+    IORingOptions sync_io = {false, 1, false};
+    w->ring = ior_create(io ? io : &sync_io);
+    w->num_bufs = (int)ior_depth(w->ring);
+    size_t bufs_bytes = (size_t)w->num_bufs * SST_WRITE_BUF_BLOCKS * SST_BLOCK_SIZE;
+    w->bufs = (char*)sst_alloc_aligned(bufs_bytes);
+    memset(w->bufs, 0, bufs_bytes);
+    w->tickets = (uint64_t*)calloc(w->num_bufs, sizeof(uint64_t));
+    w->buf = w->bufs;
+    w->cap_index = 16;
+    w->index = (SSTIndexEntry*)malloc(sizeof(SSTIndexEntry) * w->cap_index);
+    w->bloom_bits_per_key = bloom_bits_per_key;
+    if (bloom_bits_per_key > 0) {
+        w->cap_keys = 1024;
+        w->keys = (uint64_t*)malloc(sizeof(uint64_t) * w->cap_keys);
+    }
+
+    w->encoding = encoding;
+    w->blk_keys = (uint64_t*)malloc(sizeof(uint64_t) * SST_MAX_BLOCK_RECORDS);
+    w->blk_values = (uint64_t*)malloc(sizeof(uint64_t) * SST_MAX_BLOCK_RECORDS);
+    w->blk_kinds = (uint8_t*)malloc(SST_MAX_BLOCK_RECORDS);
+    if (encoding != SST_ENCODING_PLAIN) {
+        w->raw = (uint8_t*)malloc(SST_MAX_RAW_BYTES);
+        w->raw_end = (uint32_t*)malloc(sizeof(uint32_t) * SST_MAX_BLOCK_RECORDS);
+    }
+    if (encoding == SST_ENCODING_DELTA_LZ) {
+        w->lz = (uint8_t*)malloc(SST_BLOCK_PAYLOAD);
+        w->lz_try = (uint8_t*)malloc(SST_BLOCK_PAYLOAD);
+    }
+    w->next_try = SST_BLOCK_PAYLOAD + 1;
+    w->vpage = (char*)malloc(SST_BLOCK_SIZE);
+    return w;
+}
+
+static size_t sst_put_varint(uint8_t *p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static size_t sst_encode_record(uint8_t *p, uint64_t delta, uint64_t value, int kind) {
+    uint64_t rest = delta >> 5;
+    p[0] = (uint8_t)((delta & 0x1f) << 2 | (kind & 3) | (rest ? 0x80 : 0));
+    size_t n = 1;
+    if (rest) n += sst_put_varint(p + 1, rest);
+    return n + sst_put_varint(p + n, value);
+}
+
+// Next free block of the write buffer and its file offset
+static char* sst_next_block(SSTWriter *w, uint64_t *offset) {
+    *offset = w->file_off + (uint64_t)w->buf_blocks * SST_BLOCK_SIZE;
+    return w->buf + (size_t)w->buf_blocks * SST_BLOCK_SIZE;
+}
+
+// The block handed out by sst_next_block is filled in
+static int sst_block_done(SSTWriter *w) {
+    if (++w->buf_blocks == SST_WRITE_BUF_BLOCKS) return sst_flush_buf(w);
+    return 0;
+}
+
+static int sst_emit_value_page(SSTWriter *w) {
+    if (w->num_vpages == w->cap_vpages) {
+        w->cap_vpages = w->cap_vpages ? w->cap_vpages * 2 : 16;
+        w->vmap = (uint64_t*)realloc(w->vmap, sizeof(uint64_t) * w->cap_vpages);
+    }
+    char *page = sst_next_block(w, &w->vmap[w->num_vpages++]);
+    memcpy(page, w->vpage, w->vpage_used); // Past vpage_used the buffer block is zero
+    w->vpage_used = 0;
+    return sst_block_done(w);
+}
+
+uint64_t sst_writer_add_value(SSTWriter *w, const void *data, uint32_t len) {
+    uint64_t slot = w->value_bytes << 16 | len;
+    const char *p = (const char*)data;
+    w->value_bytes += len;
+    while (len > 0) {
+        uint32_t n = SST_BLOCK_SIZE - w->vpage_used;
+        if (n > len) n = len;
+        memcpy(w->vpage + w->vpage_used, p, n);
+        w->vpage_used += n;
+        p += n;
+        len -= n;
+        if (w->vpage_used == SST_BLOCK_SIZE && sst_emit_value_page(w) != 0) w->failed = true;
+    }
+    return slot;
+}
+
+// Copies one block (the first count staged records, already encoded in
+// payload) into the write buffer and opens its index entry
+static int sst_emit_block(SSTWriter *w, uint32_t count, const void *payload, uint32_t payload_len, uint32_t raw_len) {
+    if (w->num_index == w->cap_index) {
+        w->cap_index *= 2;
+        w->index = (SSTIndexEntry*)realloc(w->index, sizeof(SSTIndexEntry) * w->cap_index);
+    }
+    SSTIndexEntry *e = &w->index[w->num_index++];
+    e->first_key = w->blk_keys[0];
+    e->last_key = w->blk_keys[count - 1];
+
+    SSTBlockHeader *hdr = (SSTBlockHeader*)sst_next_block(w, &e->offset);
+    hdr->count = count;
+    hdr->payload = (uint16_t)payload_len;
+    hdr->raw = (uint16_t)raw_len;
+    memcpy((char*)hdr + sizeof(SSTBlockHeader), payload, payload_len);
+    return sst_block_done(w);
+}
+
+// DELTA_LZ: compresses everything staged. If it fits, that is the new
+// prefix to fall back on, and the next try is put off until about half the
+// room left should be used up at this ratio.
+static bool sst_block_try_compress(SSTWriter *w) {
+    size_t len = lz_compress(w->raw, w->raw_len, w->lz_try, SST_BLOCK_PAYLOAD);
+    if (len == 0) return false;
+    uint8_t *tmp = w->lz;
+    w->lz = w->lz_try;
+    w->lz_try = tmp;
+    w->fit_count = w->blk_count;
+    w->fit_len = (uint32_t)len;
+    uint64_t room = (uint64_t)(SST_BLOCK_PAYLOAD - len) * w->raw_len / len / 2;
+    w->next_try = w->raw_len + (uint32_t)(room > 128 ? room : 128);
+    return true;
+}
+
+static int sst_block_add(SSTWriter *w, uint64_t key, uint64_t value, int kind);
+
+// Writes out the block being built. A compressed block takes the longest
+// prefix that fits (retry: compress the whole block once more first); the
+// records past it start the next block.
+static int sst_block_finish(SSTWriter *w, bool retry) {
+    uint32_t n = w->blk_count, done = n;
+    if (n == 0) return 0;
+    int rc;
+    if (w->encoding == SST_ENCODING_PLAIN) {
+        SSTRecord recs[SST_RECORDS_PER_BLOCK];
+        for (uint32_t i = 0; i < n; i++) {
+            recs[i].key = w->blk_keys[i];
+            recs[i].value = w->blk_values[i];
+            recs[i].kind = w->blk_kinds[i];
+        }
+        rc = sst_emit_block(w, n, recs, n * sizeof(SSTRecord), n * sizeof(SSTRecord));
+    } else if (w->raw_len <= SST_BLOCK_PAYLOAD) {
+        rc = sst_emit_block(w, n, w->raw, w->raw_len, w->raw_len);
+    } else {
+        if (retry && w->fit_count < n) sst_block_try_compress(w);
+        done = w->fit_count;
+        uint32_t raw_len = w->raw_end[done - 1];
+        if (w->fit_len) rc = sst_emit_block(w, done, w->lz, w->fit_len, raw_len);
+        else rc = sst_emit_block(w, done, w->raw, raw_len, raw_len);
+    }
+
+    uint32_t left = n - done;
+    uint64_t *spill = NULL;
+    if (left) { // Keys, values and kinds of the records left over
+        spill = (uint64_t*)malloc(sizeof(uint64_t) * 3 * left);
+        memcpy(spill, w->blk_keys + done, sizeof(uint64_t) * left);
+        memcpy(spill + left, w->blk_values + done, sizeof(uint64_t) * left);
+        for (uint32_t i = 0; i < left; i++) spill[2 * left + i] = w->blk_kinds[done + i];
+    }
+    w->blk_count = 0;
+    w->raw_len = 0;
+    w->fit_count = w->fit_len = 0;
+    w->next_try = SST_BLOCK_PAYLOAD + 1;
+    for (uint32_t i = 0; i < left; i++) rc |= sst_block_add(w, spill[i], spill[left + i], (int)spill[2 * left + i]);
+    free(spill);
+    return rc;
+}
+
+static int sst_block_add(SSTWriter *w, uint64_t key, uint64_t value, int kind) {
+    int rc = 0;
+    if (w->encoding == SST_ENCODING_PLAIN) {
+        if (w->blk_count == SST_RECORDS_PER_BLOCK) rc = sst_block_finish(w, false);
+    } else {
+        uint8_t rec[SST_MAX_RECORD_BYTES];
+        size_t len = sst_encode_record(rec, key - (w->blk_count ? w->blk_keys[w->blk_count - 1] : 0), value, kind);
+        uint32_t cap = w->encoding == SST_ENCODING_DELTA_LZ ? SST_MAX_RAW_BYTES : SST_BLOCK_PAYLOAD;
+        if (w->blk_count == SST_MAX_BLOCK_RECORDS || w->raw_len + len > cap) {
+            rc = sst_block_finish(w, true);
+            len = sst_encode_record(rec, key - (w->blk_count ? w->blk_keys[w->blk_count - 1] : 0), value, kind);
+        }
+        memcpy(w->raw + w->raw_len, rec, len);
+        w->raw_len += (uint32_t)len;
+        w->raw_end[w->blk_count] = w->raw_len;
+    }
+    w->blk_keys[w->blk_count] = key;
+    w->blk_values[w->blk_count] = value;
+    w->blk_kinds[w->blk_count] = (uint8_t)(kind & 3);
+    w->blk_count++;
+
+    if (w->encoding == SST_ENCODING_DELTA_LZ) {
+        if (w->raw_len <= SST_BLOCK_PAYLOAD) {
+            w->fit_count = w->blk_count; // Still fits as is
+            w->fit_len = 0;
+        } else if (w->raw_len >= w->next_try && !sst_block_try_compress(w)) {
+            rc |= sst_block_finish(w, false);
+        }
+    }
+    return rc;
+}
+
+int sst_writer_add(SSTWriter *w, uint64_t key, uint64_t value, int kind) {
+    if (w->keys) {
+        if (w->num_entries == w->cap_keys) {
+            w->cap_keys *= 2;
+            w->keys = (uint64_t*)realloc(w->keys, sizeof(uint64_t) * w->cap_keys);
+        }
+        w->keys[w->num_entries] = key;
+    }
+    if (w->num_entries == 0) w->min_key = key;
+    w->max_key = key;
+    w->num_entries++;
+    return sst_block_add(w, key, value, kind);
+}
+
+uint64_t sst_writer_entries(const SSTWriter *w) {
+    return w->num_entries;
+}
+
+const char* sst_encoding_name(SSTEncoding e) {
+    static const char *names[] = {"plain", "delta", "delta+lz"};
+    return e <= SST_ENCODING_DELTA_LZ ? names[e] : "?";
+}
+
+uint64_t sst_writer_bytes(const SSTWriter *w) {
+    return w->file_off + (uint64_t)w->buf_blocks * SST_BLOCK_SIZE;
+}
+
+int sst_writer_finish(SSTWriter *w) {
+    int rc = 0;
+
+    // Staged records (a compressed block may spill into one more), then the
+    // tail of the write buffer
+    while (w->blk_count > 0) {
+        if (sst_block_finish(w, true) != 0) rc = -1;
+    }
+    if (w->vpage_used > 0 && sst_emit_value_page(w) != 0) rc = -1;
+    if (sst_flush_buf(w) != 0) rc = -1;
+    if (w->failed) rc = -1; // Value pages and blocks written while streaming
+
+    BloomFilter bf = {0};
+    if (w->keys) {
+        bloom_init(&bf, w->num_entries, w->bloom_bits_per_key);
+        for (uint64_t i = 0; i < w->num_entries; i++) bloom_add(&bf, w->keys[i]);
+    }
+
+    // Index entries, filter bits, value page map, then the footer at the very end of the last block
+    size_t index_bytes = w->num_index * sizeof(SSTIndexEntry);
+    size_t vmap_bytes = w->num_vpages * sizeof(uint64_t);
+    size_t meta_size = index_bytes + bf.num_bytes + vmap_bytes + sizeof(SSTFooter);
+    meta_size = (meta_size + SST_BLOCK_SIZE - 1) / SST_BLOCK_SIZE * SST_BLOCK_SIZE;
+
+    char *meta = (char*)sst_alloc_aligned(meta_size);
+    memset(meta, 0, meta_size);
+    memcpy(meta, w->index, index_bytes);
+    if (bf.num_bytes) memcpy(meta + index_bytes, bf.bits, bf.num_bytes);
+    if (vmap_bytes) memcpy(meta + index_bytes + bf.num_bytes, w->vmap, vmap_bytes);
+
+    SSTFooter footer;
+    footer.min_key = w->min_key;
+    footer.max_key = w->max_key;
+    footer.num_entries = w->num_entries;
+    footer.num_blocks = w->num_index;
+    footer.index_offset = w->file_off;
+    footer.filter_offset = w->file_off + index_bytes;
+    footer.filter_bytes = bf.num_bytes;
+    footer.filter_hashes = bf.num_hashes;
+    footer.encoding = w->encoding;
+    footer.reserved = 0;
+    footer.value_pages = w->num_vpages;
+    footer.vmap_offset = w->file_off + index_bytes + bf.num_bytes;
+    footer.magic = SST_MAGIC;
+    memcpy(meta + meta_size - sizeof(SSTFooter), &footer, sizeof(SSTFooter));
+
+    if (rc == 0) sst_write_aligned(w, meta, meta_size, w->file_off);
+    if (!ior_wait_all(w->ring)) rc = -1;
+    ior_destroy(w->ring);
+    // O_DIRECT skips the page cache, not the device cache: the table must be
+    // durable before the LSM manifest points at it
+    if (rc == 0 && fdatasync(w->fd) != 0) rc = -1;
+
+    free(meta);
+    bloom_free(&bf);
+    close(w->fd);
+    free(w->bufs);
+    free(w->tickets);
+    free(w->index);
+    free(w->keys);
+    free(w->blk_keys);
+    free(w->blk_values);
+    free(w->blk_kinds);
+    free(w->raw);
+    free(w->raw_end);
+    free(w->lz);
+    free(w->lz_try);
+    free(w->vpage);
+    free(w->vmap);
+    free(w);
+    return rc;
+}
+
+static _Atomic uint64_t sst_next_id = 1;
+
+static int sst_open_fd(const char *path) {
+#ifdef __linux__
+    return open(path, O_RDONLY | O_DIRECT);
+#else
+    return open(path, O_RDONLY);
+#endif
+}
+
+static SSTable* sst_alloc(int fd, BlockCache *cache, uint64_t file_bytes) {
+    SSTable *t = (SSTable*)malloc(sizeof(SSTable));
+    t->fd = fd;
+    t->id = atomic_fetch_add(&sst_next_id, 1);
+    t->cache = cache;
+    t->refs = 1;
+    t->file_bytes = file_bytes;
+    t->index = NULL;
+    t->vmap = NULL;
+    memset(&t->filter, 0, sizeof(BloomFilter));
+    t->meta_loaded = false;
+    pthread_mutex_init(&t->meta_lock, NULL);
+    return t;
+}
+
+static bool sst_footer_valid(const SSTFooter *f, uint64_t file_bytes) {
+    return f->magic == SST_MAGIC && f->encoding <= SST_ENCODING_DELTA_LZ &&
+           f->index_offset % SST_BLOCK_SIZE == 0 && f->index_offset < file_bytes;
+}
+
+// The index + filter + value map region: it starts on a block boundary and
+// runs to the end of the file (O_DIRECT reads whole aligned blocks)
+static int sst_load_meta_locked(SSTable *t) {
+    size_t meta_bytes = t->file_bytes - t->footer.index_offset;
+    char *meta = (char*)sst_alloc_aligned(meta_bytes);
+    if (pread(t->fd, meta, meta_bytes, t->footer.index_offset) != (ssize_t)meta_bytes) {
+        free(meta);
+        return -1;
+    }
+    stats_add(STAT_BYTES_READ, meta_bytes);
+
+    size_t index_bytes = t->footer.num_blocks * sizeof(SSTIndexEntry);
+    t->index = (SSTIndexEntry*)malloc(index_bytes ? index_bytes : 1);
+    memcpy(t->index, meta, index_bytes);
+    if (t->footer.filter_bytes > 0) {
+        t->filter.num_bytes = t->footer.filter_bytes;
+        t->filter.num_hashes = t->footer.filter_hashes;
+        t->filter.bits = (uint8_t*)malloc(t->footer.filter_bytes);
+        memcpy(t->filter.bits, meta + (t->footer.filter_offset - t->footer.index_offset), t->footer.filter_bytes);
+    }
+    if (t->footer.value_pages > 0) {
+        size_t vmap_bytes = t->footer.value_pages * sizeof(uint64_t);
+        t->vmap = (uint64_t*)malloc(vmap_bytes);
+        memcpy(t->vmap, meta + (t->footer.vmap_offset - t->footer.index_offset), vmap_bytes);
+    }
+    free(meta);
+    atomic_store(&t->meta_loaded, true);
+    return 0;
+}
+
+// Loads index and filter on first use (lazily opened tables)
+static int sst_load_meta(SSTable *t) {
+    if (atomic_load(&t->meta_loaded)) return 0;
+    pthread_mutex_lock(&t->meta_lock);
+    int rc = atomic_load(&t->meta_loaded) ? 0 : sst_load_meta_locked(t);
+    pthread_mutex_unlock(&t->meta_lock);
+    return rc;
+}
+
+SSTable* sst_open(const char *path, BlockCache *cache) {
+    int fd = sst_open_fd(path);
+    if (fd == -1) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < SST_BLOCK_SIZE || st.st_size % SST_BLOCK_SIZE != 0) {
+        close(fd);
+        return NULL;
+    }
+    SSTable *t = sst_alloc(fd, cache, st.st_size);
+
+    // The last block for the footer, then the metadata before it
+    char *tail = (char*)sst_alloc_aligned(SST_BLOCK_SIZE);
+    if (pread(fd, tail, SST_BLOCK_SIZE, st.st_size - SST_BLOCK_SIZE) != SST_BLOCK_SIZE) {
+        free(tail);
+        sst_close(t);
+        return NULL;
+    }
+    memcpy(&t->footer, tail + SST_BLOCK_SIZE - sizeof(SSTFooter), sizeof(SSTFooter));
+    free(tail);
+    stats_add(STAT_BYTES_READ, SST_BLOCK_SIZE);
+    if (!sst_footer_valid(&t->footer, t->file_bytes) || sst_load_meta_locked(t) != 0) {
+        sst_close(t);
+        return NULL;
+    }
+    return t;
+}
+
+SSTable* sst_open_lazy(const char *path, BlockCache *cache, const SSTFooter *footer, uint64_t file_bytes) {
+    if (!sst_footer_valid(footer, file_bytes)) return NULL;
+    int fd = sst_open_fd(path);
+    if (fd == -1) return NULL;
+    SSTable *t = sst_alloc(fd, cache, file_bytes);
+    t->footer = *footer;
+    return t;
+}
+
+// One data block into buf (aligned): a copy from the block cache, else an
+// O_DIRECT read, cached afterwards if fill is set
+static int sst_read_block(SSTable *t, uint64_t offset, char *buf, bool fill) {
+    if (t->cache && bc_get(t->cache, t->id, offset, buf)) {
+        stats_add(STAT_CACHE_HITS, 1);
+        return 0;
+    }
+    if (pread(t->fd, buf, SST_BLOCK_SIZE, offset) != SST_BLOCK_SIZE) return -1;
+    stats_add(STAT_BYTES_READ, SST_BLOCK_SIZE);
+    if (t->cache) {
+        stats_add(STAT_CACHE_MISSES, 1);
+        if (fill) bc_put(t->cache, t->id, offset, buf);
+    }
+    return 0;
+}
+
+// Encoded records of a DELTA / DELTA_LZ block, decompressed into a
+// per-thread buffer when the block is compressed. NULL if it is corrupt.
+static const uint8_t* sst_block_records(const char *block) {
+    static __thread uint8_t raw[SST_MAX_RAW_BYTES];
+    const SSTBlockHeader *hdr = (const SSTBlockHeader*)block;
+    const uint8_t *p = (const uint8_t*)block + sizeof(SSTBlockHeader);
+    if (hdr->payload > SST_BLOCK_PAYLOAD || hdr->count > SST_MAX_BLOCK_RECORDS) return NULL;
+    if (hdr->raw == hdr->payload) return p;
+    if (hdr->raw > SST_MAX_RAW_BYTES || lz_decompress(p, hdr->payload, raw, hdr->raw) != hdr->raw) return NULL;
+    return raw;
+}
+
+static inline const uint8_t* sst_get_varint(const uint8_t *p, uint64_t *v) {
+    uint64_t x = *p++;
+    if (x < 0x80) { // One byte: small values and key deltas in dense tables
+        *v = x;
+        return p;
+    }
+    x &= 0x7f;
+    for (int shift = 7; shift < 64; shift += 7) {
+        uint64_t b = *p++;
+        x |= (b & 0x7f) << shift;
+        if (b < 0x80) break;
+    }
+    *v = x;
+    return p;
+}
+
+// Next delta-encoded record: *key goes from the previous key to this one
+static inline const uint8_t* sst_decode_record(const uint8_t *p, uint64_t *key, uint64_t *value, uint8_t *kind) {
+    uint8_t b = *p++;
+    uint64_t delta = (b >> 2) & 0x1f;
+    if (b & 0x80) {
+        uint64_t rest;
+        p = sst_get_varint(p, &rest);
+        delta |= rest << 5;
+    }
+    *key += delta;
+    *kind = b & 3;
+    return sst_get_varint(p, value);
+}
+
+// Decodes a whole block into the arrays (SST_MAX_BLOCK_RECORDS each).
+// Returns the record count, -1 if the block is corrupt.
+static int sst_block_decode(const SSTable *t, const char *block, uint64_t *keys, uint64_t *values, uint8_t *kinds) {
+    const SSTBlockHeader *hdr = (const SSTBlockHeader*)block;
+    uint32_t n = hdr->count;
+    if (t->footer.encoding == SST_ENCODING_PLAIN) {
+        if (n > SST_RECORDS_PER_BLOCK) return -1;
+        const SSTRecord *recs = (const SSTRecord*)(block + sizeof(SSTBlockHeader));
+        for (uint32_t i = 0; i < n; i++) {
+            keys[i] = recs[i].key;
+            values[i] = recs[i].value;
+            kinds[i] = recs[i].kind;
+        }
+        return (int)n;
+    }
+
+    const uint8_t *p = sst_block_records(block);
+    if (!p) return -1;
+    uint64_t key = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        p = sst_decode_record(p, &key, &values[i], &kinds[i]);
+        keys[i] = key;
+    }
+    return (int)n;
+}
+
+int sst_get(SSTable *t, uint64_t key, uint64_t *value, int *kind) {
+    if (t->footer.num_entries == 0 || key < t->footer.min_key || key > t->footer.max_key) return 0;
+    if (sst_load_meta(t) != 0) return -1;
+    if (!bloom_may_contain(&t->filter, key)) {
+        atomic_fetch_add(&bloom_negatives, 1);
+        return 0;
+    }
+
+    // Last block whose first key is <= key
+    size_t lo = 0, hi = t->footer.num_blocks;
+    uint64_t cmps = 0;
+    while (hi - lo > 1) {
+        cmps++;
+        size_t mid = lo + (hi - lo) / 2;
+        if (t->index[mid].first_key <= key) lo = mid;
+        else hi = mid;
+    }
+    cmps++;
+    if (key > t->index[lo].last_key) { // Falls in the gap between two blocks
+        stats_add(STAT_KEY_COMPARISONS, cmps);
+        if (t->filter.bits) atomic_fetch_add(&bloom_false_positives, 1);
+        return 0;
+    }
+
+    _Alignas(SST_BLOCK_SIZE) char block[SST_BLOCK_SIZE];
+    if (sst_read_block(t, t->index[lo].offset, block, true) != 0) return -1;
+    stats_add(STAT_LOOKUP_BLOCKS, 1);
+
+    SSTBlockHeader *hdr = (SSTBlockHeader*)block;
+    int found = 0;
+    if (t->footer.encoding == SST_ENCODING_PLAIN) {
+        SSTRecord *recs = (SSTRecord*)(block + sizeof(SSTBlockHeader));
+        size_t l = 0, h = hdr->count;
+        while (l < h) {
+            cmps++;
+            size_t mid = l + (h - l) / 2;
+            uint64_t k = recs[mid].key;
+            if (k == key) {
+                *value = recs[mid].value;
+                *kind = recs[mid].kind;
+                found = 1;
+                break;
+            }
+            if (k < key) l = mid + 1;
+            else h = mid;
+        }
+    } else {
+        // Deltas only decode front to back: stop at the first key >= key
+        const uint8_t *p = sst_block_records(block);
+        if (!p) return -1;
+        uint64_t k = 0, v;
+        uint8_t kd;
+        for (uint32_t i = 0; i < hdr->count; i++) {
+            p = sst_decode_record(p, &k, &v, &kd);
+            cmps++;
+            if (k < key) continue;
+            if (k == key) {
+                *value = v;
+                *kind = kd;
+                found = 1;
+            }
+            break;
+        }
+    }
+    stats_add(STAT_KEY_COMPARISONS, cmps);
+    if (!found && t->filter.bits) atomic_fetch_add(&bloom_false_positives, 1);
+    return found;
+}
+
+int sst_read_value(SSTable *t, uint64_t slot, void *buf, uint32_t cap, bool fill_cache) {
+    uint64_t off = slot >> 16;
+    uint32_t len = sst_value_len(slot), want = len < cap ? len : cap;
+    if (want == 0) return (int)len;
+    if ((off + want - 1) / SST_BLOCK_SIZE >= t->footer.value_pages || sst_load_meta(t) != 0) return -1;
+
+    _Alignas(SST_BLOCK_SIZE) char page[SST_BLOCK_SIZE];
+    char *out = (char*)buf;
+    while (want > 0) {
+        uint64_t in_page = off % SST_BLOCK_SIZE;
+        uint32_t n = SST_BLOCK_SIZE - in_page < want ? (uint32_t)(SST_BLOCK_SIZE - in_page) : want;
+        if (sst_read_block(t, t->vmap[off / SST_BLOCK_SIZE], page, fill_cache) != 0) return -1;
+        memcpy(out, page + in_page, n);
+        out += n;
+        off += n;
+        want -= n;
+    }
+    return (int)len;
+}
+
+void sst_ref(SSTable *t) {
+    atomic_fetch_add(&t->refs, 1);
+}
+
+void sst_close(SSTable *t) {
+    if (!t) return;
+    if (atomic_fetch_sub(&t->refs, 1) != 1) return;
+    close(t->fd);
+    free(t->index);
+    free(t->vmap);
+    bloom_free(&t->filter);
+    pthread_mutex_destroy(&t->meta_lock);
+    free(t);
+}
+
+static void sst_iter_load(SSTIterator *it) {
+    while (it->block < it->t->footer.num_blocks) {
+        if (sst_read_block(it->t, it->t->index[it->block].offset, it->buf, it->fill_cache) != 0) break;
+        int n = sst_block_decode(it->t, it->buf, it->keys, it->values, it->kinds);
+        if (n < 0) break;
+        if (n > 0) {
+            it->count = (uint32_t)n;
+            it->pos = 0;
+            it->valid = 1;
+            return;
+        }
+        it->block++;
+    }
+    it->valid = 0;
+}
+
+static void sst_iter_fill(SSTIterator *it) {
+    it->key = it->keys[it->pos];
+    it->value = it->values[it->pos];
+    it->kind = it->kinds[it->pos];
+}
+
+static void sst_iter_alloc(SSTIterator *it, SSTable *t, bool fill_cache) {
+    it->t = t;
+    it->pos = 0;
+    it->count = 0;
+    it->fill_cache = fill_cache;
+    it->buf = (char*)sst_alloc_aligned(SST_BLOCK_SIZE);
+    it->keys = (uint64_t*)malloc((sizeof(uint64_t) * 2 + 1) * SST_MAX_BLOCK_RECORDS);
+    it->values = it->keys + SST_MAX_BLOCK_RECORDS;
+    it->kinds = (uint8_t*)(it->values + SST_MAX_BLOCK_RECORDS);
+}
+
+void sst_iter_init(SSTIterator *it, SSTable *t, bool fill_cache) {
+    sst_iter_alloc(it, t, fill_cache);
+    it->block = 0;
+    if (sst_load_meta(t) != 0) {
+        it->valid = 0;
+        return;
+    }
+    sst_iter_load(it);
+    if (it->valid) sst_iter_fill(it);
+}
+
+void sst_iter_seek(SSTIterator *it, SSTable *t, uint64_t key, bool fill_cache) {
+    sst_iter_alloc(it, t, fill_cache);
+    if (sst_load_meta(t) != 0) {
+        it->block = 0;
+        it->valid = 0;
+        return;
+    }
+    // First block that reaches key: everything before it is smaller
+    size_t lo = 0, hi = t->footer.num_blocks;
+    uint64_t cmps = 0;
+    while (lo < hi) {
+        cmps++;
+        size_t mid = lo + (hi - lo) / 2;
+        if (t->index[mid].last_key < key) lo = mid + 1;
+        else hi = mid;
+    }
+    it->block = lo;
+    sst_iter_load(it);
+    if (!it->valid) {
+        stats_add(STAT_KEY_COMPARISONS, cmps);
+        return;
+    }
+
+    uint32_t l = 0, h = it->count;
+    while (l < h) {
+        cmps++;
+        uint32_t mid = l + (h - l) / 2;
+        if (it->keys[mid] < key) l = mid + 1;
+        else h = mid;
+    }
+    stats_add(STAT_KEY_COMPARISONS, cmps);
+    it->pos = l; // < count: the block's last key is >= key
+    sst_iter_fill(it);
+}
+
+void sst_iter_next(SSTIterator *it) {
+    if (!it->valid) return;
+    if (++it->pos >= it->count) {
+        it->block++;
+        sst_iter_load(it);
+        if (!it->valid) return;
+    }
+    sst_iter_fill(it);
+}
+
+void sst_iter_destroy(SSTIterator *it) {
+    free(it->buf);
+    free(it->keys);
+    it->buf = NULL;
+    it->keys = NULL;
+    it->valid = 0;
+}
@@ -0,0 +1,158 @@
+#ifndef SSTABLE_H
+#define SSTABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "bloom.h"
+#include "ioring.h"
+#include "blockcache.h"
+
+extern _Atomic uint64_t physical_bytes_written;
+extern _Atomic uint64_t bloom_negatives;        // Lookups a filter answered without I/O
+extern _Atomic uint64_t bloom_false_positives;  // Filter said "maybe", block had no such key
+
+// On-disk SSTable layout (all regions 4KB aligned so they can go through O_DIRECT):
+//
+//   [data block 0][data block 1]...[data block N-1][index | bloom filter | value page map ... footer]
+//
+// Each data block is SST_BLOCK_SIZE bytes: a small header followed by
+// key-sorted records, encoded as the table's SSTEncoding says (one per table,
+// in the footer). A compressed block holds up to SST_MAX_RAW_BYTES of
+// encoded records squeezed into the same 4KB. The sparse index holds one entry per data block (its
+// first/last key and file offset), followed by the table's Bloom filter bits.
+// The footer lives in the last bytes of the final block so a reader can find
+// everything with one read of the file tail.
+//
+// A record is a key, a 2-bit kind the table doesn't interpret (the LSM's
+// value / tombstone / ...) and a 64-bit value. Values that are byte strings
+// go to value pages, 4KB pages of value bytes laid end to end and written
+// between the data blocks as they fill up; the record holds their slot
+// (offset in that byte stream << 16 | length) and the page map in the meta
+// region finds each page in the file.
+
+#define SST_BLOCK_SIZE 4096
+#define SST_WRITE_BUF_BLOCKS 4 // 16KB per write; the writer keeps io depth of them in flight
+#define SST_MAGIC 0x34304d534c545353ULL // "SSTLSM04"
+
+typedef enum {
+    SST_ENCODING_PLAIN,   // Packed 17-byte records, binary searched in place
+    SST_ENCODING_DELTA,   // Key delta from the previous record (kind bits folded in) + varint value
+    SST_ENCODING_DELTA_LZ // DELTA, then each block LZ-compressed (lz.c) to fit more records per 4KB
+} SSTEncoding;
+
+typedef struct __attribute__((packed)) {
+    uint64_t key;
+    uint64_t value;
+    uint8_t kind;
+} SSTRecord;
+
+typedef struct {
+    uint32_t count;   // Records in this block
+    uint16_t payload; // Bytes stored after the header
+    uint16_t raw;     // Encoded bytes once decompressed; equal to payload when stored as is
+} SSTBlockHeader;
+
+#define SST_BLOCK_PAYLOAD (SST_BLOCK_SIZE - sizeof(SSTBlockHeader))
+#define SST_RECORDS_PER_BLOCK (SST_BLOCK_PAYLOAD / sizeof(SSTRecord)) // Plain blocks
+#define SST_MAX_BLOCK_RECORDS 4096 // Any block, so readers can decode into fixed arrays
+#define SST_MAX_RAW_BYTES 16384    // Encoded bytes in one compressed block
+#define SST_MAX_VALUE_BYTES 65535  // One value in the value pages
+
+static inline uint32_t sst_value_len(uint64_t slot) { return (uint32_t)(slot & 0xffff); }
+
+typedef struct {
+    uint64_t first_key;
+    uint64_t last_key;
+    uint64_t offset;
+} SSTIndexEntry;
+
+typedef struct {
+    uint64_t min_key;
+    uint64_t max_key;
+    uint64_t num_entries;
+    uint64_t num_blocks;
+    uint64_t index_offset; // Byte offset of the first index entry
+    uint64_t filter_offset;
+    uint32_t filter_bytes; // 0 when the table was written without a filter
+    uint32_t filter_hashes;
+    uint32_t encoding;     // SSTEncoding of every data block
+    uint32_t reserved;
+    uint64_t value_pages;  // Pages of value bytes, mapped by the array at vmap_offset
+    uint64_t vmap_offset;
+    uint64_t magic;
+} SSTFooter;
+
+// Writer: records must be added in strictly increasing key order.
+typedef struct SSTWriter SSTWriter;
+
+// bloom_bits_per_key <= 0 disables the filter for this table. io NULL: synchronous writes.
+SSTWriter* sst_writer_open(const char *path, SSTEncoding encoding, int bloom_bits_per_key, const IORingOptions *io);
+int sst_writer_add(SSTWriter *w, uint64_t key, uint64_t value, int kind);
+// Appends len (<= SST_MAX_VALUE_BYTES) bytes to the value pages and returns
+// their slot, to be added as some record's value
+uint64_t sst_writer_add_value(SSTWriter *w, const void *data, uint32_t len);
+uint64_t sst_writer_entries(const SSTWriter *w);
+uint64_t sst_writer_bytes(const SSTWriter *w); // Data blocks completed so far, for cutting files at a size
+const char* sst_encoding_name(SSTEncoding e);
+int sst_writer_finish(SSTWriter *w); // Writes tail block, index and footer, then frees w
+
+// Reader: footer, index and filter are loaded at open and stay in memory;
+// each lookup that passes the filter reads one data block, from the block
+// cache or with an O_DIRECT read (the kernel page cache is bypassed). A
+// table opened from a known footer (sst_open_lazy) reads nothing until its
+// first lookup or iterator loads the index and filter.
+// Handles are reference counted so compaction can retire a table while
+// lookups still hold it: sst_open returns one reference, sst_close drops one.
+typedef struct SSTable {
+    int fd;
+    uint64_t id;       // Unique per open table: its blocks' key in the cache
+    BlockCache *cache; // NULL: every block read goes to the device
+    _Atomic int refs;
+    uint64_t file_bytes;
+    SSTFooter footer;
+    SSTIndexEntry *index;
+    uint64_t *vmap;    // File offset of each value page
+    BloomFilter filter;
+    _Atomic bool meta_loaded; // index, vmap and filter are in
+    pthread_mutex_t meta_lock;
+} SSTable;
+
+SSTable* sst_open(const char *path, BlockCache *cache);
+// Opens the file only; footer and file_bytes come from the caller (the LSM
+// manifest). NULL if the file can't be opened or the footer is not a table's.
+SSTable* sst_open_lazy(const char *path, BlockCache *cache, const SSTFooter *footer, uint64_t file_bytes);
+void sst_ref(SSTable *t);
+// Returns 1 if key is present (value/kind filled), 0 if absent, -1 on I/O error.
+int sst_get(SSTable *t, uint64_t key, uint64_t *value, int *kind);
+// Copies the first cap bytes of the value in slot, through the block cache
+// (filling it if fill_cache). Returns the value's full length, -1 on I/O error.
+int sst_read_value(SSTable *t, uint64_t slot, void *buf, uint32_t cap, bool fill_cache);
+void sst_close(SSTable *t);
+
+// Sequential scan over the records of a table, block by block (compaction
+// input, range scans).
+typedef struct {
+    SSTable *t;
+    uint64_t block; // Index of the block held in buf
+    uint32_t pos;   // Record position inside that block
+    uint32_t count; // Records in it
+    char *buf;      // The block as read (aligned for O_DIRECT)
+    uint64_t *keys; // Its records decoded, SST_MAX_BLOCK_RECORDS each
+    uint64_t *values;
+    uint8_t *kinds;
+    bool fill_cache; // Blocks read from disk go into the cache (scans yes, compaction input no)
+    int valid;
+    uint64_t key;
+    uint64_t value;
+    int kind;
+} SSTIterator;
+
+void sst_iter_init(SSTIterator *it, SSTable *t, bool fill_cache);
+void sst_iter_seek(SSTIterator *it, SSTable *t, uint64_t key, bool fill_cache); // Starts at the first record >= key
+void sst_iter_next(SSTIterator *it);
+void sst_iter_destroy(SSTIterator *it);
+
+#endif
@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+__thread StatsSlot *stats_tls = NULL;
+
+// Slots of running threads. A thread's slot is folded into `retired` and
+// put on the free list when the thread exits, so short-lived worker threads
+// don't grow the list.
+typedef struct SlotNode {
+    StatsSlot slot;
+    struct SlotNode *next;
+} SlotNode;
+
+static pthread_mutex_t slots_lock = PTHREAD_MUTEX_INITIALIZER;
+static SlotNode *active = NULL;
+static SlotNode *free_slots = NULL;
+static uint64_t retired[STAT_NUM];
+static pthread_key_t slot_key;
+static pthread_once_t slot_key_once = PTHREAD_ONCE_INIT;
+
+static const char *counter_names[STAT_NUM] = {
+    "lookups", "lookup_files", "lookup_blocks", "bytes_read", "key_comparisons", "lock_wait_ns",
+    "cache_hits", "cache_misses",
+};
+
+const char* stats_counter_name(StatCounter c) {
+    return counter_names[c];
+}
+
+static void slot_retire(void *arg) {
+    SlotNode *node = (SlotNode*)arg;
+    pthread_mutex_lock(&slots_lock);
+    for (int i = 0; i < STAT_NUM; i++) {
+        retired[i] += atomic_load_explicit(&node->slot.c[i], memory_order_relaxed);
+        atomic_store_explicit(&node->slot.c[i], 0, memory_order_relaxed);
+    }
+    SlotNode **pp = &active;
+    while (*pp != node) pp = &(*pp)->next;
+    *pp = node->next;
+    node->next = free_slots;
+    free_slots = node;
+    pthread_mutex_unlock(&slots_lock);
+}
+
+static void slot_key_init(void) {
+    pthread_key_create(&slot_key, slot_retire);
+}
+
+StatsSlot* stats_slot_new(void) {
+    pthread_once(&slot_key_once, slot_key_init);
+    pthread_mutex_lock(&slots_lock);
+    SlotNode *node = free_slots;
+    if (node) free_slots = node->next;
+    else node = (SlotNode*)calloc(1, sizeof(SlotNode));
+    node->next = active;
+    active = node;
+    pthread_mutex_unlock(&slots_lock);
+    pthread_setspecific(slot_key, node); // The main thread never exits through it: its slot just stays
+    stats_tls = &node->slot;
+    return stats_tls;
+}
+
+uint64_t stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void stats_snapshot(EngineStats *out) {
+    memset(out, 0, sizeof(*out));
+    pthread_mutex_lock(&slots_lock);
+    for (int i = 0; i < STAT_NUM; i++) out->counters[i] = retired[i];
+    for (SlotNode *n = active; n; n = n->next) {
+        for (int i = 0; i < STAT_NUM; i++) out->counters[i] += atomic_load_explicit(&n->slot.c[i], memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&slots_lock);
+    out->physical_bytes = physical_bytes_written;
+    out->logical_bytes = logical_bytes_written;
+}
+
+void stats_delta(EngineStats *out, const EngineStats *after, const EngineStats *before) {
+    for (int i = 0; i < STAT_NUM; i++) out->counters[i] = after->counters[i] - before->counters[i];
+    out->physical_bytes = after->physical_bytes - before->physical_bytes;
+    out->logical_bytes = after->logical_bytes - before->logical_bytes;
+    out->live_bytes = after->live_bytes;
+    out->disk_bytes = after->disk_bytes;
+}
@@ -0,0 +1,82 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+extern _Atomic uint64_t physical_bytes_written;
+extern _Atomic uint64_t logical_bytes_written;
+
+// Read-side and contention counters for both engines, next to the global
+// WAF byte counters. Each thread bumps its own slot (plain relaxed
+// load + store, no lock prefix, no shared cache line); stats_snapshot sums
+// the slots of live threads plus what exited threads left behind. The
+// counters are process wide: with one engine running at a time, as in the
+// benchmarks, a snapshot delta is that engine's phase.
+
+typedef enum {
+    STAT_LOOKUPS,         // Point lookups
+    STAT_LOOKUP_FILES,    // Files a lookup had to consult (LSM: SSTables covering the key; B-Tree: its one file)
+    STAT_LOOKUP_BLOCKS,   // Blocks a lookup touched (LSM: data blocks, cached or not; B-Tree: pages on the root-to-leaf path)
+    STAT_BYTES_READ,      // Everything read from disk: lookups, scans, compaction input, buffer pool misses
+    STAT_KEY_COMPARISONS, // Skiplist, SSTable and node searches (SIMD node search counted as its binary search depth)
+    STAT_LOCK_WAIT_NS,    // Time blocked on a latch or lock that was taken when asked for
+    STAT_CACHE_HITS,      // Block reads served from memory (LSM: block cache; B-Tree: buffer pool)
+    STAT_CACHE_MISSES,    // Block reads that went to the device
+    STAT_NUM
+} StatCounter;
+
+typedef struct {
+    uint64_t counters[STAT_NUM];
+    uint64_t physical_bytes;   // Copies of the WAF counters
+    uint64_t logical_bytes;
+    uint64_t live_bytes;       // 16 bytes per live key (filled in by the engine)
+    uint64_t disk_bytes;       // Files on disk (filled in by the engine)
+} EngineStats;
+
+typedef struct {
+    _Atomic uint64_t c[STAT_NUM];
+} StatsSlot;
+
+StatsSlot* stats_slot_new(void); // First use on a thread
+
+extern __thread StatsSlot *stats_tls;
+
+static inline void stats_add(StatCounter c, uint64_t n) {
+    StatsSlot *s = stats_tls;
+    if (!s) s = stats_slot_new();
+    atomic_store_explicit(&s->c[c], atomic_load_explicit(&s->c[c], memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+uint64_t stats_now_ns(void);
+
+// Lock wrappers that only read the clock when the lock is contended
+static inline void stats_rdlock(pthread_rwlock_t *l) {
+    if (pthread_rwlock_tryrdlock(l) == 0) return;
+    uint64_t t0 = stats_now_ns();
+    pthread_rwlock_rdlock(l);
+    stats_add(STAT_LOCK_WAIT_NS, stats_now_ns() - t0);
+}
+
+static inline void stats_wrlock(pthread_rwlock_t *l) {
+    if (pthread_rwlock_trywrlock(l) == 0) return;
+    uint64_t t0 = stats_now_ns();
+    pthread_rwlock_wrlock(l);
+    stats_add(STAT_LOCK_WAIT_NS, stats_now_ns() - t0);
+}
+
+static inline void stats_mutex_lock(pthread_mutex_t *m) {
+    if (pthread_mutex_trylock(m) == 0) return;
+    uint64_t t0 = stats_now_ns();
+    pthread_mutex_lock(m);
+    stats_add(STAT_LOCK_WAIT_NS, stats_now_ns() - t0);
+}
+
+// Counters and WAF bytes so far; live/disk bytes are left at 0
+void stats_snapshot(EngineStats *out);
+// after - before for the counters and WAF bytes; live/disk bytes from after
+void stats_delta(EngineStats *out, const EngineStats *after, const EngineStats *before);
+const char* stats_counter_name(StatCounter c);
+
+#endif
@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "valheap.h"
+#include "stats.h"
+
+#define VH_PAGE_DATA (BP_PAGE_SIZE - sizeof(VHPageHeader)) // Value bytes per overflow page
+
+static VHPageHeader* vh_header(BPFrame *f) { return (VHPageHeader*)f->data; }
+static VHSlot* vh_slots(BPFrame *f) { return (VHSlot*)(f->data + sizeof(VHPageHeader)); }
+
+static uint32_t vh_page_free(const VHPageHeader *h) {
+    uint32_t used = sizeof(VHPageHeader) + (h->num_slots + 1) * sizeof(VHSlot); // With one more slot
+    return h->data_start > used ? h->data_start - used : 0;
+}
+
+// Pages are latched exclusively for every change and moved to a new version
+// (bufpool.h), so vh_read can copy tuples without latching
+static void vh_latch(BPFrame *f) {
+    stats_wrlock(&f->latch);
+    bp_write_begin(f);
+}
+
+static void vh_unlatch(BPFrame *f) {
+    bp_write_end(f);
+    pthread_rwlock_unlock(&f->latch);
+}
+
+ValueHeap* vh_create(BufferPool *pool) {
+    ValueHeap *vh = (ValueHeap*)calloc(1, sizeof(ValueHeap));
+    vh->pool = pool;
+    pthread_mutex_init(&vh->lock, NULL);
+    vh->fill_page = BP_NO_PAGE;
+    return vh;
+}
+
+// A chain of fresh pages, each holding up to VH_PAGE_DATA bytes. Nothing
+// points at them until the TID is returned, but they are latched like any
+// page so a checkpoint never writes one half filled.
+static uint64_t vh_insert_overflow(ValueHeap *vh, const void *data, uint32_t len) {
+    const char *p = (const char*)data;
+    BPFrame *f = bp_new_page(vh->pool);
+    uint64_t first = f->page_no;
+    for (;;) {
+        vh_latch(f);
+        VHPageHeader *h = vh_header(f);
+        uint32_t n = len < VH_PAGE_DATA ? len : (uint32_t)VH_PAGE_DATA;
+        h->flags = VH_PAGE_OVERFLOW;
+        h->data_start = (uint16_t)n;
+        memcpy(f->data + sizeof(VHPageHeader), p, n);
+        p += n;
+        len -= n;
+        atomic_fetch_add(&vh->overflow_pages, 1);
+        BPFrame *next = len > 0 ? bp_new_page(vh->pool) : NULL;
+        h->next = next ? next->page_no : BP_NO_PAGE;
+        vh_unlatch(f);
+        bp_unpin(vh->pool, f, true);
+        if (!next) break;
+        f = next;
+    }
+    return vh_tid(first, VH_OVERFLOW, (uint32_t)(p - (const char*)data));
+}
+
+uint64_t vh_insert(ValueHeap *vh, const void *data, uint32_t len) {
+    if (len > VH_MAX_VALUE) len = VH_MAX_VALUE;
+    if (len > VH_MAX_INLINE) return vh_insert_overflow(vh, data, len);
+
+    pthread_mutex_lock(&vh->lock);
+    BPFrame *f = NULL;
+    if (vh->fill_page != BP_NO_PAGE) {
+        f = bp_fetch(vh->pool, vh->fill_page);
+        vh_latch(f);
+        if (vh_page_free(vh_header(f)) < len) {
+            vh_unlatch(f);
+            bp_unpin(vh->pool, f, false);
+            f = NULL;
+        }
+    }
+    if (!f) {
+        f = bp_new_page(vh->pool);
+        vh_latch(f);
+        vh_header(f)->data_start = BP_PAGE_SIZE;
+        vh->fill_page = f->page_no;
+        atomic_fetch_add(&vh->pages, 1);
+    }
+
+    VHPageHeader *h = vh_header(f);
+    uint32_t slot = h->num_slots++;
+    h->data_start -= len;
+    memcpy(f->data + h->data_start, data, len);
+    vh_slots(f)[slot].off = h->data_start;
+    vh_slots(f)[slot].len = (uint16_t)len;
+    uint64_t page = f->page_no;
+    vh_unlatch(f);
+    bp_unpin(vh->pool, f, true);
+    pthread_mutex_unlock(&vh->lock);
+    return vh_tid(page, slot, len);
+}
+
+int vh_read(ValueHeap *vh, uint64_t tid, void *buf, uint32_t cap, int *pages) {
+    uint32_t len = vh_tid_len(tid), want = len < cap ? len : cap;
+    int read = 0;
+    for (;;) {
+        // Optimistic: copy, then keep the copy only if the first page's
+        // version held. An overflow chain only changes through its first
+        // page, which stays latched meanwhile, and heap pages are never
+        // reused, so the chain's links can be followed as they are.
+        BPFrame *first = bp_fetch(vh->pool, vh_tid_page(tid));
+        uint64_t version;
+        read++;
+        if (!bp_read_begin(first, &version)) {
+            bp_unpin(vh->pool, first, false);
+            sched_yield();
+            continue;
+        }
+        int rc = (int)len;
+        if (vh_tid_slot(tid) != VH_OVERFLOW) {
+            uint32_t slot = vh_tid_slot(tid);
+            VHSlot s = {0, 0};
+            if (slot < vh_header(first)->num_slots && slot < VH_PAGE_DATA / sizeof(VHSlot)) s = vh_slots(first)[slot];
+            if (s.off == 0 || s.len != len || s.off + len > BP_PAGE_SIZE) rc = -1;
+            else memcpy(buf, first->data + s.off, want);
+        } else if (vh_header(first)->flags & VH_PAGE_DEAD) {
+            rc = -1;
+        } else {
+            BPFrame *f = first;
+            char *out = (char*)buf;
+            uint32_t left = want;
+            for (;;) {
+                uint32_t n = vh_header(f)->data_start;
+                if (n > VH_PAGE_DATA) n = VH_PAGE_DATA;
+                if (n > left) n = left;
+                memcpy(out, f->data + sizeof(VHPageHeader), n);
+                out += n;
+                left -= n;
+                uint64_t next = vh_header(f)->next;
+                if (f != first) bp_unpin(vh->pool, f, false);
+                if (left == 0 || next == BP_NO_PAGE) break;
+                f = bp_fetch(vh->pool, next);
+                read++;
+            }
+        }
+        bool valid = bp_read_valid(first, version);
+        bp_unpin(vh->pool, first, false);
+        if (!valid) continue;
+        if (pages) *pages = read;
+        return rc;
+    }
+}
+
+bool vh_update(ValueHeap *vh, uint64_t tid, const void *data, uint32_t len) {
+    if (len != vh_tid_len(tid)) return false;
+    BPFrame *f = bp_fetch(vh->pool, vh_tid_page(tid));
+    vh_latch(f);
+    bool done = false;
+    if (vh_tid_slot(tid) != VH_OVERFLOW) {
+        uint32_t slot = vh_tid_slot(tid);
+        VHSlot *s = &vh_slots(f)[slot];
+        if (slot < vh_header(f)->num_slots && s->off != 0 && s->len == len) {
+            memcpy(f->data + s->off, data, len);
+            done = true;
+        }
+    } else if (!(vh_header(f)->flags & VH_PAGE_DEAD)) {
+        const char *p = (const char*)data;
+        uint64_t next = vh_header(f)->next;
+        memcpy(f->data + sizeof(VHPageHeader), p, vh_header(f)->data_start);
+        p += vh_header(f)->data_start;
+        while (next != BP_NO_PAGE) {
+            BPFrame *g = bp_fetch(vh->pool, next);
+            vh_latch(g);
+            memcpy(g->data + sizeof(VHPageHeader), p, vh_header(g)->data_start);
+            p += vh_header(g)->data_start;
+            next = vh_header(g)->next;
+            vh_unlatch(g);
+            bp_unpin(vh->pool, g, true);
+        }
+        done = true;
+    }
+    vh_unlatch(f);
+    bp_unpin(vh->pool, f, done);
+    return done;
+}
+
+void vh_delete(ValueHeap *vh, uint64_t tid) {
+    BPFrame *f = bp_fetch(vh->pool, vh_tid_page(tid));
+    vh_latch(f);
+    if (vh_tid_slot(tid) != VH_OVERFLOW) {
+        uint32_t slot = vh_tid_slot(tid);
+        if (slot < vh_header(f)->num_slots) vh_slots(f)[slot].off = 0;
+    } else {
+        vh_header(f)->flags |= VH_PAGE_DEAD; // The whole chain is dead
+    }
+    vh_unlatch(f);
+    bp_unpin(vh->pool, f, true);
+    atomic_fetch_add(&vh->dead_bytes, vh_tid_len(tid));
+}
+
+void vh_free(ValueHeap *vh) {
+    pthread_mutex_destroy(&vh->lock);
+    free(vh);
+}
@@ -0,0 +1,72 @@
+#ifndef VALHEAP_H
+#define VALHEAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "bufpool.h"
+
+// Value heap: byte-string values of a B-Tree, kept out of its leaves the
+// way Postgres keeps tuples in a heap next to its indexes. The leaf stores a
+// tuple id (TID) in place of the value, so the node layout and fan-out don't
+// depend on the value size.
+//
+// Heap pages share the tree's buffer pool and file. A page is slotted:
+//
+//   [VHPageHeader][slot 0][slot 1]...  free  ...[tuple 1][tuple 0]
+//
+// slots grow from the front and tuple bytes from the back. Values over
+// VH_MAX_INLINE bytes get a chain of overflow pages of their own (TOAST
+// style). Tuples are appended to the current fill page; a deleted one only
+// has its slot cleared, its bytes stay dead in the page (there is no vacuum).
+//
+// TID: page (36 bits) | slot (12 bits) | length (16 bits), so the length of
+// a value is known without reading it. Overflow values use slot VH_OVERFLOW.
+
+#define VH_MAX_INLINE 2000 // Larger values go to overflow pages
+#define VH_MAX_VALUE 65535
+#define VH_OVERFLOW 0xfff
+
+typedef struct {
+    uint16_t num_slots;
+    uint16_t data_start; // Lowest tuple byte; free space ends here
+    uint32_t flags;
+    uint64_t next;       // Overflow pages: the next page of the chain
+} VHPageHeader;
+
+typedef struct {
+    uint16_t off; // 0: dead
+    uint16_t len;
+} VHSlot;
+
+#define VH_PAGE_OVERFLOW 1
+#define VH_PAGE_DEAD 2 // First page of a deleted overflow chain
+
+static inline uint64_t vh_tid(uint64_t page, uint32_t slot, uint32_t len) {
+    return page << 28 | (uint64_t)slot << 16 | len;
+}
+static inline uint64_t vh_tid_page(uint64_t tid) { return tid >> 28; }
+static inline uint32_t vh_tid_slot(uint64_t tid) { return (uint32_t)(tid >> 16) & 0xfff; }
+static inline uint32_t vh_tid_len(uint64_t tid) { return (uint32_t)(tid & 0xffff); }
+
+typedef struct {
+    BufferPool *pool;
+    pthread_mutex_t lock; // Fill page
+    uint64_t fill_page;   // BP_NO_PAGE until the first insert of this run
+    _Atomic uint64_t pages;
+    _Atomic uint64_t overflow_pages;
+    _Atomic uint64_t dead_bytes;
+} ValueHeap;
+
+ValueHeap* vh_create(BufferPool *pool);
+uint64_t vh_insert(ValueHeap *vh, const void *data, uint32_t len); // len <= VH_MAX_VALUE
+// Copies the first cap bytes of the tuple. Returns its length, -1 if it was
+// deleted. pages, if not NULL, gets the heap pages read.
+int vh_read(ValueHeap *vh, uint64_t tid, void *buf, uint32_t cap, int *pages);
+// Overwrites the tuple in place; false (nothing done) if it's dead or len differs
+bool vh_update(ValueHeap *vh, uint64_t tid, const void *data, uint32_t len);
+void vh_delete(ValueHeap *vh, uint64_t tid);
+void vh_free(ValueHeap *vh); // The pages belong to the pool
+
+#endif
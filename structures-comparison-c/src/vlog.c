@@ -0,0 +1,297 @@
+#define _GNU_SOURCE // Needed for O_DIRECT
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "vlog.h"
+#include "stats.h"
+
+typedef struct {
+    uint64_t no;
+    WAL *wal;                 // Until sealed
+    int fd;                   // O_DIRECT reads once sealed
+    bool sealed;              // Changed with segs_lock held exclusively
+    bool full;                // No more appends; sealed by the last writer still inside it
+    _Atomic int writers;      // Appends added but not committed yet
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t garbage;
+} VLogSegment;
+
+struct VLog {
+    char *dir;
+    uint64_t segment_bytes;
+    WALSyncMode mode;
+    int sync_interval_ms;
+    BlockCache *cache;
+    WALStats wal_stats;
+
+    // Segment table, sorted by number. Readers hold it shared for the whole
+    // read, so a segment can't be dropped or sealed under them.
+    pthread_rwlock_t segs_lock;
+    VLogSegment **segs;
+    int num_segs;
+    int cap_segs;
+
+    pthread_mutex_t append_lock; // Active segment and numbering
+    VLogSegment *active;
+    uint64_t next_no;
+    _Atomic uint64_t gc_runs;
+    _Atomic uint64_t gc_relocated;
+};
+
+// Block cache ids of segments: SSTable ids never get this high
+#define VLOG_CACHE_ID(no) ((1ULL << 63) | (no))
+
+void vlog_segment_path(VLog *vl, uint64_t seg, char *path, size_t len) {
+    snprintf(path, len, "%s/vlog_%06lu.log", vl->dir, seg);
+}
+
+static int vlog_open_fd(VLog *vl, uint64_t no) {
+    char path[512];
+    vlog_segment_path(vl, no, path, sizeof(path));
+#ifdef __linux__
+    return open(path, O_RDONLY | O_DIRECT);
+#else
+    return open(path, O_RDONLY);
+#endif
+}
+
+// segs_lock held exclusively
+static void vlog_table_add(VLog *vl, VLogSegment *s) {
+    if (vl->num_segs == vl->cap_segs) {
+        vl->cap_segs = vl->cap_segs ? vl->cap_segs * 2 : 16;
+        vl->segs = (VLogSegment**)realloc(vl->segs, sizeof(VLogSegment*) * vl->cap_segs);
+    }
+    int pos = vl->num_segs++;
+    while (pos > 0 && vl->segs[pos - 1]->no > s->no) {
+        vl->segs[pos] = vl->segs[pos - 1];
+        pos--;
+    }
+    vl->segs[pos] = s;
+}
+
+// segs_lock held
+static VLogSegment* vlog_find(VLog *vl, uint64_t no) {
+    int lo = 0, hi = vl->num_segs;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (vl->segs[mid]->no < no) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < vl->num_segs && vl->segs[lo]->no == no ? vl->segs[lo] : NULL;
+}
+
+// append_lock held
+static void vlog_new_segment(VLog *vl) {
+    VLogSegment *s = (VLogSegment*)calloc(1, sizeof(VLogSegment));
+    s->no = vl->next_no++;
+    s->fd = -1;
+    char path[512];
+    vlog_segment_path(vl, s->no, path, sizeof(path));
+    s->wal = wal_open(path, vl->mode, vl->sync_interval_ms, &vl->wal_stats);
+
+    pthread_rwlock_wrlock(&vl->segs_lock);
+    vlog_table_add(vl, s);
+    pthread_rwlock_unlock(&vl->segs_lock);
+    vl->active = s;
+}
+
+// Every append into the full segment is committed: make it all durable and
+// switch reads over to the file (page reads, cacheable)
+static void vlog_seal(VLog *vl, VLogSegment *s) {
+    wal_sync(s->wal);
+    int fd = vlog_open_fd(vl, s->no);
+    pthread_rwlock_wrlock(&vl->segs_lock);
+    WAL *w = s->wal;
+    s->fd = fd;
+    s->wal = NULL;
+    s->sealed = true;
+    pthread_rwlock_unlock(&vl->segs_lock);
+    wal_close(w);
+}
+
+VLog* vlog_open(const char *dir, uint64_t segment_bytes, WALSyncMode mode, int sync_interval_ms, BlockCache *cache) {
+    VLog *vl = (VLog*)calloc(1, sizeof(VLog));
+    vl->dir = strdup(dir);
+    // The last value of a segment starts before segment_bytes and may run a full payload past it
+    uint64_t max_bytes = VLOG_MAX_SEGMENT_BYTES - 2 * WAL_MAX_PAYLOAD;
+    vl->segment_bytes = segment_bytes == 0 || segment_bytes > max_bytes ? max_bytes : segment_bytes;
+    vl->mode = mode;
+    vl->sync_interval_ms = sync_interval_ms;
+    vl->cache = cache;
+    pthread_rwlock_init(&vl->segs_lock, NULL);
+    pthread_mutex_init(&vl->append_lock, NULL);
+    vl->next_no = 1;
+
+    // Segments of a previous run: read only, their garbage unknown
+    DIR *d = opendir(dir);
+    if (d) {
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL) {
+            unsigned long no;
+            char ext[8];
+            if (sscanf(de->d_name, "vlog_%lu.%7s", &no, ext) != 2 || strcmp(ext, "log") != 0) continue;
+            char path[512];
+            struct stat st;
+            vlog_segment_path(vl, no, path, sizeof(path));
+            if (stat(path, &st) != 0) continue;
+            VLogSegment *s = (VLogSegment*)calloc(1, sizeof(VLogSegment));
+            s->no = no;
+            s->fd = vlog_open_fd(vl, no);
+            s->sealed = true;
+            s->full = true;
+            s->bytes = st.st_size;
+            vlog_table_add(vl, s);
+            if (no >= vl->next_no) vl->next_no = no + 1;
+        }
+        closedir(d);
+    }
+
+    pthread_mutex_lock(&vl->append_lock);
+    vlog_new_segment(vl);
+    pthread_mutex_unlock(&vl->append_lock);
+    return vl;
+}
+
+uint64_t vlog_append(VLog *vl, uint64_t key, const void *data, uint32_t len) {
+    pthread_mutex_lock(&vl->append_lock);
+    VLogSegment *s = vl->active;
+    uint64_t off;
+    uint64_t lsn = wal_add(s->wal, key, 0, 0, 0, data, len, &off);
+    atomic_store(&s->bytes, off + len);
+    atomic_fetch_add(&s->writers, 1);
+    if (off + len >= vl->segment_bytes) {
+        s->full = true;
+        vlog_new_segment(vl);
+    }
+    pthread_mutex_unlock(&vl->append_lock);
+
+    wal_commit(s->wal, lsn);
+    // full is only set while this append is counted, so the last one out sees it
+    if (atomic_fetch_sub(&s->writers, 1) == 1 && s->full) vlog_seal(vl, s);
+    return vlog_ptr(s->no, off, len);
+}
+
+// Sealed segment: whole 4KB pages, through the cache
+static int vlog_read_pages(VLog *vl, VLogSegment *s, uint64_t off, char *out, uint32_t len) {
+    _Alignas(BC_BLOCK_SIZE) char page[BC_BLOCK_SIZE];
+    while (len > 0) {
+        uint64_t page_off = off / BC_BLOCK_SIZE * BC_BLOCK_SIZE;
+        uint32_t in_page = (uint32_t)(off - page_off);
+        uint32_t n = BC_BLOCK_SIZE - in_page < len ? BC_BLOCK_SIZE - in_page : len;
+        if (vl->cache && bc_get(vl->cache, VLOG_CACHE_ID(s->no), page_off, page)) {
+            stats_add(STAT_CACHE_HITS, 1);
+        } else {
+            if (pread(s->fd, page, BC_BLOCK_SIZE, page_off) != BC_BLOCK_SIZE) return -1;
+            stats_add(STAT_BYTES_READ, BC_BLOCK_SIZE);
+            if (vl->cache) {
+                stats_add(STAT_CACHE_MISSES, 1);
+                bc_put(vl->cache, VLOG_CACHE_ID(s->no), page_off, page);
+            }
+        }
+        memcpy(out, page + in_page, n);
+        out += n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int vlog_read(VLog *vl, uint64_t vptr, void *buf, uint32_t cap) {
+    uint32_t len = vlog_ptr_len(vptr);
+    uint32_t want = len < cap ? len : cap;
+    int rc = -1;
+    pthread_rwlock_rdlock(&vl->segs_lock);
+    VLogSegment *s = vlog_find(vl, vlog_ptr_seg(vptr));
+    if (s && want == 0) rc = 0;
+    else if (s && s->sealed) rc = vlog_read_pages(vl, s, vlog_ptr_off(vptr), (char*)buf, want);
+    else if (s) rc = wal_read(s->wal, vlog_ptr_off(vptr), buf, want);
+    pthread_rwlock_unlock(&vl->segs_lock);
+    return rc == 0 ? (int)len : -1;
+}
+
+void vlog_discard(VLog *vl, uint64_t vptr) {
+    pthread_rwlock_rdlock(&vl->segs_lock);
+    VLogSegment *s = vlog_find(vl, vlog_ptr_seg(vptr));
+    if (s) atomic_fetch_add(&s->garbage, vlog_ptr_len(vptr)); // Gone already if GC relocated it
+    pthread_rwlock_unlock(&vl->segs_lock);
+}
+
+void vlog_sync(VLog *vl) {
+    pthread_mutex_lock(&vl->append_lock);
+    wal_sync(vl->active->wal);
+    pthread_mutex_unlock(&vl->append_lock);
+}
+
+uint64_t vlog_gc_pick(VLog *vl, double min_ratio) {
+    uint64_t best = 0;
+    double best_ratio = min_ratio;
+    pthread_rwlock_rdlock(&vl->segs_lock);
+    for (int i = 0; i < vl->num_segs; i++) {
+        VLogSegment *s = vl->segs[i];
+        uint64_t bytes = atomic_load(&s->bytes);
+        if (!s->sealed || bytes == 0) continue;
+        double ratio = (double)atomic_load(&s->garbage) / bytes;
+        if (ratio >= best_ratio) {
+            best = s->no;
+            best_ratio = ratio;
+        }
+    }
+    pthread_rwlock_unlock(&vl->segs_lock);
+    return best;
+}
+
+static void vlog_segment_free(VLogSegment *s) {
+    wal_close(s->wal);
+    if (s->fd >= 0) close(s->fd);
+    free(s);
+}
+
+void vlog_gc_done(VLog *vl, uint64_t seg, uint64_t relocated_bytes) {
+    pthread_rwlock_wrlock(&vl->segs_lock);
+    VLogSegment *s = vlog_find(vl, seg);
+    if (s) {
+        int i = 0;
+        while (vl->segs[i] != s) i++;
+        memmove(&vl->segs[i], &vl->segs[i + 1], sizeof(VLogSegment*) * (vl->num_segs - i - 1));
+        vl->num_segs--;
+    }
+    pthread_rwlock_unlock(&vl->segs_lock);
+    if (!s) return;
+
+    char path[512];
+    vlog_segment_path(vl, seg, path, sizeof(path));
+    unlink(path);
+    vlog_segment_free(s);
+    atomic_fetch_add(&vl->gc_runs, 1);
+    atomic_fetch_add(&vl->gc_relocated, relocated_bytes);
+}
+
+void vlog_get_stats(VLog *vl, VLogStats *st) {
+    memset(st, 0, sizeof(VLogStats));
+    pthread_rwlock_rdlock(&vl->segs_lock);
+    st->segments = vl->num_segs;
+    for (int i = 0; i < vl->num_segs; i++) {
+        st->bytes += atomic_load(&vl->segs[i]->bytes);
+        st->garbage_bytes += atomic_load(&vl->segs[i]->garbage);
+    }
+    pthread_rwlock_unlock(&vl->segs_lock);
+    st->gc_runs = atomic_load(&vl->gc_runs);
+    st->gc_relocated = atomic_load(&vl->gc_relocated);
+}
+
+void vlog_close(VLog *vl) {
+    // No appends in flight any more: the active segment (and any not sealed
+    // yet) just closes its WAL, which syncs it
+    for (int i = 0; i < vl->num_segs; i++) vlog_segment_free(vl->segs[i]);
+    free(vl->segs);
+    pthread_rwlock_destroy(&vl->segs_lock);
+    pthread_mutex_destroy(&vl->append_lock);
+    free(vl->dir);
+    free(vl);
+}
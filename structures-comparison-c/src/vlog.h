@@ -0,0 +1,62 @@
+#ifndef VLOG_H
+#define VLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "wal.h"
+#include "blockcache.h"
+
+// Value log (WiscKey style): large values are appended here and the LSM
+// only stores a pointer to them, so flushes and compactions move 8 bytes
+// per key instead of the whole value.
+//
+// The log is a series of segment files (vlog_000001.log, ...), each written
+// through a WAL: a record carries the key, its payload the value bytes. The
+// segment being appended to is read through its WAL; sealed ones with
+// O_DIRECT page reads through the LSM's block cache.
+//
+// Space is reclaimed per segment, Titan style: the LSM reports every pointer
+// it drops (vlog_discard), and once a sealed segment's dead bytes pass a
+// ratio it is GC'd: its live values are re-appended at the head, the tree
+// repointed, and the file deleted (see lsm_vlog_gc).
+
+#define VLOG_MAX_SEGMENT_BYTES (16u << 20) // Payload offsets are 24 bits in a pointer
+
+// Pointer: segment (24 bits) | payload offset in it (24 bits) | length (16 bits)
+static inline uint64_t vlog_ptr(uint64_t seg, uint64_t off, uint32_t len) { return seg << 40 | off << 16 | len; }
+static inline uint64_t vlog_ptr_seg(uint64_t vptr) { return vptr >> 40; }
+static inline uint64_t vlog_ptr_off(uint64_t vptr) { return (vptr >> 16) & 0xffffff; }
+static inline uint32_t vlog_ptr_len(uint64_t vptr) { return (uint32_t)(vptr & 0xffff); }
+
+typedef struct VLog VLog;
+
+typedef struct {
+    int segments;
+    uint64_t bytes;         // Sum of segment sizes
+    uint64_t garbage_bytes; // Value bytes reported dead
+    uint64_t gc_runs;       // Segments collected
+    uint64_t gc_relocated;  // Live value bytes GC copied to the head
+} VLogStats;
+
+// Picks up segments already in dir (their pointers may be replayed from a
+// WAL) and starts a new one. cache may be NULL.
+VLog* vlog_open(const char *dir, uint64_t segment_bytes, WALSyncMode mode, int sync_interval_ms, BlockCache *cache);
+// Appends the value and returns its pointer once it is durable per the sync mode
+uint64_t vlog_append(VLog *vl, uint64_t key, const void *data, uint32_t len);
+// Copies the first cap bytes of the value. Returns its full length, -1 if
+// the segment is gone (collected since the pointer was read) or on I/O error.
+int vlog_read(VLog *vl, uint64_t vptr, void *buf, uint32_t cap);
+void vlog_discard(VLog *vl, uint64_t vptr); // The pointer is no longer reachable
+void vlog_sync(VLog *vl);
+
+// GC: the sealed segment with the most garbage, if its ratio is >= min_ratio.
+// Returns 0 if there is none.
+uint64_t vlog_gc_pick(VLog *vl, double min_ratio);
+// Segment file, for replaying it
+void vlog_segment_path(VLog *vl, uint64_t seg, char *path, size_t len);
+void vlog_gc_done(VLog *vl, uint64_t seg, uint64_t relocated_bytes); // Drops the segment
+void vlog_get_stats(VLog *vl, VLogStats *s);
+void vlog_close(VLog *vl);
+
+#endif
@@ -0,0 +1,342 @@
+#define _GNU_SOURCE // Needed for O_DIRECT and posix_memalign
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "wal.h"
+#include "stats.h"
+
+struct WAL {
+    int fd;
+    WALSyncMode mode;
+    int sync_interval_ms;
+    WALStats *stats;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cv;     // Signalled when a write finishes
+    char *buf;             // Pending records; buf[0] sits at file_off
+    size_t buf_len;
+    uint64_t file_off;     // Block aligned: everything before it is durable and final
+    uint64_t disk_off;     // Same, but only once its write has completed (file_off moves first)
+    char *wbuf;            // Leader's private copy of the blocks being written
+    uint64_t added_lsn;    // Records added so far
+    uint64_t durable_lsn;  // Records covered by a completed write + fdatasync
+    bool writing;          // A leader is doing I/O with the lock dropped
+    bool failed;           // A write or sync failed: nothing after durable_lsn will be acknowledged
+
+    pthread_t sync_thread; // WAL_SYNC_PERIODIC only
+    pthread_cond_t timer_cv;
+    bool closing;
+};
+
+static void* wal_alloc_aligned(size_t size) {
+    void *ptr;
+#ifdef __linux__
+    if (posix_memalign(&ptr, WAL_BLOCK_SIZE, size) != 0) return NULL;
+#else
+    ptr = malloc(size);
+#endif
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+// Record plus payload, padded to a whole number of records
+static size_t wal_record_bytes(uint32_t payload_len) {
+    return sizeof(WALRecord) + (payload_len + sizeof(WALRecord) - 1) / sizeof(WALRecord) * sizeof(WALRecord);
+}
+
+static uint32_t wal_checksum(const WALRecord *r, const void *payload) {
+    uint64_t h = r->key * 0x9E3779B97F4A7C15ULL;
+    h ^= r->value + 0x7F4A7C15ULL + (h << 6) + (h >> 2);
+    h ^= r->seq + 0x9E3779B9ULL + (h << 6) + (h >> 2);
+    h ^= r->kind | (uint64_t)r->payload_len << 8;
+    // Payload 8 bytes at a time (FNV-1a style), then the odd tail bytes
+    const uint8_t *p = (const uint8_t*)payload;
+    uint32_t i = 0;
+    for (; i + 8 <= r->payload_len; i += 8) {
+        uint64_t word;
+        memcpy(&word, p + i, sizeof(word));
+        h = (h ^ word) * 0x100000001B3ULL;
+    }
+    for (; i < r->payload_len; i++) h = (h ^ p[i]) * 0x100000001B3ULL;
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 29;
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+// Writes every pending block (the partial tail block included) and syncs.
+// Called with the lock held and no other leader writing; drops the lock for
+// the I/O so followers can keep adding records behind it. A failed write or
+// sync leaves durable_lsn where it was and marks the log failed for good:
+// the blocks it dropped from buf may be on disk only in part.
+static void wal_write_locked(WAL *w) {
+    uint64_t target = w->added_lsn;
+    if (target == w->durable_lsn || w->failed) return;
+
+    size_t len = w->buf_len;
+    size_t nblocks = (len + WAL_BLOCK_SIZE - 1) / WAL_BLOCK_SIZE;
+    size_t bytes = nblocks * WAL_BLOCK_SIZE;
+    uint64_t off = w->file_off;
+    memcpy(w->wbuf, w->buf, bytes); // Past buf_len the buffer is always zero
+
+    // Completed blocks are final once written: drop them from the buffer and
+    // keep only the partial tail block, which the next leader rewrites.
+    size_t full = len / WAL_BLOCK_SIZE * WAL_BLOCK_SIZE;
+    if (full > 0) {
+        memmove(w->buf, w->buf + full, len - full);
+        memset(w->buf + (len - full), 0, full);
+        w->buf_len -= full;
+        w->file_off += full;
+    }
+
+    uint64_t final_off = w->file_off;
+    w->writing = true;
+    pthread_mutex_unlock(&w->lock);
+
+    bool ok = true;
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t n = pwrite(w->fd, w->wbuf + done, bytes - done, off + done);
+        if (n <= 0) {
+            perror("WAL write failed");
+            ok = false;
+            break;
+        }
+        done += n;
+    }
+    if (ok && fdatasync(w->fd) != 0) {
+        perror("WAL sync failed");
+        ok = false;
+    }
+    if (ok) {
+        // WAF Metric: the log is part of the engine's write cost
+        atomic_fetch_add(&physical_bytes_written, bytes);
+        if (w->stats) {
+            atomic_fetch_add(&w->stats->bytes, bytes);
+            atomic_fetch_add(&w->stats->syncs, 1);
+        }
+    }
+
+    pthread_mutex_lock(&w->lock);
+    w->writing = false;
+    if (!ok) {
+        w->failed = true;
+    } else {
+        if (target > w->durable_lsn) w->durable_lsn = target;
+        if (final_off > w->disk_off) w->disk_off = final_off;
+    }
+    pthread_cond_broadcast(&w->cv);
+}
+
+static uint64_t wal_add_locked(WAL *w, uint64_t key, uint64_t value, uint64_t seq, int kind, const void *payload,
+                               uint32_t payload_len, uint64_t *payload_off) {
+    // Buffer full: write it out, or wait for the leader already doing so.
+    // Once written it only keeps a partial block, so the largest record fits.
+    size_t bytes = wal_record_bytes(payload_len);
+    while (w->buf_len + bytes > (size_t)WAL_BUF_BLOCKS * WAL_BLOCK_SIZE && !w->failed) {
+        if (!w->writing) wal_write_locked(w);
+        else pthread_cond_wait(&w->cv, &w->lock);
+    }
+    if (w->failed) return 0;
+
+    WALRecord *r = (WALRecord*)(w->buf + w->buf_len);
+    r->key = key;
+    r->value = value;
+    r->seq = seq;
+    r->kind = (uint8_t)kind;
+    r->valid = 1;
+    r->payload_len = (uint16_t)payload_len;
+    if (payload_len) memcpy(r + 1, payload, payload_len); // The padding after it is already zero
+    r->checksum = wal_checksum(r, payload);
+    if (payload_off) *payload_off = w->file_off + w->buf_len + sizeof(WALRecord);
+    w->buf_len += bytes;
+    if (w->stats) atomic_fetch_add(&w->stats->records, 1);
+    return ++w->added_lsn;
+}
+
+static void* wal_sync_main(void *arg) {
+    WAL *w = (WAL*)arg;
+    pthread_mutex_lock(&w->lock);
+    while (!w->closing) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += (long)w->sync_interval_ms * 1000000L;
+        ts.tv_sec += ts.tv_nsec / 1000000000L;
+        ts.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&w->timer_cv, &w->lock, &ts);
+        if (!w->writing) wal_write_locked(w);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+WAL* wal_open(const char *path, WALSyncMode mode, int sync_interval_ms, WALStats *stats) {
+    int fd;
+#ifdef __linux__
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+#else
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+#endif
+    if (fd == -1) {
+        perror("WAL open failed");
+        return NULL;
+    }
+
+    WAL *w = (WAL*)calloc(1, sizeof(WAL));
+    w->fd = fd;
+    w->mode = mode;
+    w->sync_interval_ms = sync_interval_ms > 0 ? sync_interval_ms : 1;
+    w->stats = stats;
+    w->buf = (char*)wal_alloc_aligned((size_t)WAL_BUF_BLOCKS * WAL_BLOCK_SIZE);
+    w->wbuf = (char*)wal_alloc_aligned((size_t)WAL_BUF_BLOCKS * WAL_BLOCK_SIZE);
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cv, NULL);
+    pthread_cond_init(&w->timer_cv, NULL);
+    if (mode == WAL_SYNC_PERIODIC) pthread_create(&w->sync_thread, NULL, wal_sync_main, w);
+    return w;
+}
+
+uint64_t wal_add(WAL *w, uint64_t key, uint64_t value, uint64_t seq, int kind, const void *payload,
+                 uint32_t payload_len, uint64_t *payload_off) {
+    pthread_mutex_lock(&w->lock);
+    uint64_t lsn = wal_add_locked(w, key, value, seq, kind, payload, payload_len, payload_off);
+    pthread_mutex_unlock(&w->lock);
+    return lsn;
+}
+
+int wal_commit(WAL *w, uint64_t lsn) {
+    pthread_mutex_lock(&w->lock);
+    int rc = lsn == 0 || w->failed ? -1 : 0;
+    if (w->mode != WAL_SYNC_PERIODIC) {
+        // Group commit: the first waiter to find no write in flight becomes the
+        // leader and writes everything added so far, covering the others too.
+        while (w->durable_lsn < lsn && !w->failed) {
+            if (!w->writing) wal_write_locked(w);
+            else pthread_cond_wait(&w->cv, &w->lock);
+        }
+        rc = lsn != 0 && w->durable_lsn >= lsn ? 0 : -1;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return rc;
+}
+
+int wal_append(WAL *w, uint64_t key, uint64_t value, uint64_t seq, int kind, const void *payload,
+               uint32_t payload_len) {
+    if (w->mode != WAL_SYNC_PER_WRITE) return wal_commit(w, wal_add(w, key, value, seq, kind, payload, payload_len, NULL));
+    // No sharing: wait out any write in flight so ours carries only this record
+    pthread_mutex_lock(&w->lock);
+    while (w->writing) pthread_cond_wait(&w->cv, &w->lock);
+    uint64_t lsn = wal_add_locked(w, key, value, seq, kind, payload, payload_len, NULL);
+    wal_write_locked(w);
+    int rc = lsn != 0 && w->durable_lsn >= lsn ? 0 : -1;
+    pthread_mutex_unlock(&w->lock);
+    return rc;
+}
+
+int wal_sync(WAL *w) {
+    pthread_mutex_lock(&w->lock);
+    while (w->durable_lsn < w->added_lsn && !w->failed) {
+        if (!w->writing) wal_write_locked(w);
+        else pthread_cond_wait(&w->cv, &w->lock);
+    }
+    int rc = w->durable_lsn >= w->added_lsn ? 0 : -1;
+    pthread_mutex_unlock(&w->lock);
+    return rc;
+}
+
+// O_DIRECT read of the blocks around [off, off + len)
+static int wal_pread(int fd, uint64_t off, void *dst, size_t len) {
+    uint64_t start = off / WAL_BLOCK_SIZE * WAL_BLOCK_SIZE;
+    size_t span = (off + len - start + WAL_BLOCK_SIZE - 1) / WAL_BLOCK_SIZE * WAL_BLOCK_SIZE;
+    char *buf = (char*)wal_alloc_aligned(span);
+    ssize_t n = pread(fd, buf, span, start);
+    int rc = n >= (ssize_t)(off + len - start) ? 0 : -1;
+    if (rc == 0) {
+        memcpy(dst, buf + (off - start), len);
+        stats_add(STAT_BYTES_READ, span);
+    }
+    free(buf);
+    return rc;
+}
+
+int wal_read(WAL *w, uint64_t off, void *dst, size_t len) {
+    pthread_mutex_lock(&w->lock);
+    if (off + len > w->disk_off) {
+        // With no write in flight everything before file_off is on disk and
+        // the rest sits in buf
+        while (w->writing) pthread_cond_wait(&w->cv, &w->lock);
+        if (w->failed) { // Past disk_off nothing is known to be there
+            pthread_mutex_unlock(&w->lock);
+            return -1;
+        }
+        if (off + len > w->file_off) {
+            uint64_t from = off > w->file_off ? off : w->file_off;
+            memcpy((char*)dst + (from - off), w->buf + (from - w->file_off), off + len - from);
+            len = from - off;
+        }
+    }
+    pthread_mutex_unlock(&w->lock);
+    return len ? wal_pread(w->fd, off, dst, len) : 0;
+}
+
+void wal_close(WAL *w) {
+    if (!w) return;
+    if (w->mode == WAL_SYNC_PERIODIC) {
+        pthread_mutex_lock(&w->lock);
+        w->closing = true;
+        pthread_cond_signal(&w->timer_cv);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->sync_thread, NULL);
+    }
+    wal_sync(w);
+    close(w->fd);
+    free(w->buf);
+    free(w->wbuf);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cv);
+    pthread_cond_destroy(&w->timer_cv);
+    free(w);
+}
+
+long wal_replay(const char *path, WALReplayFn fn, void *arg) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    // One memtable's worth (or one value log segment): read it whole, since
+    // payloads run across blocks
+    size_t size = st.st_size / WAL_BLOCK_SIZE * WAL_BLOCK_SIZE;
+    char *data = (char*)malloc(size ? size : 1);
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = pread(fd, data + got, size - got, got);
+        if (n <= 0) break;
+        got += n;
+    }
+    close(fd);
+    stats_add(STAT_BYTES_READ, got);
+
+    long count = 0;
+    size_t pos = 0;
+    while (pos + sizeof(WALRecord) <= got) {
+        const WALRecord *r = (const WALRecord*)(data + pos);
+        // Zero padding or a torn write: the log ends here
+        if (r->valid != 1 || pos + wal_record_bytes(r->payload_len) > got) break;
+        if (r->checksum != wal_checksum(r, r + 1)) break;
+        fn(arg, r, r + 1, pos + sizeof(WALRecord));
+        count++;
+        pos += wal_record_bytes(r->payload_len);
+    }
+    free(data);
+    return count;
+}
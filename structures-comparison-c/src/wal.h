@@ -0,0 +1,70 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+extern _Atomic uint64_t physical_bytes_written;
+
+// Append-only write-ahead log, one file per memtable.
+//
+// The file is a sequence of 4KB blocks written with O_DIRECT, holding fixed-size
+// records, each optionally followed by a payload (value bytes) padded to the
+// record size. A record without payload never spans blocks; one with a payload
+// runs on across them. The partially filled tail block is rewritten on every
+// commit, so the on-disk log is always a valid prefix followed by zero
+// padding. Replay stops at the first record that is zero or fails its
+// checksum, payload included (torn tail after a crash).
+
+#define WAL_BLOCK_SIZE 4096
+#define WAL_BUF_BLOCKS 16 // Records buffered ahead of the last durable block
+#define WAL_MAX_PAYLOAD (32 * 1024)
+
+typedef struct {
+    uint64_t key;
+    uint64_t value;
+    uint64_t seq;
+    uint32_t checksum;
+    uint8_t kind;  // The caller's record type, opaque here
+    uint8_t valid; // Always 1, so a zeroed slot is never a record
+    uint16_t payload_len; // Bytes following the record
+} WALRecord;
+
+typedef enum {
+    WAL_SYNC_PER_WRITE, // Every append does its own write + fdatasync
+    WAL_SYNC_GROUP,     // Concurrent appends share one write + fdatasync (leader/follower)
+    WAL_SYNC_PERIODIC   // Appends return at once; a timer thread syncs every interval
+} WALSyncMode;
+
+typedef struct {
+    _Atomic uint64_t records;
+    _Atomic uint64_t syncs;
+    _Atomic uint64_t bytes; // Physical bytes, tail block rewrites included
+} WALStats;
+
+typedef struct WAL WAL;
+
+// Creates (truncates) the log. stats may be shared by several logs or NULL.
+WAL* wal_open(const char *path, WALSyncMode mode, int sync_interval_ms, WALStats *stats);
+// Buffers a record (and payload_len bytes of payload, up to WAL_MAX_PAYLOAD)
+// and returns its log sequence number (0 once the log has failed), without
+// waiting. payload_off, if not NULL, gets the file offset the payload lands at.
+uint64_t wal_add(WAL *w, uint64_t key, uint64_t value, uint64_t seq, int kind, const void *payload,
+                 uint32_t payload_len, uint64_t *payload_off);
+// Returns once record `lsn` is durable as far as the sync mode promises: 0,
+// or -1 if a log write or sync failed first (also for lsn 0, a failed add).
+// A failed log stays failed; nothing added after it is acknowledged.
+int wal_commit(WAL *w, uint64_t lsn);
+int wal_append(WAL *w, uint64_t key, uint64_t value, uint64_t seq, int kind, const void *payload,
+               uint32_t payload_len); // add + commit
+int wal_sync(WAL *w); // Makes everything added so far durable; -1 as wal_commit
+// Copies len bytes at off (anything added so far, durable or still buffered). -1 on a read error.
+int wal_read(WAL *w, uint64_t off, void *dst, size_t len);
+void wal_close(WAL *w); // Syncs, closes and frees
+
+typedef void (*WALReplayFn)(void *arg, const WALRecord *rec, const void *payload, uint64_t payload_off);
+// Feeds every intact record to fn in log order. Returns the count, -1 if the file can't be read.
+long wal_replay(const char *path, WALReplayFn fn, void *arg);
+
+#endif
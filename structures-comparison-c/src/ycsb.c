@@ -0,0 +1,595 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "ycsb.h"
+
+static double ycsb_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// --- Workload definitions ---
+
+static const char *op_names[YCSB_NUM_OPS] = {"read", "update", "insert", "scan", "readmodifywrite"};
+
+const char* ycsb_op_name(YCSBOp op) {
+    return op_names[op];
+}
+
+void ycsb_workload_init(YCSBWorkload *w) {
+    memset(w, 0, sizeof(*w));
+    strcpy(w->name, "core");
+    w->record_count = 1000;
+    w->operation_count = 1000;
+    w->proportions[YCSB_READ] = 0.95;
+    w->proportions[YCSB_UPDATE] = 0.05;
+    w->request_distribution = YCSB_UNIFORM;
+    w->min_scan_length = 1;
+    w->max_scan_length = 1000;
+    w->scan_length_distribution = YCSB_UNIFORM;
+    w->ordered_inserts = false;
+    w->zipfian_constant = 0.99;
+}
+
+bool ycsb_workload_core(YCSBWorkload *w, char letter) {
+    ycsb_workload_init(w);
+    w->record_count = 10000000;
+    w->operation_count = 1000000;
+    w->request_distribution = YCSB_ZIPFIAN;
+    double *p = w->proportions;
+    memset(p, 0, sizeof(w->proportions));
+    switch (letter) {
+        case 'a': p[YCSB_READ] = 0.5;  p[YCSB_UPDATE] = 0.5; break;
+        case 'b': p[YCSB_READ] = 0.95; p[YCSB_UPDATE] = 0.05; break;
+        case 'c': p[YCSB_READ] = 1.0; break;
+        case 'd': p[YCSB_READ] = 0.95; p[YCSB_INSERT] = 0.05; w->request_distribution = YCSB_LATEST; break;
+        case 'e': p[YCSB_SCAN] = 0.95; p[YCSB_INSERT] = 0.05; w->max_scan_length = 100; break;
+        case 'f': p[YCSB_READ] = 0.5;  p[YCSB_RMW] = 0.5; break;
+        default: return false;
+    }
+    snprintf(w->name, sizeof(w->name), "workload_%c", letter);
+    return true;
+}
+
+static bool parse_u64(const char *name, const char *value, uint64_t *out) {
+    char *end;
+    unsigned long long v = strtoull(value, &end, 10);
+    if (end == value || *end != '\0') {
+        fprintf(stderr, "ycsb: %s: bad number '%s'\n", name, value);
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+static bool parse_double(const char *name, const char *value, double *out) {
+    char *end;
+    double v = strtod(value, &end);
+    if (end == value || *end != '\0' || v < 0) {
+        fprintf(stderr, "ycsb: %s: bad value '%s'\n", name, value);
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+static bool parse_distribution(const char *name, const char *value, bool allow_latest, YCSBDistribution *out) {
+    if (strcasecmp(value, "uniform") == 0) *out = YCSB_UNIFORM;
+    else if (strcasecmp(value, "zipfian") == 0) *out = YCSB_ZIPFIAN;
+    else if (allow_latest && strcasecmp(value, "latest") == 0) *out = YCSB_LATEST;
+    else {
+        fprintf(stderr, "ycsb: %s: unsupported distribution '%s'\n", name, value);
+        return false;
+    }
+    return true;
+}
+
+bool ycsb_workload_set(YCSBWorkload *w, const char *name, const char *value) {
+    uint64_t u;
+    if (strcmp(name, "recordcount") == 0) return parse_u64(name, value, &w->record_count);
+    if (strcmp(name, "operationcount") == 0) return parse_u64(name, value, &w->operation_count);
+    if (strcmp(name, "readproportion") == 0) return parse_double(name, value, &w->proportions[YCSB_READ]);
+    if (strcmp(name, "updateproportion") == 0) return parse_double(name, value, &w->proportions[YCSB_UPDATE]);
+    if (strcmp(name, "insertproportion") == 0) return parse_double(name, value, &w->proportions[YCSB_INSERT]);
+    if (strcmp(name, "scanproportion") == 0) return parse_double(name, value, &w->proportions[YCSB_SCAN]);
+    if (strcmp(name, "readmodifywriteproportion") == 0) return parse_double(name, value, &w->proportions[YCSB_RMW]);
+    if (strcmp(name, "requestdistribution") == 0) return parse_distribution(name, value, true, &w->request_distribution);
+    if (strcmp(name, "scanlengthdistribution") == 0) return parse_distribution(name, value, false, &w->scan_length_distribution);
+    if (strcmp(name, "zipfianconstant") == 0) {
+        if (!parse_double(name, value, &w->zipfian_constant)) return false;
+        if (w->zipfian_constant <= 0 || w->zipfian_constant >= 1) {
+            fprintf(stderr, "ycsb: %s must be in (0, 1)\n", name);
+            return false;
+        }
+        return true;
+    }
+    if (strcmp(name, "minscanlength") == 0 || strcmp(name, "maxscanlength") == 0) {
+        if (!parse_u64(name, value, &u)) return false;
+        if (u < 1 || u > UINT32_MAX) {
+            fprintf(stderr, "ycsb: %s out of range\n", name);
+            return false;
+        }
+        if (name[1] == 'i') w->min_scan_length = (uint32_t)u;
+        else w->max_scan_length = (uint32_t)u;
+        return true;
+    }
+    if (strcmp(name, "valuesize") == 0) {
+        if (!parse_u64(name, value, &u)) return false;
+        if (u > ENGINE_MAX_VALUE_BYTES) {
+            fprintf(stderr, "ycsb: %s must be at most %d\n", name, ENGINE_MAX_VALUE_BYTES);
+            return false;
+        }
+        w->value_size = (uint32_t)u;
+        return true;
+    }
+    if (strcmp(name, "insertorder") == 0) {
+        if (strcasecmp(value, "ordered") == 0) w->ordered_inserts = true;
+        else if (strcasecmp(value, "hashed") == 0) w->ordered_inserts = false;
+        else {
+            fprintf(stderr, "ycsb: insertorder: expected hashed or ordered, got '%s'\n", value);
+            return false;
+        }
+        return true;
+    }
+    return true; // workload, readallfields, fieldcount, ...: nothing to do with u64 records
+}
+
+static char* trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) *--end = '\0';
+    return s;
+}
+
+bool ycsb_workload_load(YCSBWorkload *w, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    char line[512];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        char *s = trim(line);
+        if (*s == '\0' || *s == '#') continue;
+        char *eq = strchr(s, '=');
+        if (!eq) continue;
+        *eq = '\0';
+        ok = ycsb_workload_set(w, trim(s), trim(eq + 1));
+    }
+    fclose(f);
+
+    const char *base = strrchr(path, '/');
+    snprintf(w->name, sizeof(w->name), "%s", base ? base + 1 : path);
+    return ok;
+}
+
+// --- Generators ---
+
+static inline uint64_t rng_next(uint64_t *s) { // xorshift64*
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545F4914F6CDD1DULL;
+}
+
+static inline double rng_double(uint64_t *s) {
+    return (rng_next(s) >> 11) * (1.0 / 9007199254740992.0); // [0, 1)
+}
+
+static inline uint64_t fnv64(uint64_t v) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < 8; i++) {
+        h ^= v & 0xff;
+        h *= 1099511628211ULL;
+        v >>= 8;
+    }
+    return h;
+}
+
+static inline uint64_t ycsb_key(const YCSBWorkload *w, uint64_t keynum) {
+    return w->ordered_inserts ? keynum : fnv64(keynum);
+}
+
+// Zipfian over [0, items), Gray et al. "Quickly generating billion-record
+// synthetic databases", as in YCSB's ZipfianGenerator. zeta(n) is a sum over
+// every item, so it is extended incrementally when the item count grows.
+typedef struct {
+    double theta;
+    double alpha;
+    double zeta2;
+    double zetan;
+    double eta;
+    uint64_t items; // zetan covers this many items
+} YCSBZipf;
+
+static double zeta_sum(uint64_t from, uint64_t to, double theta) {
+    double sum = 0;
+    for (uint64_t i = from; i < to; i++) sum += 1.0 / pow((double)(i + 1), theta);
+    return sum;
+}
+
+static void zipf_init(YCSBZipf *z, uint64_t items, double theta) {
+    z->theta = theta;
+    z->alpha = 1.0 / (1.0 - theta);
+    z->zeta2 = zeta_sum(0, 2, theta);
+    z->zetan = zeta_sum(0, items, theta);
+    z->items = items;
+    z->eta = (1 - pow(2.0 / items, 1 - theta)) / (1 - z->zeta2 / z->zetan);
+}
+
+static uint64_t zipf_next(YCSBZipf *z, uint64_t items, uint64_t *rng) {
+    if (items != z->items) {
+        if (items > z->items) z->zetan += zeta_sum(z->items, items, z->theta);
+        else z->zetan = zeta_sum(0, items, z->theta);
+        z->items = items;
+        z->eta = (1 - pow(2.0 / items, 1 - z->theta)) / (1 - z->zeta2 / z->zetan);
+    }
+    double u = rng_double(rng);
+    double uz = u * z->zetan;
+    if (uz < 1.0) return 0;
+    if (uz < 1.0 + pow(0.5, z->theta)) return 1;
+    uint64_t r = (uint64_t)(items * pow(z->eta * u - z->eta + 1, z->alpha));
+    return r < items ? r : items - 1;
+}
+
+// --- Run phase ---
+
+// Inserts finish out of order (one waits on a WAL sync while the next one
+// is already done), so readers only see the contiguous prefix of finished
+// ones, like YCSB's AcknowledgedCounterGenerator. Far more than the threads
+// can have in flight at once.
+#define YCSB_ACK_WINDOW (1 << 16)
+
+typedef struct {
+    const YCSBWorkload *w;
+    StorageEngine *e;
+    double cumulative[YCSB_NUM_OPS]; // Op choice thresholds, summing to 1
+    uint64_t key_space;  // Zipfian: popularity ranks, record_count + expected inserts
+    YCSBZipf key_zipf;   // Over key_space (zipfian) or record_count (latest, grown per thread)
+    YCSBZipf scan_zipf;
+    _Atomic uint64_t next_keynum; // Claimed by inserts
+    _Atomic uint64_t inserted;    // Every key number below this is inserted and can be read
+    pthread_mutex_t ack_lock;
+    _Atomic bool acked[YCSB_ACK_WINDOW]; // Finished inserts at or above `inserted`, by keynum % window
+} YCSBShared;
+
+typedef struct {
+    YCSBShared *sh;
+    uint64_t ops;
+    uint64_t seed;
+    YCSBResult r;
+} YCSBThread;
+
+static bool scan_count(void *arg, uint64_t key, const void *value, uint32_t len) {
+    (void)key;
+    (void)value;
+    (void)len;
+    (*(uint64_t*)arg)++;
+    return true;
+}
+
+static void ack_insert(YCSBShared *sh, uint64_t keynum) {
+    atomic_store(&sh->acked[keynum % YCSB_ACK_WINDOW], true);
+    // Whoever gets the lock moves the prefix for everyone; the others don't wait
+    if (pthread_mutex_trylock(&sh->ack_lock) != 0) return;
+    uint64_t limit = atomic_load(&sh->inserted);
+    while (atomic_load(&sh->acked[limit % YCSB_ACK_WINDOW])) {
+        atomic_store(&sh->acked[limit % YCSB_ACK_WINDOW], false);
+        limit++;
+    }
+    atomic_store(&sh->inserted, limit);
+    pthread_mutex_unlock(&sh->ack_lock);
+}
+
+// A key number that has been inserted
+static uint64_t choose_keynum(YCSBShared *sh, YCSBZipf *latest, uint64_t *rng) {
+    uint64_t count = atomic_load(&sh->inserted);
+    switch (sh->w->request_distribution) {
+        case YCSB_ZIPFIAN:
+            for (;;) {
+                uint64_t k = fnv64(zipf_next(&sh->key_zipf, sh->key_space, rng)) % sh->key_space;
+                if (k < count) return k;
+            }
+        case YCSB_LATEST:
+            return count - 1 - zipf_next(latest, count, rng);
+        default:
+            return rng_next(rng) % count;
+    }
+}
+
+// Update or insert. Byte values are the thread's random buffer with v in
+// front, so consecutive writes differ without refilling the whole value.
+static void ycsb_write(const YCSBWorkload *w, StorageEngine *e, uint64_t key, uint64_t v, char *buf) {
+    if (w->value_size == 0) {
+        engine_insert(e, key, v);
+        return;
+    }
+    memcpy(buf, &v, w->value_size < sizeof(v) ? w->value_size : sizeof(v));
+    engine_put(e, key, buf, w->value_size);
+}
+
+static bool ycsb_read(const YCSBWorkload *w, StorageEngine *e, uint64_t key, char *buf) {
+    uint64_t value;
+    uint32_t len;
+    if (w->value_size == 0) return engine_search(e, key, &value);
+    return engine_get(e, key, buf, w->value_size, &len);
+}
+
+static void fill_random(char *buf, uint32_t len, uint64_t *rng) {
+    for (uint32_t i = 0; i < len; i += sizeof(uint64_t)) {
+        uint64_t r = rng_next(rng);
+        memcpy(buf + i, &r, len - i < sizeof(r) ? len - i : sizeof(r));
+    }
+}
+
+static void* ycsb_worker(void *arg) {
+    YCSBThread *t = (YCSBThread*)arg;
+    YCSBShared *sh = t->sh;
+    const YCSBWorkload *w = sh->w;
+    uint64_t rng = t->seed;
+    YCSBZipf latest = sh->key_zipf; // Private copy: its zeta grows with the inserts
+    YCSBZipf scan_zipf = sh->scan_zipf;
+    uint32_t scan_range = w->max_scan_length - w->min_scan_length + 1;
+    char *buf = (char*)malloc(w->value_size ? w->value_size : 1);
+    fill_random(buf, w->value_size, &rng);
+
+    for (int op = 0; op < YCSB_NUM_OPS; op++) hist_reset(&t->r.latency[op]);
+    for (uint64_t i = 0; i < t->ops; i++) {
+        double u = rng_double(&rng);
+        int op = 0;
+        while (op < YCSB_NUM_OPS - 1 && u >= sh->cumulative[op]) op++;
+        uint64_t op_start = hist_now_ns();
+        switch (op) {
+            case YCSB_READ:
+                if (!ycsb_read(w, sh->e, ycsb_key(w, choose_keynum(sh, &latest, &rng)), buf)) t->r.not_found++;
+                break;
+            case YCSB_UPDATE:
+                ycsb_write(w, sh->e, ycsb_key(w, choose_keynum(sh, &latest, &rng)), rng_next(&rng), buf);
+                break;
+            case YCSB_INSERT: {
+                uint64_t keynum = atomic_fetch_add(&sh->next_keynum, 1);
+                ycsb_write(w, sh->e, ycsb_key(w, keynum), keynum, buf);
+                ack_insert(sh, keynum);
+                break;
+            }
+            case YCSB_SCAN: {
+                uint64_t start = ycsb_key(w, choose_keynum(sh, &latest, &rng));
+                uint64_t len = w->scan_length_distribution == YCSB_ZIPFIAN
+                    ? zipf_next(&scan_zipf, scan_range, &rng) : rng_next(&rng) % scan_range;
+                engine_scan(sh->e, start, w->min_scan_length + len, scan_count, &t->r.scanned);
+                break;
+            }
+            case YCSB_RMW: {
+                uint64_t key = ycsb_key(w, choose_keynum(sh, &latest, &rng));
+                if (!ycsb_read(w, sh->e, key, buf)) t->r.not_found++;
+                ycsb_write(w, sh->e, key, rng_next(&rng), buf);
+                break;
+            }
+        }
+        hist_record(&t->r.latency[op], hist_now_ns() - op_start);
+        t->r.ops[op]++;
+    }
+    free(buf);
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+void ycsb_load(const YCSBWorkload *w, StorageEngine *e, YCSBResult *r) {
+    size_t n = w->record_count;
+    uint64_t *keys = (uint64_t*)malloc(sizeof(uint64_t) * (n ? n : 1));
+    for (size_t i = 0; i < n; i++) keys[i] = ycsb_key(w, i);
+    EngineStats before, after;
+    stats_snapshot(&before);
+    double start = ycsb_now();
+    // Hashed keys sort into one run the batch path can bulk load. The key
+    // doubles as the value: nothing reads values back to check them.
+    if (!w->ordered_inserts) qsort(keys, n, sizeof(uint64_t), cmp_u64);
+    if (w->value_size == 0) {
+        engine_insert_batch(e, keys, keys, n);
+    } else {
+        // The batch API takes u64 values only
+        uint64_t rng = 0x9e3779b97f4a7c15ULL;
+        char *buf = (char*)malloc(w->value_size);
+        fill_random(buf, w->value_size, &rng);
+        for (size_t i = 0; i < n; i++) ycsb_write(w, e, keys[i], keys[i], buf);
+        free(buf);
+    }
+    engine_sync(e);
+    r->load_sec = ycsb_now() - start;
+    engine_stats(e, &after);
+    stats_delta(&r->load_stats, &after, &before);
+    free(keys);
+}
+
+void ycsb_run(const YCSBWorkload *w, StorageEngine *e, int threads, YCSBResult *r) {
+    if (threads < 1) threads = 1;
+    YCSBShared *sh = (YCSBShared*)calloc(1, sizeof(YCSBShared));
+    sh->w = w;
+    sh->e = e;
+    // Proportions needn't add up to 1: YCSB normalizes them too
+    double total = 0, acc = 0;
+    for (int i = 0; i < YCSB_NUM_OPS; i++) total += w->proportions[i];
+    if (total <= 0) {
+        fprintf(stderr, "ycsb: every operation proportion is 0\n");
+        free(sh);
+        return;
+    }
+    for (int i = 0; i < YCSB_NUM_OPS; i++) {
+        acc += w->proportions[i] / total;
+        sh->cumulative[i] = acc;
+    }
+    if (w->record_count == 0 && w->proportions[YCSB_INSERT] < total) {
+        fprintf(stderr, "ycsb: recordcount=0 leaves nothing to read\n");
+        free(sh);
+        return;
+    }
+    atomic_store(&sh->next_keynum, w->record_count);
+    atomic_store(&sh->inserted, w->record_count);
+    pthread_mutex_init(&sh->ack_lock, NULL);
+
+    // Like YCSB, the zipfian key space leaves room for twice the expected
+    // inserts, so new keys get a share of the popularity ranks too
+    uint64_t expected_inserts = (uint64_t)(w->operation_count * (w->proportions[YCSB_INSERT] / total) * 2.0);
+    sh->key_space = w->record_count + expected_inserts;
+    if (w->request_distribution != YCSB_UNIFORM && w->record_count > 0) {
+        uint64_t items = w->request_distribution == YCSB_ZIPFIAN ? sh->key_space : w->record_count;
+        zipf_init(&sh->key_zipf, items, w->zipfian_constant);
+    }
+    if (w->scan_length_distribution == YCSB_ZIPFIAN) {
+        zipf_init(&sh->scan_zipf, w->max_scan_length - w->min_scan_length + 1, w->zipfian_constant);
+    }
+
+    logical_bytes_written = 0;
+    physical_bytes_written = 0;
+    engine_reset_stats(e);
+    EngineStats before, after;
+    stats_snapshot(&before);
+
+    pthread_t *tids = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+    YCSBThread *targs = (YCSBThread*)calloc(threads, sizeof(YCSBThread));
+    uint64_t chunk = w->operation_count / threads;
+    double start = ycsb_now();
+    for (int i = 0; i < threads; i++) {
+        targs[i].sh = sh;
+        targs[i].ops = (i == threads - 1) ? w->operation_count - chunk * (threads - 1) : chunk;
+        targs[i].seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+        pthread_create(&tids[i], NULL, ycsb_worker, &targs[i]);
+    }
+    for (int i = 0; i < threads; i++) pthread_join(tids[i], NULL);
+    r->run_sec = ycsb_now() - start;
+    // Dirty pages and pending compactions the run left behind are part of its write cost
+    engine_sync(e);
+    r->physical_bytes = physical_bytes_written;
+    r->logical_bytes = logical_bytes_written;
+    engine_stats(e, &after);
+    stats_delta(&r->run_stats, &after, &before);
+
+    r->threads = threads;
+    for (int op = 0; op < YCSB_NUM_OPS; op++) hist_reset(&r->latency[op]);
+    for (int i = 0; i < threads; i++) {
+        for (int op = 0; op < YCSB_NUM_OPS; op++) {
+            r->ops[op] += targs[i].r.ops[op];
+            hist_merge(&r->latency[op], &targs[i].r.latency[op]);
+        }
+        r->not_found += targs[i].r.not_found;
+        r->scanned += targs[i].r.scanned;
+    }
+    free(tids);
+    free(targs);
+    pthread_mutex_destroy(&sh->ack_lock);
+    free(sh);
+}
+
+// Read amplification (files, blocks and bytes per lookup, cache hit rate), space
+// amplification (disk over live bytes) and WAF of one phase
+static void print_amplification(const char *label, const char *phase, const EngineStats *s, uint64_t ops) {
+    const uint64_t *c = s->counters;
+    printf("%s %s RA: ", label, phase);
+    if (c[STAT_LOOKUPS]) {
+        printf("%.2f files / %.2f blocks per lookup, ", (double)c[STAT_LOOKUP_FILES] / c[STAT_LOOKUPS],
+               (double)c[STAT_LOOKUP_BLOCKS] / c[STAT_LOOKUPS]);
+    }
+    if (c[STAT_CACHE_HITS] + c[STAT_CACHE_MISSES]) {
+        printf("cache hit rate %.1f%%, ", 100.0 * c[STAT_CACHE_HITS] / (c[STAT_CACHE_HITS] + c[STAT_CACHE_MISSES]));
+    }
+    printf("%.0f bytes read per op, %.1f key comparisons per op, lock wait %.1f ms\n",
+           ops ? (double)c[STAT_BYTES_READ] / ops : 0.0, ops ? (double)c[STAT_KEY_COMPARISONS] / ops : 0.0,
+           c[STAT_LOCK_WAIT_NS] / 1e6);
+    printf("%s %s SA: ", label, phase);
+    if (s->live_bytes) printf("%.2f", (double)s->disk_bytes / s->live_bytes);
+    else printf("n/a");
+    printf(" (%.1f MB live / %.1f MB on disk), WAF ", s->live_bytes / 1e6, s->disk_bytes / 1e6);
+    if (s->logical_bytes) printf("%.2f\n", (double)s->physical_bytes / s->logical_bytes);
+    else printf("n/a\n");
+}
+
+void ycsb_print_result(const YCSBWorkload *w, const char *label, const YCSBResult *r) {
+    if (r->load_sec > 0) {
+        printf("%s Load: %.4f s (%.2f ops/sec)\n", label, r->load_sec, w->record_count / r->load_sec);
+        print_amplification(label, "Load", &r->load_stats, w->record_count);
+    }
+    uint64_t ops = 0;
+    for (int op = 0; op < YCSB_NUM_OPS; op++) ops += r->ops[op];
+    printf("%s Throughput: %.2f ops/sec (", label, r->run_sec > 0 ? ops / r->run_sec : 0.0);
+    const char *sep = "";
+    for (int op = 0; op < YCSB_NUM_OPS; op++) {
+        if (!r->ops[op]) continue;
+        printf("%s%s %lu", sep, op_names[op], r->ops[op]);
+        sep = ", ";
+    }
+    if (r->not_found) printf("%s%lu not found", sep, r->not_found);
+    printf(")\n");
+    if (r->ops[YCSB_SCAN]) {
+        printf("%s Scan: %lu entries scanned, %.2f M entries/sec\n", label, r->scanned, r->scanned / r->run_sec / 1e6);
+    }
+    for (int op = 0; op < YCSB_NUM_OPS; op++) {
+        const Histogram *h = &r->latency[op];
+        if (!h->count) continue;
+        printf("%s %s latency: p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n", label,
+               op_names[op], hist_percentile(h, 0.50) / 1e3, hist_percentile(h, 0.90) / 1e3,
+               hist_percentile(h, 0.99) / 1e3, hist_percentile(h, 0.999) / 1e3, h->max / 1e3);
+    }
+    if (r->logical_bytes) {
+        printf("%s WAF: %.2f (Phys: %lu / Log: %lu)\n", label,
+               (double)r->physical_bytes / (double)r->logical_bytes, r->physical_bytes, r->logical_bytes);
+    } else {
+        printf("%s WAF: n/a (Phys: %lu / Log: 0)\n", label, r->physical_bytes);
+    }
+    print_amplification(label, "Run", &r->run_stats, ops);
+}
+
+static void write_phase_json(FILE *f, const char *name, const EngineStats *s) {
+    fprintf(f, "\"%s\": {", name);
+    for (int i = 0; i < STAT_NUM; i++) fprintf(f, "\"%s\": %lu, ", stats_counter_name((StatCounter)i), s->counters[i]);
+    fprintf(f, "\"physical_bytes\": %lu, \"logical_bytes\": %lu, \"live_bytes\": %lu, \"disk_bytes\": %lu, ",
+            s->physical_bytes, s->logical_bytes, s->live_bytes, s->disk_bytes);
+    uint64_t lookups = s->counters[STAT_LOOKUPS];
+    if (lookups) fprintf(f, "\"ra_blocks_per_lookup\": %.4f, ", (double)s->counters[STAT_LOOKUP_BLOCKS] / lookups);
+    else fprintf(f, "\"ra_blocks_per_lookup\": null, ");
+    if (s->live_bytes) fprintf(f, "\"sa\": %.4f, ", (double)s->disk_bytes / s->live_bytes);
+    else fprintf(f, "\"sa\": null, ");
+    if (s->logical_bytes) fprintf(f, "\"waf\": %.4f}", (double)s->physical_bytes / s->logical_bytes);
+    else fprintf(f, "\"waf\": null}");
+}
+
+void ycsb_write_json(FILE *f, const YCSBWorkload *w, const char *label, const YCSBResult *r) {
+    uint64_t ops = 0;
+    for (int op = 0; op < YCSB_NUM_OPS; op++) ops += r->ops[op];
+    fprintf(f, "{\"engine\": \"%s\", \"workload\": \"%s\", \"threads\": %d, ", label, w->name, r->threads);
+    fprintf(f, "\"record_count\": %lu, \"operation_count\": %lu, \"value_size\": %u, ", w->record_count, ops, w->value_size);
+    fprintf(f, "\"load_sec\": %.6f, \"run_sec\": %.6f, \"throughput\": %.2f, ",
+            r->load_sec, r->run_sec, r->run_sec > 0 ? ops / r->run_sec : 0.0);
+    fprintf(f, "\"physical_bytes\": %lu, \"logical_bytes\": %lu, ", r->physical_bytes, r->logical_bytes);
+    if (r->logical_bytes) fprintf(f, "\"waf\": %.4f, ", (double)r->physical_bytes / (double)r->logical_bytes);
+    else fprintf(f, "\"waf\": null, ");
+    fprintf(f, "\"not_found\": %lu, \"scanned\": %lu, \"operations\": {", r->not_found, r->scanned);
+    const char *sep = "";
+    for (int op = 0; op < YCSB_NUM_OPS; op++) {
+        const Histogram *h = &r->latency[op];
+        if (!r->ops[op]) continue;
+        fprintf(f, "%s\"%s\": {\"count\": %lu, \"mean_us\": %.3f, \"p50_us\": %.3f, \"p90_us\": %.3f, "
+                   "\"p95_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f, \"max_us\": %.3f}",
+                sep, op_names[op], r->ops[op], hist_mean(h) / 1e3, hist_percentile(h, 0.50) / 1e3,
+                hist_percentile(h, 0.90) / 1e3, hist_percentile(h, 0.95) / 1e3, hist_percentile(h, 0.99) / 1e3,
+                hist_percentile(h, 0.999) / 1e3, h->max / 1e3);
+        sep = ", ";
+    }
+    fprintf(f, "}, \"phases\": {");
+    write_phase_json(f, "load", &r->load_stats);
+    fprintf(f, ", ");
+    write_phase_json(f, "run", &r->run_stats);
+    fprintf(f, "}}");
+}
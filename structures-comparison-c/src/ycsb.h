@@ -0,0 +1,89 @@
+#ifndef YCSB_H
+#define YCSB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "engine.h"
+#include "histogram.h"
+
+// YCSB core workloads over a StorageEngine: the property files in
+// benchmarks/configs (or the same workloads built in), a load phase, then
+// operationcount ops spread over N threads.
+//
+// Keys are u64. Values are u64 too unless valuesize=N asks for N-byte
+// strings (engine_put/engine_get, N <= ENGINE_MAX_VALUE_BYTES): one value
+// stands in for YCSB's fieldcount x fieldlength record, and those and the
+// other record layout properties are accepted but ignored. insertorder=hashed
+// (the default) scatters key number i to fnv64(i) like YCSB does; ordered
+// keeps i.
+
+typedef enum {
+    YCSB_UNIFORM,
+    YCSB_ZIPFIAN, // Scrambled: the hot keys are spread over the key space
+    YCSB_LATEST   // Zipfian over recency: the newest inserts are the hottest
+} YCSBDistribution;
+
+typedef enum {
+    YCSB_READ,
+    YCSB_UPDATE,
+    YCSB_INSERT,
+    YCSB_SCAN,
+    YCSB_RMW, // Read, then update the same key
+    YCSB_NUM_OPS
+} YCSBOp;
+
+typedef struct {
+    char name[64];
+    uint64_t record_count;    // Keys loaded before the run
+    uint64_t operation_count; // Ops in the run, all threads together
+    double proportions[YCSB_NUM_OPS];
+    YCSBDistribution request_distribution;
+    uint32_t min_scan_length;
+    uint32_t max_scan_length;
+    YCSBDistribution scan_length_distribution; // Uniform or zipfian
+    bool ordered_inserts;
+    double zipfian_constant;
+    uint32_t value_size; // 0: u64 values
+} YCSBWorkload;
+
+typedef struct {
+    int threads;
+    double load_sec;
+    double run_sec;
+    uint64_t ops[YCSB_NUM_OPS];
+    uint64_t not_found; // Reads (and read-modify-writes) that missed
+    uint64_t scanned;   // Entries handed back by scans
+    uint64_t physical_bytes; // Run phase, sync included
+    uint64_t logical_bytes;
+    EngineStats load_stats;  // Counter deltas of each phase, space as it ended
+    EngineStats run_stats;
+    Histogram latency[YCSB_NUM_OPS]; // ns per op, all threads merged
+} YCSBResult;
+
+// CoreWorkload defaults: 1000 records and ops, 95% reads / 5% updates, uniform
+void ycsb_workload_init(YCSBWorkload *w);
+// YCSB core workload 'a'..'f', as in benchmarks/configs. false on any other letter.
+bool ycsb_workload_core(YCSBWorkload *w, char letter);
+// Reads a property file on top of what w already holds. false (with a
+// message) if it can't be read or a known property has a bad value.
+bool ycsb_workload_load(YCSBWorkload *w, const char *path);
+// One property, as in a file or a -p override. Unknown names are ignored.
+bool ycsb_workload_set(YCSBWorkload *w, const char *name, const char *value);
+const char* ycsb_op_name(YCSBOp op);
+
+// Load phase: record_count keys through the batch API (sorted; one put per
+// key in the same order with valuesize), then a sync.
+// Both phases end with a full scan for the engine's live bytes.
+void ycsb_load(const YCSBWorkload *w, StorageEngine *e, YCSBResult *r);
+// Run phase on threads threads. Resets the byte counters and the engine's
+// stats first, and syncs at the end so buffered writes count as the run's.
+// Each op is timed into a per-thread histogram, merged into r at the end.
+void ycsb_run(const YCSBWorkload *w, StorageEngine *e, int threads, YCSBResult *r);
+void ycsb_print_result(const YCSBWorkload *w, const char *label, const YCSBResult *r);
+// One JSON object: workload, engine, throughput, per op count, mean and
+// p50/p90/p95/p99/p99.9/max latency in us, and the read / space / write
+// amplification counters of each phase
+void ycsb_write_json(FILE *f, const YCSBWorkload *w, const char *label, const YCSBResult *r);
+
+#endif